@@ -1,11 +1,14 @@
 #pragma once
 
 #include <array>
+#include <bit>
 #include <concepts>
+#include <span>
 #include <type_traits>
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 namespace xnet {
 
@@ -67,6 +70,15 @@ constexpr I betoh(const std::array<std::byte, sizeof(I)> data)
 template <std::unsigned_integral I>
 constexpr I letoh(const std::array<std::byte, sizeof(I)> data)
 {
+    // GCC does not fold the loop below into a plain load
+    if constexpr (std::endian::native == std::endian::little) {
+        if (!std::is_constant_evaluated()) {
+            I output;
+            std::memcpy(&output, data.data(), sizeof(I));
+            return output;
+        }
+    }
+
     I output = 0;
     size_t off = 0;
     for (std::byte b : data) {
@@ -77,4 +89,24 @@ constexpr I letoh(const std::array<std::byte, sizeof(I)> data)
     return output;
 }
 
+template <std::unsigned_integral I>
+constexpr I load_be(std::span<const std::byte> data, size_t offset)
+{
+    std::array<std::byte, sizeof(I)> output_data{};
+    for (size_t idx = 0; idx < sizeof(I); idx++) {
+        output_data[idx] = data[offset + idx];
+    }
+    return betoh<I>(output_data);
+}
+
+template <std::unsigned_integral I>
+constexpr void store_be(
+    std::span<std::byte> data, size_t offset, std::type_identity_t<I> n)
+{
+    auto input_data = htobe<I>(n);
+    for (size_t idx = 0; idx < sizeof(I); idx++) {
+        data[offset + idx] = input_data[idx];
+    }
+}
+
 } // namespace xnet
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/IPv4.hh>
+#include <xnet/SegmentedView.hh>
+
+/*
+ * One's complement arithmetic shared by the IPv4 header and UDP checksums,
+ * including incremental updates (RFC 1624) for in-place header rewrites.
+ */
+namespace xnet::Checksum {
+
+// Adds big-endian 16-bit words of `data` as if it starts at an even offset
+constexpr uint64_t add(uint64_t sum, std::span<const std::byte> data)
+{
+    size_t nb_u16 = data.size() / sizeof(uint16_t);
+    for (size_t u16_idx = 0; u16_idx < nb_u16; u16_idx++) {
+        uint16_t word = std::to_integer<uint8_t>(data[u16_idx * 2]);
+        word <<= 8;
+        word |= std::to_integer<uint8_t>(data[u16_idx * 2 + 1]);
+        sum += word;
+    }
+
+    if (data.size() % sizeof(uint16_t) != 0) {
+        uint16_t last = std::to_integer<uint8_t>(data.back());
+        sum += uint16_t(last << 8);
+    }
+
+    return sum;
+}
+
+constexpr uint16_t fold(uint64_t sum)
+{
+    while ((sum >> 16) != 0) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return sum;
+}
+
+constexpr uint16_t finish(uint64_t sum)
+{
+    return ~fold(sum);
+}
+
+// Folded sum of a region that starts `offset` bytes into the checksummed data
+constexpr uint16_t
+    partial(std::span<const std::byte> data, size_t offset = 0)
+{
+    uint16_t output = fold(add(0, data));
+    if (offset % 2 != 0) {
+        output = uint16_t(output << 8) | uint16_t(output >> 8);
+    }
+    return output;
+}
+
+// Chunks starting at an odd offset contribute their sum byte swapped
+inline uint64_t add(uint64_t sum, const SegmentedView &data)
+{
+    size_t offset = 0;
+    for (std::span<const std::byte> chunk : data.chunks()) {
+        sum += partial(chunk, offset);
+        offset += chunk.size();
+    }
+    return sum;
+}
+
+// RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m')
+constexpr uint16_t
+    update(uint16_t checksum, uint16_t old_sum, uint16_t new_sum)
+{
+    uint64_t sum = uint16_t(~checksum);
+    sum += uint16_t(~old_sum);
+    sum += new_sum;
+    return finish(sum);
+}
+
+constexpr uint16_t
+    update_u32(uint16_t checksum, uint32_t old_value, uint32_t new_value)
+{
+    uint16_t old_sum = fold(uint64_t(old_value >> 16) + (old_value & 0xffff));
+    uint16_t new_sum = fold(uint64_t(new_value >> 16) + (new_value & 0xffff));
+    return update(checksum, old_sum, new_sum);
+}
+
+constexpr uint16_t update_address(
+    uint16_t checksum, IPv4::Address old_value, IPv4::Address new_value)
+{
+    auto o = old_value.data_msbf();
+    auto n = new_value.data_msbf();
+    return update(checksum, partial(o), partial(n));
+}
+
+// UDP transmits a computed zero as all ones, zero means "no checksum"
+constexpr uint16_t udp_nonzero(uint16_t checksum)
+{
+    return checksum == 0 ? 0xffff : checksum;
+}
+
+constexpr uint16_t pseudo_header_sum(
+    IPv4::Address source,
+    IPv4::Address destination,
+    uint8_t protocol,
+    uint16_t length)
+{
+    auto s = source.data_msbf();
+    auto d = destination.data_msbf();
+    uint64_t sum = add(0, s);
+    sum = add(sum, d);
+    sum += protocol;
+    sum += length;
+    return fold(sum);
+}
+
+} // namespace xnet::Checksum
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <xnet/Hash.hh>
+
+namespace xnet {
+
+/*
+ * Cuckoo filter (Fan et al.) over pre-hashed keys: 16-bit fingerprints in
+ * buckets of 8, two candidate buckets per key, deletion supported. A bucket
+ * is 16 bytes, probed with one SSE2 compare where available. False positive
+ * rate is about 16 / 2^16, a failed relocation parks one victim entry.
+ *
+ * Erasing a key that was never inserted may remove another key's
+ * fingerprint, callers confirm membership first.
+ */
+struct CuckooFilter
+{
+    static constexpr size_t bucket_size = 8;
+    static constexpr size_t max_kicks = 500;
+
+    CuckooFilter(size_t capacity)
+        : m_mask(bucket_count(capacity) - 1),
+          m_buckets(new Bucket[m_mask + 1]())
+    {
+    }
+
+    CuckooFilter(const CuckooFilter &other)
+        : m_mask(other.m_mask), m_buckets(new Bucket[m_mask + 1]),
+          m_size(other.m_size), m_victim(other.m_victim), m_kick(other.m_kick)
+    {
+        std::copy_n(other.m_buckets.get(), m_mask + 1, m_buckets.get());
+    }
+
+    CuckooFilter &operator=(const CuckooFilter &) = delete;
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    size_t capacity() const
+    {
+        return (m_mask + 1) * bucket_size;
+    }
+
+    // False once full, the filter is unchanged then
+    bool insert(uint64_t hash)
+    {
+        if (m_victim.fingerprint != 0) {
+            return false;
+        }
+
+        uint16_t fp = fingerprint(hash);
+        size_t idx = hash & m_mask;
+        size_t alt = alternate(idx, fp);
+        if (put(idx, fp) || put(alt, fp)) {
+            m_size++;
+            return true;
+        }
+
+        idx = (m_kick & 1) != 0 ? alt : idx;
+        for (size_t kick = 0; kick < max_kicks; kick++) {
+            size_t slot = m_kick++ % bucket_size;
+            std::swap(fp, m_buckets[idx].slots[slot]);
+            idx = alternate(idx, fp);
+            if (put(idx, fp)) {
+                m_size++;
+                return true;
+            }
+        }
+
+        // Everything moved stays reachable, the last one displaced waits
+        m_victim = Victim{idx, fp};
+        m_size++;
+        return true;
+    }
+
+    bool contains(uint64_t hash) const
+    {
+        uint16_t fp = fingerprint(hash);
+        size_t idx = hash & m_mask;
+        size_t alt = alternate(idx, fp);
+        if (m_victim.fingerprint == fp &&
+            (m_victim.index == idx || m_victim.index == alt)) {
+            return true;
+        }
+        return match(m_buckets[idx], m_buckets[alt], fp);
+    }
+
+    bool erase(uint64_t hash)
+    {
+        uint16_t fp = fingerprint(hash);
+        size_t idx = hash & m_mask;
+        size_t alt = alternate(idx, fp);
+        if (m_victim.fingerprint == fp &&
+            (m_victim.index == idx || m_victim.index == alt)) {
+            m_victim = Victim{};
+            m_size--;
+            return true;
+        }
+
+        if (!remove(idx, fp) && !remove(alt, fp)) {
+            return false;
+        }
+        m_size--;
+
+        if (m_victim.fingerprint != 0) {
+            Victim victim = std::exchange(m_victim, Victim{});
+            m_size--;
+            insert_fingerprint(victim.index, victim.fingerprint);
+        }
+        return true;
+    }
+
+    void prefetch(uint64_t hash) const
+    {
+        size_t idx = hash & m_mask;
+        __builtin_prefetch(&m_buckets[idx]);
+        __builtin_prefetch(&m_buckets[alternate(idx, fingerprint(hash))]);
+    }
+
+    // Prefetches every bucket before the first probe
+    void contains_batch(
+        std::span<const uint64_t> hashes, std::span<bool> output) const
+    {
+        assert(output.size() >= hashes.size());
+        for (uint64_t hash : hashes) {
+            prefetch(hash);
+        }
+        for (size_t idx = 0; idx < hashes.size(); idx++) {
+            output[idx] = contains(hashes[idx]);
+        }
+    }
+
+  private:
+    struct alignas(16) Bucket
+    {
+        std::array<uint16_t, bucket_size> slots;
+    };
+
+    struct Victim
+    {
+        size_t index = 0;
+        uint16_t fingerprint = 0;
+    };
+
+    size_t m_mask;
+    std::unique_ptr<Bucket[]> m_buckets;
+    size_t m_size = 0;
+    Victim m_victim;
+    size_t m_kick = 0;
+
+    static size_t bucket_count(size_t capacity)
+    {
+        // Relocations start failing around 95 % full, plan for 7 of 8 slots
+        size_t nb_buckets = capacity / (bucket_size - 1) + 1;
+        return std::bit_ceil(std::max<size_t>(2, nb_buckets));
+    }
+
+    static uint16_t fingerprint(uint64_t hash)
+    {
+        uint16_t fp = hash >> 48;
+        return fp == 0 ? 1 : fp;
+    }
+
+    size_t alternate(size_t idx, uint16_t fp) const
+    {
+        return (idx ^ mix64(fp)) & m_mask;
+    }
+
+    void insert_fingerprint(size_t idx, uint16_t fp)
+    {
+        // Reinserting a fingerprint that fit before cannot fail
+        if (put(idx, fp) || put(alternate(idx, fp), fp)) {
+            m_size++;
+            return;
+        }
+        m_victim = Victim{idx, fp};
+        m_size++;
+    }
+
+#if defined(__SSE2__)
+    static uint32_t equal_mask(const Bucket &b, uint16_t value)
+    {
+        __m128i slots = _mm_load_si128((const __m128i *)b.slots.data());
+        __m128i wanted = _mm_set1_epi16(int16_t(value));
+        return _mm_movemask_epi8(_mm_cmpeq_epi16(slots, wanted));
+    }
+
+    static bool match(const Bucket &l, const Bucket &r, uint16_t fp)
+    {
+        return (equal_mask(l, fp) | equal_mask(r, fp)) != 0;
+    }
+
+    static int find_slot(const Bucket &b, uint16_t value)
+    {
+        uint32_t mask = equal_mask(b, value);
+        return mask == 0 ? -1 : std::countr_zero(mask) / 2;
+    }
+#else
+    static bool match(const Bucket &l, const Bucket &r, uint16_t fp)
+    {
+        bool found = false;
+        for (size_t slot = 0; slot < bucket_size; slot++) {
+            found |= l.slots[slot] == fp;
+            found |= r.slots[slot] == fp;
+        }
+        return found;
+    }
+
+    static int find_slot(const Bucket &b, uint16_t value)
+    {
+        for (size_t slot = 0; slot < bucket_size; slot++) {
+            if (b.slots[slot] == value) {
+                return slot;
+            }
+        }
+        return -1;
+    }
+#endif
+
+    bool put(size_t idx, uint16_t fp)
+    {
+        int slot = find_slot(m_buckets[idx], 0);
+        if (slot < 0) {
+            return false;
+        }
+        m_buckets[idx].slots[slot] = fp;
+        return true;
+    }
+
+    bool remove(size_t idx, uint16_t fp)
+    {
+        int slot = find_slot(m_buckets[idx], fp);
+        if (slot < 0) {
+            return false;
+        }
+        m_buckets[idx].slots[slot] = 0;
+        return true;
+    }
+};
+
+} // namespace xnet
@@ -5,6 +5,7 @@
 #include <concepts>
 #include <endian.h>
 #include <iterator>
+#include <limits>
 #include <optional>
 #include <ranges>
 #include <span>
@@ -18,6 +19,7 @@
 #include <cstring>
 
 #include <xnet/ByteOrder.hh>
+#include <xnet/Hash.hh>
 #include <xnet/IPv4.hh>
 
 namespace xnet::DHCP {
@@ -41,12 +43,45 @@ constexpr size_t header_size = []() {
     return output;
 }();
 
+static constexpr uint16_t server_port = 67;
+static constexpr uint16_t client_port = 68;
+
 enum class OperationCode
 {
     BOOTREQUEST,
     BOOTREPLY
 };
 
+constexpr std::array<std::byte, 4> magic_cookie{
+    std::byte(99), std::byte(130), std::byte(83), std::byte(99)};
+
+enum class MessageType : uint8_t
+{
+    DHCPDISCOVER = 1,
+    DHCPOFFER = 2,
+    DHCPREQUEST = 3,
+    DHCPDECLINE = 4,
+    DHCPACK = 5,
+    DHCPNAK = 6,
+    DHCPRELEASE = 7,
+    DHCPINFORM = 8
+};
+
+enum class OptionCode : uint8_t
+{
+    PAD = 0,
+    SUBNET_MASK = 1,
+    ROUTER = 3,
+    REQUESTED_ADDRESS = 50,
+    LEASE_TIME = 51,
+    MESSAGE_TYPE = 53,
+    SERVER_IDENTIFIER = 54,
+    RENEWAL_TIME = 58,
+    REBINDING_TIME = 59,
+    RELAY_AGENT_INFORMATION = 82,
+    END = 255
+};
+
 struct ClientHardwareAddr
 {
     constexpr ClientHardwareAddr() = default;
@@ -65,15 +100,33 @@ struct ClientHardwareAddr
               return out;
           }()) {};
 
-    std::array<std::byte, 16> data() const
+    constexpr std::array<std::byte, 16> data() const
     {
         return m_data;
     }
 
+    static constexpr bool
+        equals(const ClientHardwareAddr &l, const ClientHardwareAddr &r)
+    {
+        return l.m_data == r.m_data;
+    }
+
   private:
     std::array<std::byte, 16> m_data{};
 };
 
+constexpr bool
+    operator==(const ClientHardwareAddr &l, const ClientHardwareAddr &r)
+{
+    return ClientHardwareAddr::equals(l, r);
+}
+
+constexpr uint64_t hash(const ClientHardwareAddr &addr, uint64_t seed = 0)
+{
+    auto data = addr.data();
+    return hash_bytes(std::span<const std::byte>(data), seed);
+}
+
 struct Header
 {
     uint8_t op;
@@ -275,6 +328,21 @@ struct HeaderView
         return output;
     }
 
+    // Unchecked accessors for the hot path, after not_safe_to_parse()
+    constexpr xnet::IPv4::Address giaddr_unsafe() const
+    {
+        std::array<std::byte, 4> addr_data;
+        std::ranges::copy(m_data.subspan(24, 4), addr_data.begin());
+        return xnet::IPv4::Address(addr_data);
+    }
+
+    constexpr ClientHardwareAddr chaddr_unsafe() const
+    {
+        std::array<std::byte, 16> addr_data;
+        std::ranges::copy(m_data.subspan(28, 16), addr_data.begin());
+        return ClientHardwareAddr(addr_data);
+    }
+
   private:
     std::span<const std::byte> m_data;
 
@@ -319,6 +387,102 @@ struct PacketView
         return HeaderView(header.value());
     }
 
+    constexpr std::optional<std::span<const std::byte>> options_data() const
+    {
+        if (!validate_header()) {
+            return std::nullopt;
+        }
+
+        std::span<const std::byte> options_data = m_data.subspan(header_size);
+        if (options_data.size() < 4) {
+            return std::nullopt;
+        }
+
+        std::array<uint8_t, 4> cookie_data{};
+        std::ranges::copy(
+            options_data | std::views::take(4) |
+                std::views::transform(std::to_integer<uint8_t>),
+            std::begin(cookie_data));
+        std::array<uint8_t, 4> valid_cookie_data{99, 130, 83, 99};
+        if (valid_cookie_data != cookie_data) {
+            return std::nullopt;
+        }
+
+        auto output = options_data.subspan(4);
+        if (!validate_options(output)) {
+            return std::nullopt;
+        }
+
+        return output;
+    }
+
+    // Value of the first occurrence of `code` before END
+    constexpr std::optional<std::span<const std::byte>>
+        find_option(OptionCode code) const
+    {
+        auto options_opt = options_data();
+        if (!options_opt) {
+            return std::nullopt;
+        }
+
+        return find_option_in(options_opt.value(), code);
+    }
+
+    constexpr std::optional<MessageType> message_type() const
+    {
+        auto option = find_option(OptionCode::MESSAGE_TYPE);
+        if (!option || option->size() != 1) {
+            return std::nullopt;
+        }
+
+        uint8_t type = std::to_integer<uint8_t>(option->front());
+        if (type < uint8_t(MessageType::DHCPDISCOVER) ||
+            type > uint8_t(MessageType::DHCPINFORM)) {
+            return std::nullopt;
+        }
+
+        return MessageType(type);
+    }
+
+    static constexpr std::optional<std::span<const std::byte>>
+        find_option_in(std::span<const std::byte> options_data, OptionCode code)
+    {
+        size_t read_offset = 0;
+        while (read_offset < options_data.size()) {
+            const uint8_t op_code =
+                std::to_integer<uint8_t>(options_data[read_offset]);
+
+            switch (OptionCode(op_code)) {
+            case OptionCode::PAD:
+                read_offset++;
+                continue;
+            case OptionCode::END:
+                return std::nullopt;
+            default:
+                break;
+            }
+
+            if (read_offset + 1 >= options_data.size()) {
+                return std::nullopt;
+            }
+
+            const uint8_t op_size =
+                std::to_integer<uint8_t>(options_data[read_offset + 1]);
+            size_t value_offset = read_offset + 2;
+            if (value_offset + op_size > options_data.size()) {
+                return std::nullopt;
+            }
+
+            if (OptionCode(op_code) == code) {
+                return options_data.subspan(value_offset, op_size);
+            }
+
+            read_offset = value_offset + op_size;
+        }
+
+        return std::nullopt;
+    }
+
   private:
 #if 0
     static constexpr std::span<uint8_t> trim_options(std::span<uint8_t> options_data)
@@ -352,35 +516,6 @@ struct PacketView
             m_data.template subspan<0, header_size>());
     }
 
-    constexpr std::optional<std::span<const std::byte>> options_data() const
-    {
-        if (!validate_header()) {
-            return std::nullopt;
-        }
-
-        std::span<const std::byte> options_data = m_data.subspan(header_size);
-        if (options_data.size() < 4) {
-            return std::nullopt;
-        }
-
-        std::array<uint8_t, 4> cookie_data{};
-        std::ranges::copy(
-            options_data | std::views::take(4) |
-                std::views::transform(std::to_integer<uint8_t>),
-            std::begin(cookie_data));
-        std::array<uint8_t, 4> valid_cookie_data{99, 130, 83, 99};
-        if (valid_cookie_data != cookie_data) {
-            return std::nullopt;
-        }
-
-        auto output = options_data.subspan(4);
-        if (!validate_options(output)) {
-            return std::nullopt;
-        }
-
-        return output;
-    }
-
   private:
     std::span<const std::byte> m_data;
 
@@ -403,6 +538,10 @@ struct PacketView
                 continue;
             }
 
+            if (read_offset + sizeof(op_code) >= options_data.size()) {
+                return false;
+            }
+
             const uint8_t op_size = std::to_integer<uint8_t>(
                 options_data[read_offset + sizeof(op_code)]);
             read_offset += sizeof(op_code) + sizeof(op_size);
@@ -413,4 +552,80 @@ struct PacketView
     }
 };
 
+/*
+ * Appends options (cookie first) to a caller provided buffer. Every write
+ * reports whether it fit, nothing is written past the buffer.
+ */
+struct OptionsWriter
+{
+    constexpr OptionsWriter(std::span<std::byte> output) : m_output(output)
+    {
+    }
+
+    constexpr bool write_cookie()
+    {
+        return write_raw(magic_cookie);
+    }
+
+    constexpr bool write(OptionCode code, std::span<const std::byte> value)
+    {
+        if (value.size() > std::numeric_limits<uint8_t>::max()) {
+            return false;
+        }
+
+        if (m_size + 2 + value.size() > m_output.size()) {
+            return false;
+        }
+
+        m_output[m_size++] = std::byte(code);
+        m_output[m_size++] = std::byte(value.size());
+        std::ranges::copy(value, m_output.begin() + m_size);
+        m_size += value.size();
+        return true;
+    }
+
+    constexpr bool write(OptionCode code, MessageType type)
+    {
+        std::array<std::byte, 1> value{std::byte(type)};
+        return write(code, value);
+    }
+
+    constexpr bool write(OptionCode code, uint32_t value)
+    {
+        auto data = htobe<uint32_t>(value);
+        return write(code, std::span<const std::byte>(data));
+    }
+
+    constexpr bool write(OptionCode code, xnet::IPv4::Address value)
+    {
+        auto data = value.data_msbf();
+        return write(code, std::span<const std::byte>(data));
+    }
+
+    constexpr bool write_end()
+    {
+        std::array<std::byte, 1> end{std::byte(OptionCode::END)};
+        return write_raw(end);
+    }
+
+    constexpr size_t size() const
+    {
+        return m_size;
+    }
+
+  private:
+    std::span<std::byte> m_output;
+    size_t m_size = 0;
+
+    constexpr bool write_raw(std::span<const std::byte> data)
+    {
+        if (m_size + data.size() > m_output.size()) {
+            return false;
+        }
+        std::ranges::copy(data, m_output.begin() + m_size);
+        m_size += data.size();
+        return true;
+    }
+};
+
 } // namespace xnet::DHCP
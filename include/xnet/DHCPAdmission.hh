@@ -0,0 +1,205 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <span>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <xnet/DHCP.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::DHCP {
+
+// Lower values are served first and shed last
+enum class AdmissionClass : uint8_t
+{
+    // RENEWING / REBINDING requests, RELEASE, DECLINE and INFORM
+    BOUND = 0,
+    // SELECTING / INIT-REBOOT requests, an offer was already spent on these
+    SELECTING = 1,
+    // DISCOVER and anything unparsable
+    NEW = 2
+};
+
+constexpr size_t nb_admission_classes = 3;
+
+constexpr AdmissionClass classify(std::span<const std::byte> payload)
+{
+    PacketView packet(payload);
+    auto type = packet.message_type();
+    if (!type) {
+        return AdmissionClass::NEW;
+    }
+
+    switch (type.value()) {
+    case MessageType::DHCPREQUEST: {
+        auto ciaddr = HeaderView(payload).ciaddr();
+        if (ciaddr && ciaddr.value() != IPv4::Address()) {
+            return AdmissionClass::BOUND;
+        }
+        return AdmissionClass::SELECTING;
+    }
+    case MessageType::DHCPDECLINE:
+    case MessageType::DHCPRELEASE:
+    case MessageType::DHCPINFORM:
+        return AdmissionClass::BOUND;
+    default:
+        return AdmissionClass::NEW;
+    }
+}
+
+struct AdmissionConfig
+{
+    // Queued datagrams per class, indexed by AdmissionClass
+    std::array<size_t, nb_admission_classes> capacity{256, 256, 512};
+    // Datagrams taken from a class per weighted round
+    std::array<uint32_t, nb_admission_classes> weights{8, 4, 1};
+};
+
+struct AdmissionClassStats
+{
+    std::atomic<uint64_t> admitted{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint32_t> depth{0};
+};
+
+using AdmissionStats =
+    std::array<AdmissionClassStats, nb_admission_classes>;
+
+/*
+ * Bounded FIFO per admission class in front of request processing. A full
+ * class drops its own arrivals, so a DISCOVER flood cannot take room from
+ * renewals. Draining is weighted round robin with the position kept across
+ * calls, no class starves.
+ *
+ * Datagrams are copied into fixed slots, the queue never allocates after
+ * construction. Single threaded, only the stats may be read concurrently.
+ */
+struct AdmissionQueue
+{
+    static constexpr size_t max_datagram_size = 1500;
+
+    AdmissionQueue(const AdmissionConfig &config) : m_weights(config.weights)
+    {
+        for (size_t cls = 0; cls < nb_admission_classes; cls++) {
+            m_queues[cls].slots.reset(new Slot[config.capacity[cls]]);
+            m_queues[cls].capacity = config.capacity[cls];
+            m_weights[cls] = std::max<uint32_t>(1, m_weights[cls]);
+        }
+        m_credit = m_weights[0];
+    }
+
+    AdmissionQueue(const AdmissionQueue &) = delete;
+    AdmissionQueue &operator=(const AdmissionQueue &) = delete;
+
+    const AdmissionStats &stats() const
+    {
+        return m_stats;
+    }
+
+    size_t size() const
+    {
+        size_t output = 0;
+        for (const Queue &q : m_queues) {
+            output += q.size;
+        }
+        return output;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    bool push(std::span<const std::byte> payload, const UDP::Endpoint &peer)
+    {
+        return push(payload, peer, classify(payload));
+    }
+
+    bool push(
+        std::span<const std::byte> payload,
+        const UDP::Endpoint &peer,
+        AdmissionClass cls)
+    {
+        Queue &q = m_queues[size_t(cls)];
+        AdmissionClassStats &stats = m_stats[size_t(cls)];
+        if (q.size == q.capacity || payload.size() > max_datagram_size) {
+            stats.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        Slot &slot = q.slots[(q.head + q.size) % q.capacity];
+        std::memcpy(slot.data.data(), payload.data(), payload.size());
+        slot.size = payload.size();
+        slot.peer = peer;
+        q.size++;
+
+        stats.admitted.fetch_add(1, std::memory_order_relaxed);
+        stats.depth.store(q.size, std::memory_order_relaxed);
+        return true;
+    }
+
+    /*
+     * Hands up to `budget` datagrams to `fn(payload, peer, class)`, the
+     * payload is only valid during the call. Returns how many were handed.
+     */
+    template <typename Fn>
+    size_t drain(size_t budget, Fn &&fn)
+    {
+        size_t nb_drained = 0;
+        size_t nb_idle = 0;
+        while (nb_drained < budget && nb_idle < nb_admission_classes) {
+            Queue &q = m_queues[m_current];
+            if (q.size == 0 || m_credit == 0) {
+                nb_idle = q.size == 0 ? nb_idle + 1 : 0;
+                m_current = (m_current + 1) % nb_admission_classes;
+                m_credit = m_weights[m_current];
+                continue;
+            }
+            nb_idle = 0;
+
+            Slot &slot = q.slots[q.head];
+            fn(std::span<const std::byte>(slot.data.data(), slot.size),
+               slot.peer,
+               AdmissionClass(m_current));
+            q.head = (q.head + 1) % q.capacity;
+            q.size--;
+            m_stats[m_current].depth.store(q.size, std::memory_order_relaxed);
+
+            m_credit--;
+            nb_drained++;
+        }
+        return nb_drained;
+    }
+
+  private:
+    struct Slot
+    {
+        std::array<std::byte, max_datagram_size> data;
+        uint16_t size = 0;
+        UDP::Endpoint peer;
+    };
+
+    struct Queue
+    {
+        std::unique_ptr<Slot[]> slots;
+        size_t capacity = 0;
+        size_t head = 0;
+        size_t size = 0;
+    };
+
+    std::array<Queue, nb_admission_classes> m_queues;
+    std::array<uint32_t, nb_admission_classes> m_weights;
+    size_t m_current = 0;
+    uint32_t m_credit = 0;
+    AdmissionStats m_stats;
+};
+
+} // namespace xnet::DHCP
@@ -0,0 +1,533 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <xnet/Hash.hh>
+
+namespace xnet::DHCP {
+
+/*
+ * On-disk lease, one per pool slot. Host byte order, the snapshot header
+ * magic rejects files written on a host with a different layout.
+ */
+struct StoredLease
+{
+    std::array<std::byte, 16> chaddr{};
+    uint64_t expires = 0; // Unix seconds, zero for a free slot
+    uint8_t state = 0;
+    uint8_t hlen = 0;
+    std::array<uint8_t, 6> reserved{};
+};
+
+static_assert(sizeof(StoredLease) == 32);
+static_assert(std::is_trivially_copyable_v<StoredLease>);
+
+namespace LeaseStoreLayout {
+static constexpr uint64_t magic = 0x31534c54454e5878; // "xNETLS1"
+static constexpr size_t snapshot_header_size = 4096;
+
+struct SnapshotHeader
+{
+    uint64_t magic;
+    uint64_t nb_records;
+    // Every journal entry up to this sequence is reflected in the records
+    uint64_t applied_sequence;
+    // Oldest journal file that may still hold entries past applied_sequence
+    uint64_t journal_generation;
+    uint32_t crc;
+    uint32_t reserved;
+};
+
+struct JournalEntry
+{
+    uint64_t sequence;
+    uint32_t slot;
+    uint32_t crc;
+    StoredLease lease;
+};
+
+static_assert(sizeof(JournalEntry) == 48);
+
+inline uint32_t header_crc(const SnapshotHeader &h)
+{
+    SnapshotHeader copy = h;
+    copy.crc = 0;
+    return crc32c(std::as_bytes(std::span(&copy, 1)));
+}
+
+inline uint32_t entry_crc(const JournalEntry &e)
+{
+    JournalEntry copy = e;
+    copy.crc = 0;
+    return crc32c(std::as_bytes(std::span(&copy, 1)));
+}
+} // namespace LeaseStoreLayout
+
+struct LeaseStoreOptions
+{
+    std::string path;
+    uint64_t nb_records = 0;
+    // Journal size that triggers a background compaction
+    size_t compaction_threshold = 64 << 20;
+};
+
+/*
+ * Crash-safe lease database: a memory-mapped fixed-record snapshot plus an
+ * append-only, checksummed journal.
+ *
+ * `update` only stages an entry; `commit` appends all staged entries with a
+ * single write + fdatasync (group commit) and then applies them to the
+ * mapped records, so the snapshot never holds a change the journal lacks.
+ * Compaction rotates the journal, msyncs the records and advances the
+ * header on a background thread. Opening maps the snapshot and replays only
+ * journal entries newer than the header, which is idempotent.
+ *
+ * Not thread safe, meant to be owned by one shard.
+ */
+struct LeaseStore
+{
+    static std::optional<LeaseStore> open(const LeaseStoreOptions &options)
+    {
+        using namespace LeaseStoreLayout;
+
+        LeaseStore output(options);
+        output.m_snapshot_fd =
+            ::open(options.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (output.m_snapshot_fd < 0) {
+            return std::nullopt;
+        }
+
+        struct stat st{};
+        if (::fstat(output.m_snapshot_fd, &st) != 0) {
+            return std::nullopt;
+        }
+
+        size_t map_size =
+            snapshot_header_size + options.nb_records * sizeof(StoredLease);
+        bool fresh = st.st_size == 0;
+        if (!fresh && size_t(st.st_size) != map_size) {
+            return std::nullopt;
+        }
+        if (fresh && ::ftruncate(output.m_snapshot_fd, map_size) != 0) {
+            return std::nullopt;
+        }
+
+        void *map = ::mmap(
+            nullptr,
+            map_size,
+            PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            output.m_snapshot_fd,
+            0);
+        if (map == MAP_FAILED) {
+            return std::nullopt;
+        }
+        output.m_map = std::span<std::byte>((std::byte *)map, map_size);
+
+        SnapshotHeader &h = output.header();
+        if (fresh) {
+            h = SnapshotHeader{};
+            h.magic = magic;
+            h.nb_records = options.nb_records;
+            h.crc = header_crc(h);
+            if (::msync(map, snapshot_header_size, MS_SYNC) != 0) {
+                return std::nullopt;
+            }
+        } else if (h.magic != magic || h.nb_records != options.nb_records ||
+                   h.crc != header_crc(h)) {
+            return std::nullopt;
+        }
+
+        if (!output.replay()) {
+            return std::nullopt;
+        }
+
+        return output;
+    }
+
+    /*
+     * Whether open() would accept the snapshot, found out without writing
+     * anything: files another process still appends to are left alone
+     */
+    static bool check(const LeaseStoreOptions &options)
+    {
+        using namespace LeaseStoreLayout;
+
+        int fd = ::open(options.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            // A fresh store, its directory must let open() create it
+            size_t slash = options.path.rfind('/');
+            std::string directory = slash == std::string::npos
+                                        ? std::string(".")
+                                        : options.path.substr(0, slash + 1);
+            return errno == ENOENT &&
+                   ::access(directory.c_str(), W_OK | X_OK) == 0;
+        }
+
+        struct stat st{};
+        SnapshotHeader h{};
+        size_t map_size =
+            snapshot_header_size + options.nb_records * sizeof(StoredLease);
+        bool valid = ::fstat(fd, &st) == 0 &&
+                     (st.st_size == 0 ||
+                      (size_t(st.st_size) == map_size &&
+                       ::pread(fd, &h, sizeof(h), 0) == sizeof(h) &&
+                       h.magic == magic && h.nb_records == options.nb_records &&
+                       h.crc == header_crc(h)));
+        ::close(fd);
+        return valid;
+    }
+
+    LeaseStore(LeaseStore &&other)
+        : m_options(std::move(other.m_options)),
+          m_snapshot_fd(std::exchange(other.m_snapshot_fd, -1)),
+          m_journal_fd(std::exchange(other.m_journal_fd, -1)),
+          m_map(std::exchange(other.m_map, {})),
+          m_generation(other.m_generation),
+          m_next_sequence(other.m_next_sequence),
+          m_journal_size(other.m_journal_size),
+          m_staged(std::move(other.m_staged))
+    {
+        assert(!other.m_compactor.joinable());
+    }
+
+    LeaseStore &operator=(LeaseStore &&) = delete;
+
+    ~LeaseStore()
+    {
+        if (m_compactor.joinable()) {
+            m_compactor.request_stop();
+            m_compaction_cv.notify_all();
+            m_compactor.join();
+        }
+
+        if (!m_map.empty()) {
+            ::munmap(m_map.data(), m_map.size());
+        }
+        if (m_journal_fd >= 0) {
+            ::close(m_journal_fd);
+        }
+        if (m_snapshot_fd >= 0) {
+            ::close(m_snapshot_fd);
+        }
+    }
+
+    uint64_t size() const
+    {
+        return m_options.nb_records;
+    }
+
+    // Durable state as of the last commit
+    std::span<const StoredLease> leases() const
+    {
+        auto records = m_map.subspan(LeaseStoreLayout::snapshot_header_size);
+        return std::span<const StoredLease>(
+            (const StoredLease *)records.data(), m_options.nb_records);
+    }
+
+    // Returns the sequence the change becomes durable with
+    uint64_t update(uint32_t slot, const StoredLease &lease)
+    {
+        assert(slot < m_options.nb_records);
+
+        LeaseStoreLayout::JournalEntry entry{};
+        entry.sequence = m_next_sequence++;
+        entry.slot = slot;
+        entry.lease = lease;
+        entry.crc = LeaseStoreLayout::entry_crc(entry);
+        m_staged.push_back(entry);
+        return entry.sequence;
+    }
+
+    size_t nb_staged() const
+    {
+        return m_staged.size();
+    }
+
+    // Last sequence known to be on disk
+    uint64_t durable_sequence() const
+    {
+        return m_next_sequence - 1 - m_staged.size();
+    }
+
+    bool commit()
+    {
+        if (m_staged.empty()) {
+            return true;
+        }
+
+        auto data = std::as_bytes(std::span(m_staged));
+        size_t written = 0;
+        while (written != data.size()) {
+            ssize_t res = ::write(
+                m_journal_fd,
+                data.data() + written,
+                data.size() - written);
+            if (res < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // Never leave a torn entry in front of later commits
+                ::ftruncate(m_journal_fd, m_journal_size);
+                return false;
+            }
+            written += res;
+        }
+
+        if (::fdatasync(m_journal_fd) != 0) {
+            ::ftruncate(m_journal_fd, m_journal_size);
+            return false;
+        }
+        m_journal_size += data.size();
+
+        auto records = mutable_leases();
+        for (const auto &entry : m_staged) {
+            records[entry.slot] = entry.lease;
+        }
+        m_staged.clear();
+
+        if (m_journal_size >= m_options.compaction_threshold) {
+            request_compaction();
+        }
+        return true;
+    }
+
+    /*
+     * Switches to a fresh journal and lets the background thread fold the
+     * previous one into the snapshot. No-op while a compaction is running.
+     */
+    bool request_compaction()
+    {
+        {
+            std::lock_guard lock(m_compaction_mutex);
+            if (m_compaction_pending) {
+                return false;
+            }
+        }
+
+        if (!m_staged.empty() && !commit()) {
+            return false;
+        }
+
+        uint64_t folded_generation = m_generation;
+        uint64_t folded_sequence = m_next_sequence - 1;
+        if (!open_journal(m_generation + 1)) {
+            return false;
+        }
+
+        if (!m_compactor.joinable()) {
+            m_compactor = std::jthread(
+                [this](std::stop_token st) { compaction_loop(st); });
+        }
+
+        {
+            std::lock_guard lock(m_compaction_mutex);
+            m_compaction_pending = true;
+            m_folded_generation = folded_generation;
+            m_folded_sequence = folded_sequence;
+        }
+        m_compaction_cv.notify_all();
+        return true;
+    }
+
+    void wait_compaction()
+    {
+        std::unique_lock lock(m_compaction_mutex);
+        m_compaction_cv.wait(lock, [this] { return !m_compaction_pending; });
+    }
+
+  private:
+    LeaseStoreOptions m_options;
+    int m_snapshot_fd = -1;
+    int m_journal_fd = -1;
+    std::span<std::byte> m_map;
+    uint64_t m_generation = 0;
+    uint64_t m_next_sequence = 1;
+    size_t m_journal_size = 0;
+    std::vector<LeaseStoreLayout::JournalEntry> m_staged;
+
+    std::mutex m_compaction_mutex;
+    std::condition_variable_any m_compaction_cv;
+    bool m_compaction_pending = false;
+    uint64_t m_folded_generation = 0;
+    uint64_t m_folded_sequence = 0;
+    std::jthread m_compactor;
+
+    LeaseStore(const LeaseStoreOptions &options) : m_options(options)
+    {
+    }
+
+    LeaseStoreLayout::SnapshotHeader &header()
+    {
+        return *(LeaseStoreLayout::SnapshotHeader *)m_map.data();
+    }
+
+    std::span<StoredLease> mutable_leases()
+    {
+        auto records = m_map.subspan(LeaseStoreLayout::snapshot_header_size);
+        return std::span<StoredLease>(
+            (StoredLease *)records.data(), m_options.nb_records);
+    }
+
+    std::string journal_path(uint64_t generation) const
+    {
+        return m_options.path + ".journal." + std::to_string(generation);
+    }
+
+    bool open_journal(uint64_t generation)
+    {
+        int fd = ::open(
+            journal_path(generation).c_str(),
+            O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+            0644);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        if (m_journal_fd >= 0) {
+            ::close(m_journal_fd);
+        }
+        m_journal_fd = fd;
+        m_generation = generation;
+        m_journal_size = st.st_size;
+        return true;
+    }
+
+    /*
+     * Applies every intact journal entry newer than the snapshot. A torn
+     * tail (short or bad CRC entry) ends the file and is cut off.
+     */
+    bool replay()
+    {
+        using namespace LeaseStoreLayout;
+
+        const SnapshotHeader &h = header();
+        uint64_t applied = h.applied_sequence;
+        m_next_sequence = applied + 1;
+
+        auto records = mutable_leases();
+        uint64_t generation = h.journal_generation;
+        for (;; generation++) {
+            std::string path = journal_path(generation);
+            int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+            if (fd < 0) {
+                if (errno == ENOENT) {
+                    break;
+                }
+                return false;
+            }
+
+            struct stat st{};
+            if (::fstat(fd, &st) != 0) {
+                ::close(fd);
+                return false;
+            }
+
+            size_t valid_size = 0;
+            if (st.st_size != 0) {
+                void *map = ::mmap(
+                    nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map == MAP_FAILED) {
+                    ::close(fd);
+                    return false;
+                }
+
+                size_t nb_entries = st.st_size / sizeof(JournalEntry);
+                auto entries = std::span<const JournalEntry>(
+                    (const JournalEntry *)map, nb_entries);
+                for (const JournalEntry &e : entries) {
+                    if (e.crc != entry_crc(e) || e.slot >= records.size()) {
+                        break;
+                    }
+                    if (e.sequence > applied) {
+                        records[e.slot] = e.lease;
+                    }
+                    m_next_sequence = std::max(m_next_sequence, e.sequence + 1);
+                    valid_size += sizeof(JournalEntry);
+                }
+                ::munmap(map, st.st_size);
+            }
+
+            if (valid_size != size_t(st.st_size) &&
+                ::ftruncate(fd, valid_size) != 0) {
+                ::close(fd);
+                return false;
+            }
+            ::close(fd);
+        }
+
+        uint64_t last_generation =
+            generation == h.journal_generation ? generation : generation - 1;
+        return open_journal(last_generation);
+    }
+
+    void compaction_loop(std::stop_token st)
+    {
+        using namespace LeaseStoreLayout;
+
+        while (true) {
+            uint64_t generation = 0;
+            uint64_t sequence = 0;
+            {
+                std::unique_lock lock(m_compaction_mutex);
+                m_compaction_cv.wait(
+                    lock, st, [this] { return m_compaction_pending; });
+                if (!m_compaction_pending) {
+                    return;
+                }
+                generation = m_folded_generation;
+                sequence = m_folded_sequence;
+            }
+
+            // Records newer than `sequence` may be torn, replay rewrites them
+            bool synced = ::msync(m_map.data(), m_map.size(), MS_SYNC) == 0;
+            if (synced) {
+                SnapshotHeader &h = header();
+                h.applied_sequence = sequence;
+                h.journal_generation = generation + 1;
+                h.crc = header_crc(h);
+                synced =
+                    ::msync(m_map.data(), snapshot_header_size, MS_SYNC) == 0;
+            }
+            if (synced) {
+                ::unlink(journal_path(generation).c_str());
+            }
+
+            {
+                std::lock_guard lock(m_compaction_mutex);
+                m_compaction_pending = false;
+            }
+            m_compaction_cv.notify_all();
+        }
+    }
+};
+
+} // namespace xnet::DHCP
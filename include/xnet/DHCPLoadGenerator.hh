@@ -0,0 +1,589 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <time.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/Checksum.hh>
+#include <xnet/DHCP.hh>
+#include <xnet/Histogram.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/RawSocket.hh>
+#include <xnet/TimingWheel.hh>
+#include <xnet/UDP.hh>
+#include <xnet/UDPChecksum.hh>
+#include <xnet/UDPSocket.hh>
+
+/*
+ * DHCP load generator. Simulated clients run DISCOVER/OFFER/REQUEST/ACK
+ * once and RENEW afterwards, at a fixed rate of new transactions. Packets
+ * are copied from prebuilt IPv4/UDP/DHCP templates, only xid, chaddr and
+ * addresses are patched, with an incremental UDP checksum.
+ */
+namespace xnet::DHCP {
+
+struct LoadConfig
+{
+    UDP::Endpoint server{IPv4::Address(127, 0, 0, 1), server_port};
+    // Replies are read here, also the source of the generated packets
+    UDP::Endpoint bind_to{IPv4::Address(127, 0, 0, 1), 0};
+    // Send raw IPv4 datagrams through this interface (veth) instead of UDP
+    std::string interface;
+
+    uint64_t nb_clients = 1'000'000;
+    uint64_t first_client = 0;
+
+    // New transactions per second over all threads
+    double rate = 10'000;
+    std::chrono::milliseconds duration{10'000};
+    std::chrono::milliseconds timeout{1'000};
+    size_t max_outstanding = 1 << 16;
+
+    // Threads split the clients, each uses bind_to.port + thread if not 0
+    size_t nb_threads = 1;
+    int socket_buffer = 4 << 20;
+};
+
+struct LoadReport
+{
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t stray = 0;
+    uint64_t bound = 0;
+    uint64_t renewed = 0;
+    uint64_t naks = 0;
+    uint64_t timeouts = 0;
+    std::chrono::nanoseconds elapsed{0};
+
+    LatencyHistogram offer_latency;
+    LatencyHistogram bind_latency;
+    LatencyHistogram renew_latency;
+
+    double transactions_per_second() const
+    {
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        return seconds == 0 ? 0 : (bound + renewed) / seconds;
+    }
+
+    void merge(const LoadReport &other)
+    {
+        sent += other.sent;
+        received += other.received;
+        stray += other.stray;
+        bound += other.bound;
+        renewed += other.renewed;
+        naks += other.naks;
+        timeouts += other.timeouts;
+        elapsed = std::max(elapsed, other.elapsed);
+        offer_latency.merge(other.offer_latency);
+        bind_latency.merge(other.bind_latency);
+        renew_latency.merge(other.renew_latency);
+    }
+};
+
+/*
+ * Prebuilt IPv4 + UDP + DHCP request. Patched fields are zero in `data`,
+ * `udp_sum` is the folded UDP checksum sum of everything else.
+ */
+struct PacketTemplate
+{
+    static constexpr size_t max_size = 384;
+    static constexpr size_t ip_offset = 0;
+    static constexpr size_t udp_offset = IPv4::minimal_header_size;
+    static constexpr size_t dhcp_offset = udp_offset + UDP::header_size;
+    // BOOTP relays and some servers drop shorter requests
+    static constexpr size_t min_dhcp_size = 300;
+
+    static constexpr size_t xid_offset = dhcp_offset + 4;
+    static constexpr size_t ciaddr_offset = dhcp_offset + 12;
+    static constexpr size_t chaddr_offset = dhcp_offset + 28;
+
+    std::array<std::byte, max_size> data{};
+    size_t size = 0;
+    // Option payloads, absent from the template if 0
+    size_t requested_offset = 0;
+    size_t server_id_offset = 0;
+    uint16_t udp_sum = 0;
+
+    static PacketTemplate make(
+        MessageType type,
+        bool selecting,
+        const UDP::Endpoint &source,
+        const UDP::Endpoint &destination)
+    {
+        PacketTemplate output;
+
+        Header h{};
+        h.op = 1;
+        h.htype = 1;
+        h.hlen = 6;
+        auto header_data = serialize(h);
+        std::ranges::copy(header_data, output.data.begin() + dhcp_offset);
+
+        auto options_data = std::span(output.data).subspan(
+            dhcp_offset + header_size,
+            max_size - dhcp_offset - header_size);
+        OptionsWriter options(options_data);
+        options.write_cookie();
+        options.write(OptionCode::MESSAGE_TYPE, type);
+        if (selecting) {
+            size_t option_offset = dhcp_offset + header_size + options.size();
+            options.write(OptionCode::REQUESTED_ADDRESS, IPv4::Address());
+            output.requested_offset = option_offset + 2;
+
+            option_offset = dhcp_offset + header_size + options.size();
+            options.write(OptionCode::SERVER_IDENTIFIER, IPv4::Address());
+            output.server_id_offset = option_offset + 2;
+        }
+        options.write_end();
+
+        size_t dhcp_size =
+            std::max(min_dhcp_size, header_size + options.size());
+        auto dhcp_data =
+            std::span<const std::byte>(output.data).subspan(
+                dhcp_offset, dhcp_size);
+
+        UDP::HeaderCreateInfo udp_info;
+        udp_info.pseudo_source = source.address;
+        udp_info.pseudo_destination = destination.address;
+        udp_info.pseudo_protocol = IPPROTO_UDP;
+        udp_info.source_port = source.port;
+        udp_info.destination_port = destination.port;
+        udp_info.data = dhcp_data;
+        UDP::Header udp = UDP::create_valid_header(udp_info).value();
+
+        auto udp_data = std::span(output.data).subspan(udp_offset);
+        store_be<uint16_t>(udp_data, 0, udp.source_port);
+        store_be<uint16_t>(udp_data, 2, udp.destination_port);
+        store_be<uint16_t>(udp_data, 4, udp.length);
+
+        uint64_t sum = Checksum::pseudo_header_sum(
+            source.address, destination.address, IPPROTO_UDP, udp.length);
+        sum = Checksum::add(sum, udp_data.first(udp.length));
+        output.udp_sum = Checksum::fold(sum);
+
+        IPv4::Header ip{};
+        ip.header_size = IPv4::minimal_header_size;
+        ip.total_size = udp_offset + udp.length;
+        ip.flags = IPv4::Flags(0b010);
+        ip.time_to_live = 64;
+        ip.protocol = IPPROTO_UDP;
+        ip.source_address = source.address;
+        ip.destination_address = destination.address;
+        ip.checksum = IPv4::compute_checksum(ip);
+        auto ip_data = IPv4::serialize(ip);
+        std::ranges::copy(ip_data, output.data.begin() + ip_offset);
+
+        output.size = ip.total_size;
+        return output;
+    }
+
+    std::span<const std::byte> dhcp(std::span<const std::byte> packet) const
+    {
+        return packet.subspan(dhcp_offset, size - dhcp_offset);
+    }
+};
+
+/*
+ * One generator thread. Owns the clients [first, first + nb) and a reply
+ * socket, so replies need no demultiplexing across threads. Client state
+ * is index linked with the xid, timeouts run on a TimingWheel.
+ */
+struct LoadWorker
+{
+    static constexpr size_t batch_size = 64;
+    static constexpr std::chrono::milliseconds timer_tick{1};
+
+    static std::optional<std::unique_ptr<LoadWorker>>
+        create(const LoadConfig &config, size_t thread)
+    {
+        size_t nb_threads = std::max<size_t>(1, config.nb_threads);
+        uint64_t per_thread = config.nb_clients / nb_threads;
+        uint64_t first = config.first_client + per_thread * thread;
+        uint64_t nb = thread + 1 == nb_threads
+                          ? config.nb_clients - per_thread * thread
+                          : per_thread;
+        if (nb == 0 || first + nb > uint64_t(UINT32_MAX) + 1) {
+            return std::nullopt;
+        }
+
+        UDP::SocketOptions options;
+        options.bind_to = config.bind_to;
+        if (options.bind_to.port != 0) {
+            options.bind_to.port += thread;
+        }
+        options.receive_buffer = config.socket_buffer;
+        options.send_buffer = config.socket_buffer;
+        options.receive_timeout = std::chrono::milliseconds(1);
+        auto socket = UDP::Socket::open(options);
+        if (!socket) {
+            return std::nullopt;
+        }
+
+        std::optional<IPv4::RawSocket> raw;
+        if (!config.interface.empty()) {
+            IPv4::RawSocketOptions raw_options;
+            raw_options.interface = config.interface;
+            raw_options.broadcast = true;
+            raw_options.send_buffer = config.socket_buffer;
+            auto opened = IPv4::RawSocket::open(raw_options);
+            if (!opened) {
+                return std::nullopt;
+            }
+            raw.emplace(std::move(opened.value()));
+        }
+
+        UDP::Endpoint source = socket->local_endpoint().value();
+        return std::unique_ptr<LoadWorker>(new LoadWorker(
+            config,
+            first,
+            nb,
+            std::move(socket.value()),
+            std::move(raw),
+            source));
+    }
+
+    LoadReport run(std::stop_token st, double rate)
+    {
+        auto rx = std::make_unique<UDP::RecvBatch<batch_size>>();
+        uint64_t start = monotonic_ns();
+        uint64_t end =
+            start + std::chrono::nanoseconds(m_config.duration).count();
+        uint64_t started = 0;
+
+        m_wheel.advance(m_clock.refresh(), [](auto) {});
+        while (!st.stop_requested()) {
+            uint64_t now = monotonic_ns();
+            if (now >= end) {
+                break;
+            }
+
+            m_wheel.advance(
+                m_clock.refresh(),
+                [this](std::span<const uint32_t> expired) {
+                    for (uint32_t idx : expired) {
+                        time_out(m_clients[idx]);
+                    }
+                });
+
+            uint64_t due = rate * (now - start) / 1e9;
+            while (started < due && m_outstanding < m_config.max_outstanding &&
+                   !m_tx.full()) {
+                if (!begin_transaction(now)) {
+                    break;
+                }
+                started++;
+            }
+            flush();
+
+            auto nb_received = m_socket.recv_batch(*rx);
+            if (!nb_received) {
+                break;
+            }
+
+            now = monotonic_ns();
+            for (size_t idx = 0; idx < *nb_received; idx++) {
+                m_report.received++;
+                on_reply(rx->payload(idx), now);
+                if (m_tx.full()) {
+                    flush();
+                }
+            }
+            flush();
+        }
+
+        m_report.elapsed = std::chrono::nanoseconds(monotonic_ns() - start);
+        return m_report;
+    }
+
+  private:
+    enum class Phase : uint8_t
+    {
+        IDLE,
+        SELECTING,
+        REQUESTING,
+        BOUND,
+        RENEWING
+    };
+
+    struct Client
+    {
+        TimerNode timer;
+        uint64_t started = 0;
+        IPv4::Address address;
+        IPv4::Address server_id;
+        Phase phase = Phase::IDLE;
+    };
+
+    const LoadConfig &m_config;
+    uint64_t m_first;
+    UDP::Socket m_socket;
+    std::optional<IPv4::RawSocket> m_raw;
+    UDP::Endpoint m_destination;
+
+    PacketTemplate m_discover;
+    PacketTemplate m_select;
+    PacketTemplate m_renew;
+
+    std::unique_ptr<Client[]> m_clients;
+    std::span<Client> m_clients_view;
+    TimingWheelState m_wheel_state{};
+    TimingWheel<Client, &Client::timer> m_wheel;
+    CoarseClock m_clock{timer_tick};
+    uint64_t m_cursor = 0;
+    size_t m_outstanding = 0;
+
+    std::array<std::array<std::byte, PacketTemplate::max_size>, batch_size>
+        m_tx_buffers;
+    UDP::SendBatch<batch_size> m_tx;
+    LoadReport m_report;
+
+    LoadWorker(
+        const LoadConfig &config,
+        uint64_t first,
+        uint64_t nb,
+        UDP::Socket socket,
+        std::optional<IPv4::RawSocket> raw,
+        const UDP::Endpoint &source)
+        : m_config(config), m_first(first), m_socket(std::move(socket)),
+          m_raw(std::move(raw)), m_destination(config.server),
+          m_discover(PacketTemplate::make(
+              MessageType::DHCPDISCOVER, false, source, config.server)),
+          m_select(PacketTemplate::make(
+              MessageType::DHCPREQUEST, true, source, config.server)),
+          m_renew(PacketTemplate::make(
+              MessageType::DHCPREQUEST, false, source, config.server)),
+          m_clients(new Client[nb]), m_clients_view(m_clients.get(), nb),
+          m_wheel(m_clients_view, m_wheel_state)
+    {
+    }
+
+    static uint64_t monotonic_ns()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+    }
+
+    // Locally administered 02:xx:xx:xx:xx:xx, the low 40 bits number clients
+    std::array<std::byte, 6> mac_of(uint32_t idx) const
+    {
+        uint64_t id = m_first + idx;
+        return std::array<std::byte, 6>{
+            std::byte(0x02),
+            std::byte(id >> 32),
+            std::byte(id >> 24),
+            std::byte(id >> 16),
+            std::byte(id >> 8),
+            std::byte(id),
+        };
+    }
+
+    bool begin_transaction(uint64_t now)
+    {
+        for (size_t tries = 0; tries < m_clients_view.size(); tries++) {
+            uint32_t idx = m_cursor;
+            m_cursor = (m_cursor + 1) % m_clients_view.size();
+
+            Client &c = m_clients_view[idx];
+            if (c.phase == Phase::IDLE) {
+                c.phase = Phase::SELECTING;
+            } else if (c.phase == Phase::BOUND) {
+                c.phase = Phase::RENEWING;
+            } else {
+                continue;
+            }
+
+            c.started = now;
+            m_outstanding++;
+            send(idx, c.phase == Phase::SELECTING ? m_discover : m_renew);
+            return true;
+        }
+        return false;
+    }
+
+    void on_reply(std::span<const std::byte> payload, uint64_t now)
+    {
+        PacketView packet(payload);
+        auto header_opt = packet.header_view();
+        auto type_opt = packet.message_type();
+        if (!header_opt || !type_opt) {
+            m_report.stray++;
+            return;
+        }
+
+        HeaderView header = header_opt.value();
+        uint32_t idx = header.xid().value() - uint32_t(m_first);
+        auto mac = mac_of(idx);
+        auto chaddr = header.chaddr().value().data();
+        if (idx >= m_clients_view.size() ||
+            !std::equal(mac.begin(), mac.end(), chaddr.begin())) {
+            m_report.stray++;
+            return;
+        }
+
+        Client &c = m_clients_view[idx];
+        MessageType type = type_opt.value();
+        if (type == MessageType::DHCPOFFER && c.phase == Phase::SELECTING) {
+            m_report.offer_latency.record(now - c.started);
+            c.address = header.yiaddr().value();
+            c.server_id = IPv4::Address();
+            auto server_id = packet.find_option(OptionCode::SERVER_IDENTIFIER);
+            if (server_id && server_id->size() == 4) {
+                std::array<std::byte, 4> data{};
+                std::ranges::copy(*server_id, data.begin());
+                c.server_id = IPv4::Address(data);
+            }
+            c.phase = Phase::REQUESTING;
+            send(idx, m_select);
+            return;
+        }
+
+        bool waiting =
+            c.phase == Phase::REQUESTING || c.phase == Phase::RENEWING;
+        if (!waiting) {
+            m_report.stray++;
+            return;
+        }
+
+        if (type == MessageType::DHCPACK) {
+            if (c.phase == Phase::REQUESTING) {
+                m_report.bind_latency.record(now - c.started);
+                m_report.bound++;
+            } else {
+                m_report.renew_latency.record(now - c.started);
+                m_report.renewed++;
+            }
+            c.phase = Phase::BOUND;
+        } else if (type == MessageType::DHCPNAK) {
+            m_report.naks++;
+            c.phase = Phase::IDLE;
+        } else {
+            m_report.stray++;
+            return;
+        }
+
+        m_wheel.cancel(idx);
+        m_outstanding--;
+    }
+
+    void time_out(Client &c)
+    {
+        m_report.timeouts++;
+        m_outstanding--;
+        c.phase = c.phase == Phase::RENEWING ? Phase::BOUND : Phase::IDLE;
+    }
+
+    // Copies the template, patches it and queues it, flushing a full batch
+    void send(uint32_t idx, const PacketTemplate &t)
+    {
+        if (m_tx.full()) {
+            flush();
+        }
+
+        Client &c = m_clients_view[idx];
+        auto &buffer = m_tx_buffers[m_tx.size()];
+        std::memcpy(buffer.data(), t.data.data(), t.size);
+        auto packet = std::span(buffer).first(t.size);
+
+        uint32_t xid = m_first + idx;
+        auto mac = mac_of(idx);
+        store_be<uint32_t>(packet, PacketTemplate::xid_offset, xid);
+        std::ranges::copy(mac, packet.begin() + PacketTemplate::chaddr_offset);
+
+        uint64_t sum = t.udp_sum;
+        sum += Checksum::partial(
+            std::span<const std::byte>(packet).subspan(
+                PacketTemplate::xid_offset, 4));
+        sum += Checksum::partial(
+            std::span<const std::byte>(mac),
+            PacketTemplate::chaddr_offset);
+
+        auto patch_address = [&](size_t offset, IPv4::Address a) {
+            auto data = a.data_msbf();
+            std::ranges::copy(data, packet.begin() + offset);
+            sum += Checksum::partial(data, offset);
+        };
+        if (&t == &m_renew) {
+            patch_address(PacketTemplate::ciaddr_offset, c.address);
+        }
+        if (t.requested_offset != 0) {
+            patch_address(t.requested_offset, c.address);
+        }
+        if (t.server_id_offset != 0) {
+            patch_address(t.server_id_offset, c.server_id);
+        }
+
+        uint16_t checksum = Checksum::udp_nonzero(Checksum::finish(sum));
+        store_be<uint16_t>(packet, PacketTemplate::udp_offset + 6, checksum);
+
+        auto deadline = m_clock.ticks_from_now(m_config.timeout);
+        m_wheel.schedule(idx, deadline);
+
+        if (m_raw) {
+            m_tx.push(packet, m_destination);
+        } else {
+            m_tx.push(t.dhcp(packet), m_destination);
+        }
+    }
+
+    void flush()
+    {
+        if (m_tx.size() == 0) {
+            return;
+        }
+
+        m_report.sent +=
+            m_raw ? m_raw->send_batch(m_tx) : m_socket.send_batch(m_tx);
+    }
+};
+
+// Runs `config.nb_threads` workers for `config.duration`, merged results
+inline std::optional<LoadReport> run_load(const LoadConfig &config)
+{
+    size_t nb_threads = std::max<size_t>(1, config.nb_threads);
+
+    std::vector<std::unique_ptr<LoadWorker>> workers;
+    for (size_t thread = 0; thread < nb_threads; thread++) {
+        auto worker = LoadWorker::create(config, thread);
+        if (!worker) {
+            return std::nullopt;
+        }
+        workers.push_back(std::move(worker.value()));
+    }
+
+    std::vector<LoadReport> reports(nb_threads);
+    std::vector<std::jthread> threads;
+    for (size_t thread = 0; thread < nb_threads; thread++) {
+        threads.emplace_back([&, thread](std::stop_token st) {
+            reports[thread] =
+                workers[thread]->run(st, config.rate / nb_threads);
+        });
+    }
+    // Joined before destruction, which would request a stop
+    for (std::jthread &thread : threads) {
+        thread.join();
+    }
+
+    LoadReport output;
+    for (const LoadReport &report : reports) {
+        output.merge(report);
+    }
+    return output;
+}
+
+} // namespace xnet::DHCP
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/CuckooFilter.hh>
+#include <xnet/DHCP.hh>
+
+namespace xnet::DHCP {
+
+enum class MacListMode : uint8_t
+{
+    // Only listed clients are served
+    ALLOW,
+    // Listed clients are ignored
+    DENY
+};
+
+/*
+ * chaddr allow or deny list for millions of entries. A cuckoo filter
+ * answers most lookups from one or two cache lines, only its positives are
+ * confirmed against the exact keys, kept in a flat open addressing table.
+ * Sized at construction, insert fails once full.
+ *
+ * Lists are built or copied and edited off the packet path, then swapped in
+ * through a MacListRegistry.
+ */
+struct MacList
+{
+    static constexpr size_t batch_size = 64;
+
+    MacList(MacListMode mode, size_t capacity)
+        : m_mode(mode), m_capacity(capacity), m_filter(capacity),
+          m_keys(std::bit_ceil(std::max<size_t>(16, capacity * 2)))
+    {
+    }
+
+    MacListMode mode() const
+    {
+        return m_mode;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool insert(const ClientHardwareAddr &chaddr)
+    {
+        uint64_t h = key_hash(chaddr);
+        if (find(chaddr, h)) {
+            return true;
+        }
+        if (m_size == m_capacity || !m_filter.insert(h)) {
+            return false;
+        }
+
+        size_t pos = h & mask();
+        while (m_keys[pos].hash != 0) {
+            pos = (pos + 1) & mask();
+        }
+        m_keys[pos] = Slot{h, chaddr.data()};
+        m_size++;
+        return true;
+    }
+
+    bool erase(const ClientHardwareAddr &chaddr)
+    {
+        uint64_t h = key_hash(chaddr);
+        auto pos = find(chaddr, h);
+        if (!pos) {
+            return false;
+        }
+        m_filter.erase(h);
+        erase_at(*pos);
+        m_size--;
+        return true;
+    }
+
+    bool contains(const ClientHardwareAddr &chaddr) const
+    {
+        uint64_t h = key_hash(chaddr);
+        return m_filter.contains(h) && find(chaddr, h).has_value();
+    }
+
+    // Whether a request from `chaddr` passes the list
+    bool admits(const ClientHardwareAddr &chaddr) const
+    {
+        return contains(chaddr) == (m_mode == MacListMode::ALLOW);
+    }
+
+    // Lookups with their memory accesses overlapped, batch_size at a time
+    void contains_batch(
+        std::span<const ClientHardwareAddr> chaddrs,
+        std::span<bool> output) const
+    {
+        assert(output.size() >= chaddrs.size());
+
+        for (size_t first = 0; first < chaddrs.size(); first += batch_size) {
+            size_t count = std::min(batch_size, chaddrs.size() - first);
+            contains_chunk(
+                chaddrs.subspan(first, count), output.subspan(first, count));
+        }
+    }
+
+  private:
+    struct Slot
+    {
+        // 0 marks an empty slot
+        uint64_t hash = 0;
+        std::array<std::byte, 16> key{};
+    };
+
+    MacListMode m_mode;
+    size_t m_capacity;
+    size_t m_size = 0;
+    CuckooFilter m_filter;
+    std::vector<Slot> m_keys;
+
+    size_t mask() const
+    {
+        return m_keys.size() - 1;
+    }
+
+    static uint64_t key_hash(const ClientHardwareAddr &chaddr)
+    {
+        uint64_t h = hash(chaddr);
+        return h == 0 ? 1 : h;
+    }
+
+    std::optional<size_t>
+        find(const ClientHardwareAddr &chaddr, uint64_t h) const
+    {
+        auto key = chaddr.data();
+        for (size_t pos = h & mask(); m_keys[pos].hash != 0;
+             pos = (pos + 1) & mask()) {
+            if (m_keys[pos].hash == h && m_keys[pos].key == key) {
+                return pos;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // At most batch_size lookups
+    void contains_chunk(
+        std::span<const ClientHardwareAddr> chaddrs,
+        std::span<bool> output) const
+    {
+        std::array<uint64_t, batch_size> hashes;
+        for (size_t idx = 0; idx < chaddrs.size(); idx++) {
+            hashes[idx] = key_hash(chaddrs[idx]);
+        }
+        auto hashes_view = std::span(hashes).first(chaddrs.size());
+        m_filter.contains_batch(hashes_view, output);
+
+        for (size_t idx = 0; idx < chaddrs.size(); idx++) {
+            if (output[idx]) {
+                __builtin_prefetch(&m_keys[hashes[idx] & mask()]);
+            }
+        }
+        for (size_t idx = 0; idx < chaddrs.size(); idx++) {
+            if (output[idx]) {
+                output[idx] = find(chaddrs[idx], hashes[idx]).has_value();
+            }
+        }
+    }
+
+    // Backward shift deletion, as in the lease table index
+    void erase_at(size_t hole)
+    {
+        for (size_t next = (hole + 1) & mask(); m_keys[next].hash != 0;
+             next = (next + 1) & mask()) {
+            size_t home = m_keys[next].hash & mask();
+            if (((next - home) & mask()) >= ((next - hole) & mask())) {
+                m_keys[hole] = m_keys[next];
+                hole = next;
+            }
+        }
+        m_keys[hole] = Slot{};
+    }
+};
+
+/*
+ * Publishes the current MacList to packet threads. Readers keep their own
+ * reference and only touch the shared one when the generation moved, the
+ * per packet cost is one load of a rarely written counter.
+ */
+struct MacListRegistry
+{
+    void publish(std::shared_ptr<const MacList> list)
+    {
+        std::lock_guard lock(m_mutex);
+        m_list = std::move(list);
+        m_generation.fetch_add(1, std::memory_order_release);
+    }
+
+    std::shared_ptr<const MacList> current() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_list;
+    }
+
+    uint64_t generation() const
+    {
+        return m_generation.load(std::memory_order_acquire);
+    }
+
+  private:
+    mutable std::mutex m_mutex;
+    std::shared_ptr<const MacList> m_list;
+    std::atomic<uint64_t> m_generation{0};
+};
+
+// Per thread view of a MacListRegistry
+struct MacListReader
+{
+    MacListReader(std::shared_ptr<const MacListRegistry> registry)
+        : m_registry(std::move(registry))
+    {
+    }
+
+    // Null while nothing was published
+    const MacList *get()
+    {
+        uint64_t generation = m_registry->generation();
+        if (generation != m_generation) {
+            m_list = m_registry->current();
+            m_generation = generation;
+        }
+        return m_list.get();
+    }
+
+    // Runs on the fixed header only, before any option is parsed
+    bool admits(const HeaderView &header)
+    {
+        const MacList *list = get();
+        return list == nullptr || list->admits(header.chaddr_unsafe());
+    }
+
+  private:
+    std::shared_ptr<const MacListRegistry> m_registry;
+    std::shared_ptr<const MacList> m_list;
+    uint64_t m_generation = 0;
+};
+
+} // namespace xnet::DHCP
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <optional>
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include <time.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/DHCP.hh>
+#include <xnet/Hash.hh>
+#include <xnet/IPv4.hh>
+
+namespace xnet {
+
+struct TokenBucketConfig
+{
+    // One token every ~11.6 days, slower rates are configuration mistakes
+    static constexpr double min_rate = 1e-6;
+
+    // Tokens per second, 0 disables the limit
+    double rate = 0;
+    uint32_t burst = 1;
+
+    bool valid() const
+    {
+        return rate == 0 || (std::isfinite(rate) && rate >= min_rate);
+    }
+};
+
+/*
+ * Token buckets for arbitrary 64-bit keys in a fixed table. Buckets are
+ * kept as a theoretical arrival time (GCRA), one 64-bit microsecond stamp
+ * per key. Keys live in 3-way sets of one cache line, a full set evicts
+ * with CLOCK (second chance), so memory never grows with the number of
+ * keys. A forgotten key restarts with a full bucket.
+ */
+struct TokenBucketTable
+{
+    static constexpr size_t ways = 3;
+
+    // A disabled (0) rate gives the slowest buckets, others must be valid()
+    TokenBucketTable(const TokenBucketConfig &config, size_t capacity)
+        : m_interval(interval_of(config)), m_tolerance(tolerance_of(config)),
+          m_sets(new Set[set_count(capacity)]),
+          m_mask(set_count(capacity) - 1)
+    {
+        assert(config.valid());
+    }
+
+    size_t capacity() const
+    {
+        return (m_mask + 1) * ways;
+    }
+
+    // Reference to a bucket that holds a token, valid until the next lookup
+    struct Token
+    {
+        uint64_t *arrival;
+    };
+
+    // Takes a token for `key` at `now_us` (any monotonic microsecond count)
+    bool allow(uint64_t key, uint64_t now_us)
+    {
+        auto token = peek(key, now_us);
+        if (!token) {
+            return false;
+        }
+        take(*token);
+        return true;
+    }
+
+    // Finds the bucket of `key` without consuming, empty once it is dry
+    std::optional<Token> peek(uint64_t key, uint64_t now_us)
+    {
+        key = key == 0 ? 1 : key;
+        Set &set = m_sets[mix64(key) & m_mask];
+
+        size_t way = ways;
+        for (size_t idx = 0; idx < ways; idx++) {
+            if (set.keys[idx] == key) {
+                way = idx;
+            }
+        }
+        if (way == ways) {
+            way = evict(set);
+            set.keys[way] = key;
+            set.arrival[way] = now_us;
+        }
+        set.referenced |= uint8_t(1) << way;
+
+        // An idle bucket is full however long it has been idle
+        if (set.arrival[way] < now_us) {
+            set.arrival[way] = now_us;
+        }
+        uint64_t ahead = set.arrival[way] - now_us;
+        assert(ahead <= m_tolerance + m_interval);
+        if (ahead > m_tolerance) {
+            return std::nullopt;
+        }
+        return Token{&set.arrival[way]};
+    }
+
+    void take(const Token &token)
+    {
+        *token.arrival += m_interval;
+    }
+
+  private:
+    struct alignas(64) Set
+    {
+        std::array<uint64_t, ways> keys{};
+        std::array<uint64_t, ways> arrival{};
+        uint8_t referenced = 0;
+        uint8_t hand = 0;
+    };
+    static_assert(sizeof(Set) == 64);
+
+    uint64_t m_interval;
+    uint64_t m_tolerance;
+    std::unique_ptr<Set[]> m_sets;
+    size_t m_mask;
+
+    // Microseconds per token, at least 1 and at most 1e12
+    static uint64_t interval_of(const TokenBucketConfig &config)
+    {
+        double rate = std::max(config.rate, TokenBucketConfig::min_rate);
+        return std::max(1.0, 1e6 / rate);
+    }
+
+    // Capped so that stamps stay far from wrapping
+    static uint64_t tolerance_of(const TokenBucketConfig &config)
+    {
+        constexpr double max_tolerance = double(uint64_t(1) << 48);
+        double burst = std::max<uint32_t>(1, config.burst) - 1;
+        return std::min(max_tolerance, interval_of(config) * burst);
+    }
+
+    static size_t set_count(size_t capacity)
+    {
+        size_t nb_sets = (capacity + ways - 1) / ways;
+        return std::bit_ceil(std::max<size_t>(1, nb_sets));
+    }
+
+    static size_t evict(Set &set)
+    {
+        while (true) {
+            size_t way = set.hand;
+            set.hand = (set.hand + 1) % ways;
+            if (set.keys[way] == 0) {
+                return way;
+            }
+
+            uint8_t bit = uint8_t(1) << way;
+            if ((set.referenced & bit) == 0) {
+                return way;
+            }
+            set.referenced &= ~bit;
+        }
+    }
+};
+
+inline uint64_t coarse_monotonic_us()
+{
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return uint64_t(ts.tv_sec) * 1'000'000 + ts.tv_nsec / 1'000;
+}
+
+} // namespace xnet
+
+namespace xnet::DHCP {
+
+struct IngressLimiterStats
+{
+    std::atomic<uint64_t> allowed{0};
+    std::atomic<uint64_t> client_drops{0};
+    std::atomic<uint64_t> relay_drops{0};
+};
+
+/*
+ * Per client (chaddr) and per relay (giaddr) admission of requests, meant
+ * to run on the fixed header before any option is looked at. Requests
+ * without a relay only consume a client token. Tokens are taken only once
+ * both buckets admit, a client flooding behind a relay cannot drain the
+ * relay bucket with requests its own bucket drops.
+ */
+struct IngressLimiter
+{
+    IngressLimiter(
+        const TokenBucketConfig &client,
+        const TokenBucketConfig &relay,
+        size_t capacity)
+        : m_clients(client, capacity), m_relays(relay, capacity),
+          m_limit_clients(client.rate > 0), m_limit_relays(relay.rate > 0)
+    {
+    }
+
+    const IngressLimiterStats &stats() const
+    {
+        return m_stats;
+    }
+
+    // `header` must have been checked to hold a full fixed header
+    bool allow(const HeaderView &header, uint64_t now_us)
+    {
+        std::optional<TokenBucketTable::Token> relay_token;
+        if (m_limit_relays) {
+            auto giaddr = header.giaddr_unsafe().data_msbf();
+            uint32_t relay = betoh<uint32_t>(giaddr);
+            if (relay != 0) {
+                relay_token = m_relays.peek(relay, now_us);
+                if (!relay_token) {
+                    m_stats.relay_drops.fetch_add(
+                        1, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+        }
+
+        if (m_limit_clients) {
+            uint64_t client = hash(header.chaddr_unsafe());
+            if (!m_clients.allow(client, now_us)) {
+                m_stats.client_drops.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        if (relay_token) {
+            m_relays.take(*relay_token);
+        }
+        m_stats.allowed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+  private:
+    TokenBucketTable m_clients;
+    TokenBucketTable m_relays;
+    bool m_limit_clients;
+    bool m_limit_relays;
+    IngressLimiterStats m_stats;
+};
+
+} // namespace xnet::DHCP
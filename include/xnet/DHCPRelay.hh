@@ -0,0 +1,529 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/Checksum.hh>
+#include <xnet/DHCP.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/UDP.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::DHCP {
+
+struct RelayConfig
+{
+    // Written to giaddr and used as source of everything the relay sends
+    IPv4::Address relay_address{};
+    IPv4::Address server_address{};
+
+    // Relay Agent Information sub-options, none inserted when both empty
+    std::vector<std::byte> circuit_id;
+    std::vector<std::byte> remote_id;
+
+    uint8_t max_hops = 16;
+    uint8_t time_to_live = 64;
+};
+
+struct RelayStats
+{
+    // Client requests already carrying option 82, discarded (RFC 3046 2.1)
+    std::atomic<uint64_t> client_agent_option{0};
+};
+
+// One datagram slot, `buffer` spans the whole slot including tailroom
+struct RelayPacket
+{
+    std::span<std::byte> buffer;
+    size_t size = 0;
+    std::optional<IPv4::Address> destination;
+};
+
+/*
+ * Forwarding path rewriting full IPv4/UDP/DHCP datagrams in place: giaddr,
+ * hops and option 82 are patched in the original buffer and every header
+ * change is folded into the existing checksums (RFC 1624) instead of
+ * recomputing them over the packet.
+ */
+struct Relay
+{
+    static std::optional<Relay> create(const RelayConfig &config)
+    {
+        Relay output(config);
+
+        size_t circuit_size = config.circuit_id.size();
+        size_t remote_size = config.remote_id.size();
+        size_t sub_options_size = 0;
+        sub_options_size += circuit_size != 0 ? 2 + circuit_size : 0;
+        sub_options_size += remote_size != 0 ? 2 + remote_size : 0;
+        if (sub_options_size > std::numeric_limits<uint8_t>::max()) {
+            return std::nullopt;
+        }
+
+        if (sub_options_size != 0) {
+            auto &o = output.m_agent_option;
+            size_t &o_size = output.m_agent_option_size;
+            o[o_size++] = std::byte(OptionCode::RELAY_AGENT_INFORMATION);
+            o[o_size++] = std::byte(sub_options_size);
+            auto write_sub_option = [&](uint8_t code,
+                                        const std::vector<std::byte> &value) {
+                if (value.empty()) {
+                    return;
+                }
+                o[o_size++] = std::byte(code);
+                o[o_size++] = std::byte(value.size());
+                std::ranges::copy(value, o.begin() + o_size);
+                o_size += value.size();
+            };
+            write_sub_option(1, config.circuit_id);
+            write_sub_option(2, config.remote_id);
+        }
+
+        return output;
+    }
+
+    const RelayConfig &config() const
+    {
+        return m_config;
+    }
+
+    const RelayStats &stats() const
+    {
+        return *m_stats;
+    }
+
+    // Client (or downstream relay) to server, returns the new datagram size
+    std::optional<size_t>
+        to_server(std::span<std::byte> buffer, size_t size) const
+    {
+        auto layout_opt = parse_layout(buffer, size, server_port);
+        if (!layout_opt) {
+            return std::nullopt;
+        }
+        Layout L = layout_opt.value();
+        auto dhcp = buffer.subspan(L.dhcp_offset);
+
+        if (std::to_integer<uint8_t>(dhcp[0]) != 1) {
+            return std::nullopt;
+        }
+
+        uint8_t hops = std::to_integer<uint8_t>(dhcp[3]);
+        if (hops >= m_config.max_hops) {
+            return std::nullopt;
+        }
+
+        // A client must not choose the circuit or remote id the server sees
+        IPv4::Address giaddr = read_address(dhcp, 24);
+        if (giaddr == IPv4::Address() && has_agent_option(buffer, L)) {
+            m_stats->client_agent_option.fetch_add(
+                1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        Checksums C = read_checksums(buffer, L);
+
+        uint16_t old_hlen_hops = load_be<uint16_t>(dhcp, 2);
+        dhcp[3] = std::byte(hops + 1);
+        C.udp = Checksum::update(
+            C.udp, old_hlen_hops, load_be<uint16_t>(dhcp, 2));
+
+        if (giaddr == IPv4::Address()) {
+            write_address(dhcp, 24, m_config.relay_address);
+            C.udp = Checksum::update_address(
+                C.udp, giaddr, m_config.relay_address);
+
+            // Only the first relay adds agent information
+            if (m_agent_option_size != 0) {
+                auto new_end = insert_agent_option(buffer, L, C);
+                if (!new_end) {
+                    return std::nullopt;
+                }
+                resize(buffer, L, C, new_end.value());
+            }
+        }
+
+        rewrite_addressing(
+            buffer,
+            L,
+            C,
+            UDP::Endpoint{m_config.relay_address, server_port},
+            UDP::Endpoint{m_config.server_address, server_port});
+        write_checksums(buffer, L, C);
+        return L.datagram_end;
+    }
+
+    // Server to client, strips option 82 and picks the delivery address
+    std::optional<size_t> to_client(
+        std::span<std::byte> buffer,
+        size_t size,
+        IPv4::Address &destination) const
+    {
+        auto layout_opt = parse_layout(buffer, size, server_port);
+        if (!layout_opt) {
+            return std::nullopt;
+        }
+        Layout L = layout_opt.value();
+        auto dhcp = buffer.subspan(L.dhcp_offset);
+
+        if (std::to_integer<uint8_t>(dhcp[0]) != 2) {
+            return std::nullopt;
+        }
+
+        if (read_address(dhcp, 24) != m_config.relay_address) {
+            return std::nullopt;
+        }
+
+        Checksums C = read_checksums(buffer, L);
+
+        auto new_end = strip_agent_option(buffer, L, C);
+        if (new_end) {
+            resize(buffer, L, C, new_end.value());
+        }
+
+        uint16_t flags = load_be<uint16_t>(dhcp, 10);
+        IPv4::Address yiaddr = read_address(dhcp, 16);
+        bool broadcast = (flags & 0x8000) != 0 || yiaddr == IPv4::Address();
+        destination = broadcast ? IPv4::Address(255, 255, 255, 255) : yiaddr;
+
+        rewrite_addressing(
+            buffer,
+            L,
+            C,
+            UDP::Endpoint{m_config.relay_address, server_port},
+            UDP::Endpoint{destination, client_port});
+        write_checksums(buffer, L, C);
+        return L.datagram_end;
+    }
+
+    // Rewrites a batch and queues forwarded datagrams, returns how many
+    template <size_t capacity>
+    size_t to_server(
+        std::span<RelayPacket> packets, UDP::SendBatch<capacity> &tx) const
+    {
+        size_t nb_forwarded = 0;
+        for (RelayPacket &p : packets) {
+            p.destination.reset();
+            if (tx.full()) {
+                break;
+            }
+            auto new_size = to_server(p.buffer, p.size);
+            if (!new_size) {
+                continue;
+            }
+            p.size = new_size.value();
+            p.destination = m_config.server_address;
+            tx.push(
+                p.buffer.first(p.size),
+                UDP::Endpoint{m_config.server_address, 0});
+            nb_forwarded++;
+        }
+        return nb_forwarded;
+    }
+
+    template <size_t capacity>
+    size_t to_client(
+        std::span<RelayPacket> packets, UDP::SendBatch<capacity> &tx) const
+    {
+        size_t nb_forwarded = 0;
+        for (RelayPacket &p : packets) {
+            p.destination.reset();
+            if (tx.full()) {
+                break;
+            }
+            IPv4::Address destination;
+            auto new_size = to_client(p.buffer, p.size, destination);
+            if (!new_size) {
+                continue;
+            }
+            p.size = new_size.value();
+            p.destination = destination;
+            tx.push(p.buffer.first(p.size), UDP::Endpoint{destination, 0});
+            nb_forwarded++;
+        }
+        return nb_forwarded;
+    }
+
+  private:
+    static constexpr size_t options_offset = header_size + magic_cookie.size();
+
+    struct Layout
+    {
+        size_t udp_offset;
+        size_t dhcp_offset;
+        size_t datagram_end;
+    };
+
+    struct Checksums
+    {
+        uint16_t ip;
+        uint16_t udp;
+        bool udp_enabled;
+    };
+
+    RelayConfig m_config;
+    std::array<std::byte, 2 + 255> m_agent_option{};
+    size_t m_agent_option_size = 0;
+    std::unique_ptr<RelayStats> m_stats = std::make_unique<RelayStats>();
+
+    Relay(const RelayConfig &config) : m_config(config)
+    {
+    }
+
+    static IPv4::Address
+        read_address(std::span<const std::byte> data, size_t offset)
+    {
+        std::array<std::byte, 4> addr{};
+        std::ranges::copy(data.subspan(offset, 4), addr.begin());
+        return IPv4::Address(addr);
+    }
+
+    static void
+        write_address(std::span<std::byte> data, size_t offset, IPv4::Address a)
+    {
+        std::ranges::copy(a.data_msbf(), data.begin() + offset);
+    }
+
+    static std::optional<Layout> parse_layout(
+        std::span<std::byte> buffer, size_t size, uint16_t destination_port)
+    {
+        if (size > buffer.size()) {
+            return std::nullopt;
+        }
+
+        IPv4::HeaderView ip(buffer.first(size));
+        if (ip.is_not_valid() || ip.protocol() != 17) {
+            return std::nullopt;
+        }
+
+        auto total_size_opt = ip.total_size();
+        if (!total_size_opt) {
+            return std::nullopt;
+        }
+
+        size_t ip_header_size = ip.header_size().value();
+        size_t total_size = total_size_opt.value();
+        if (total_size < ip_header_size + UDP::header_size + options_offset) {
+            return std::nullopt;
+        }
+
+        auto udp = buffer.subspan(ip_header_size);
+        if (load_be<uint16_t>(udp, 2) != destination_port ||
+            load_be<uint16_t>(udp, 4) != total_size - ip_header_size) {
+            return std::nullopt;
+        }
+
+        Layout output;
+        output.udp_offset = ip_header_size;
+        output.dhcp_offset = ip_header_size + UDP::header_size;
+        output.datagram_end = total_size;
+
+        auto cookie = buffer.subspan(output.dhcp_offset + header_size, 4);
+        if (!std::ranges::equal(cookie, magic_cookie)) {
+            return std::nullopt;
+        }
+
+        return output;
+    }
+
+    static Checksums read_checksums(std::span<const std::byte> buffer, Layout L)
+    {
+        Checksums output;
+        output.ip = load_be<uint16_t>(buffer, 10);
+        output.udp = load_be<uint16_t>(buffer, L.udp_offset + 6);
+        output.udp_enabled = output.udp != 0;
+        return output;
+    }
+
+    static void
+        write_checksums(std::span<std::byte> buffer, Layout L, Checksums C)
+    {
+        store_be<uint16_t>(buffer, 10, C.ip);
+        uint16_t udp = C.udp_enabled ? Checksum::udp_nonzero(C.udp) : 0;
+        store_be<uint16_t>(buffer, L.udp_offset + 6, udp);
+    }
+
+    // Offset of the END option (or of the first byte past the options)
+    static std::optional<size_t>
+        find_end(std::span<const std::byte> buffer, Layout L)
+    {
+        size_t offset = L.dhcp_offset + options_offset;
+        while (offset < L.datagram_end) {
+            uint8_t code = std::to_integer<uint8_t>(buffer[offset]);
+            if (code == uint8_t(OptionCode::END)) {
+                return offset;
+            }
+            if (code == uint8_t(OptionCode::PAD)) {
+                offset++;
+                continue;
+            }
+            if (offset + 1 >= L.datagram_end) {
+                return std::nullopt;
+            }
+            offset += 2 + std::to_integer<uint8_t>(buffer[offset + 1]);
+        }
+
+        if (offset != L.datagram_end) {
+            return std::nullopt;
+        }
+        return offset;
+    }
+
+    static bool has_agent_option(std::span<const std::byte> buffer, Layout L)
+    {
+        size_t begin = L.dhcp_offset + options_offset;
+        size_t end = find_end(buffer, L).value_or(L.datagram_end);
+        if (begin >= end) {
+            return false;
+        }
+        auto existing = PacketView::find_option_in(
+            buffer.subspan(begin, end - begin),
+            OptionCode::RELAY_AGENT_INFORMATION);
+        return existing.has_value();
+    }
+
+    /*
+     * Overwrites END (and trailing PADs) with option 82 followed by END,
+     * growing into tailroom only when the padding is too short
+     */
+    std::optional<size_t> insert_agent_option(
+        std::span<std::byte> buffer, Layout L, Checksums &C) const
+    {
+        auto end_opt = find_end(buffer, L);
+        if (!end_opt) {
+            return std::nullopt;
+        }
+
+        size_t begin = end_opt.value();
+        size_t new_content_end = begin + m_agent_option_size + 1;
+        size_t new_end = std::max(new_content_end, L.datagram_end);
+        if (new_end > buffer.size() ||
+            new_end - L.udp_offset > std::numeric_limits<uint16_t>::max()) {
+            return std::nullopt;
+        }
+
+        size_t parity = begin - L.udp_offset;
+        uint16_t old_sum = Checksum::partial(
+            buffer.subspan(begin, L.datagram_end - begin), parity);
+
+        std::ranges::copy(
+            std::span(m_agent_option).first(m_agent_option_size),
+            buffer.begin() + begin);
+        buffer[new_content_end - 1] = std::byte(OptionCode::END);
+        std::fill(
+            buffer.begin() + new_content_end,
+            buffer.begin() + new_end,
+            std::byte(0));
+
+        uint16_t new_sum =
+            Checksum::partial(buffer.subspan(begin, new_end - begin), parity);
+        C.udp = Checksum::update(C.udp, old_sum, new_sum);
+        return new_end;
+    }
+
+    static std::optional<size_t>
+        strip_agent_option(std::span<std::byte> buffer, Layout L, Checksums &C)
+    {
+        size_t offset = L.dhcp_offset + options_offset;
+        while (offset + 1 < L.datagram_end) {
+            uint8_t code = std::to_integer<uint8_t>(buffer[offset]);
+            if (code == uint8_t(OptionCode::END)) {
+                return std::nullopt;
+            }
+            if (code == uint8_t(OptionCode::PAD)) {
+                offset++;
+                continue;
+            }
+
+            size_t option_size =
+                2 + std::to_integer<uint8_t>(buffer[offset + 1]);
+            if (offset + option_size > L.datagram_end) {
+                return std::nullopt;
+            }
+
+            if (code != uint8_t(OptionCode::RELAY_AGENT_INFORMATION)) {
+                offset += option_size;
+                continue;
+            }
+
+            size_t parity = offset - L.udp_offset;
+            uint16_t old_sum = Checksum::partial(
+                buffer.subspan(offset, L.datagram_end - offset), parity);
+
+            std::memmove(
+                buffer.data() + offset,
+                buffer.data() + offset + option_size,
+                L.datagram_end - offset - option_size);
+
+            size_t new_end = L.datagram_end - option_size;
+            uint16_t new_sum = Checksum::partial(
+                buffer.subspan(offset, new_end - offset), parity);
+            C.udp = Checksum::update(C.udp, old_sum, new_sum);
+            return new_end;
+        }
+
+        return std::nullopt;
+    }
+
+    // UDP length sits in both the pseudo header and the UDP header
+    static void resize(
+        std::span<std::byte> buffer, Layout &L, Checksums &C, size_t new_end)
+    {
+        uint16_t old_total = load_be<uint16_t>(buffer, 2);
+        uint16_t new_total = new_end;
+        store_be<uint16_t>(buffer, 2, new_total);
+        C.ip = Checksum::update(C.ip, old_total, new_total);
+
+        uint16_t old_udp_length = L.datagram_end - L.udp_offset;
+        uint16_t new_udp_length = new_end - L.udp_offset;
+        store_be<uint16_t>(buffer, L.udp_offset + 4, new_udp_length);
+        C.udp = Checksum::update(C.udp, old_udp_length, new_udp_length);
+        C.udp = Checksum::update(C.udp, old_udp_length, new_udp_length);
+
+        L.datagram_end = new_end;
+    }
+
+    void rewrite_addressing(
+        std::span<std::byte> buffer,
+        Layout L,
+        Checksums &C,
+        UDP::Endpoint source,
+        UDP::Endpoint destination) const
+    {
+        IPv4::Address old_source = read_address(buffer, 12);
+        IPv4::Address old_destination = read_address(buffer, 16);
+        write_address(buffer, 12, source.address);
+        write_address(buffer, 16, destination.address);
+        C.ip = Checksum::update_address(C.ip, old_source, source.address);
+        C.ip = Checksum::update_address(
+            C.ip, old_destination, destination.address);
+        C.udp = Checksum::update_address(C.udp, old_source, source.address);
+        C.udp = Checksum::update_address(
+            C.udp, old_destination, destination.address);
+
+        uint16_t old_ttl_protocol = load_be<uint16_t>(buffer, 8);
+        buffer[8] = std::byte(m_config.time_to_live);
+        C.ip = Checksum::update(
+            C.ip, old_ttl_protocol, load_be<uint16_t>(buffer, 8));
+
+        uint16_t old_source_port = load_be<uint16_t>(buffer, L.udp_offset);
+        uint16_t old_destination_port =
+            load_be<uint16_t>(buffer, L.udp_offset + 2);
+        store_be<uint16_t>(buffer, L.udp_offset, source.port);
+        store_be<uint16_t>(buffer, L.udp_offset + 2, destination.port);
+        C.udp = Checksum::update(C.udp, old_source_port, source.port);
+        C.udp = Checksum::update(C.udp, old_destination_port, destination.port);
+    }
+};
+
+} // namespace xnet::DHCP
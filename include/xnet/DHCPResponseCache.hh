@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <optional>
+#include <span>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <xnet/DHCP.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::DHCP {
+
+struct ResponseKey
+{
+    ClientHardwareAddr chaddr;
+    uint32_t xid;
+    MessageType type;
+};
+
+struct ResponseCacheStats
+{
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    // Matching entry older than its time to live
+    std::atomic<uint64_t> stale{0};
+    std::atomic<uint64_t> stores{0};
+    // Slot busy with a concurrent write, the lookup or store was skipped
+    std::atomic<uint64_t> contended{0};
+};
+
+/*
+ * Replays the exact reply of a retransmitted request (same chaddr, xid and
+ * message type) without redoing lease work. Fixed number of 2-way set
+ * associative slots, each guarded by a sequence lock: lookups never block
+ * and retry nothing, writers that lose a race drop their entry.
+ *
+ * Times are in caller defined ticks, an entry is served while now < expires.
+ */
+struct ResponseCache
+{
+    static constexpr size_t max_response_size = 576;
+
+    ResponseCache(size_t capacity)
+        : m_slots(new Slot[std::bit_ceil(std::max<size_t>(2, capacity))]),
+          m_mask(std::bit_ceil(std::max<size_t>(2, capacity)) - 1)
+    {
+    }
+
+    ResponseCache(const ResponseCache &) = delete;
+    ResponseCache &operator=(const ResponseCache &) = delete;
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    const ResponseCacheStats &stats() const
+    {
+        return m_stats;
+    }
+
+    // Copies the cached reply into `output` and returns its size
+    std::optional<size_t> lookup(
+        const ResponseKey &key,
+        uint64_t now,
+        std::span<std::byte> output,
+        UDP::Endpoint &reply_to)
+    {
+        size_t set = index_of(key);
+        for (size_t way = 0; way < 2; way++) {
+            Slot &slot = m_slots[set ^ way];
+
+            uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if ((sequence & 1) != 0) {
+                continue;
+            }
+
+            Entry entry;
+            std::memcpy(&entry, &slot.entry, sizeof(entry));
+            if (!stable(slot, sequence) || !matches(entry, key)) {
+                continue;
+            }
+
+            if (entry.expires <= now) {
+                m_stats.stale.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            if (entry.size > output.size()) {
+                break;
+            }
+
+            std::memcpy(output.data(), slot.data.data(), entry.size);
+            if (!stable(slot, sequence)) {
+                m_stats.contended.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+
+            reply_to = entry.reply_to;
+            m_stats.hits.fetch_add(1, std::memory_order_relaxed);
+            return entry.size;
+        }
+
+        m_stats.misses.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    // Replaces the same key or the entry closer to expiry in the set
+    bool store(
+        const ResponseKey &key,
+        uint64_t expires,
+        std::span<const std::byte> response,
+        const UDP::Endpoint &reply_to)
+    {
+        if (response.size() > max_response_size) {
+            return false;
+        }
+
+        size_t set = index_of(key);
+        Slot *slot = &m_slots[set];
+        Slot *other = &m_slots[set ^ 1];
+        bool same_key = matches(other->entry, key);
+        if (same_key || (!matches(slot->entry, key) &&
+                         other->entry.expires < slot->entry.expires)) {
+            slot = other;
+        }
+
+        uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+        if ((sequence & 1) != 0 ||
+            !slot->sequence.compare_exchange_strong(
+                sequence, sequence + 1, std::memory_order_relaxed)) {
+            m_stats.contended.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->entry.chaddr = key.chaddr.data();
+        slot->entry.xid = key.xid;
+        slot->entry.type = key.type;
+        slot->entry.size = response.size();
+        slot->entry.expires = expires;
+        slot->entry.reply_to = reply_to;
+        std::memcpy(slot->data.data(), response.data(), response.size());
+
+        slot->sequence.store(sequence + 2, std::memory_order_release);
+        m_stats.stores.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Drops every entry, e.g. when replies already cached were not durable
+    void clear()
+    {
+        for (size_t idx = 0; idx <= m_mask; idx++) {
+            Slot &slot = m_slots[idx];
+            uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            if ((sequence & 1) != 0 ||
+                !slot.sequence.compare_exchange_strong(
+                    sequence, sequence + 1, std::memory_order_relaxed)) {
+                continue;
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.entry.expires = 0;
+            slot.sequence.store(sequence + 2, std::memory_order_release);
+        }
+    }
+
+  private:
+    struct Entry
+    {
+        std::array<std::byte, 16> chaddr{};
+        uint32_t xid = 0;
+        MessageType type{};
+        uint16_t size = 0;
+        uint64_t expires = 0;
+        UDP::Endpoint reply_to;
+    };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint32_t> sequence{0};
+        Entry entry;
+        std::array<std::byte, max_response_size> data;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+    ResponseCacheStats m_stats;
+
+    size_t index_of(const ResponseKey &key) const
+    {
+        uint64_t seed = (uint64_t(key.xid) << 8) | uint8_t(key.type);
+        return hash(key.chaddr, seed) & m_mask;
+    }
+
+    static bool matches(const Entry &entry, const ResponseKey &key)
+    {
+        return entry.expires != 0 && entry.xid == key.xid &&
+               entry.type == key.type && entry.chaddr == key.chaddr.data();
+    }
+
+    static bool stable(const Slot &slot, uint32_t sequence)
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+};
+
+} // namespace xnet::DHCP
@@ -0,0 +1,1500 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/filter.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/DHCP.hh>
+#include <xnet/DHCPAdmission.hh>
+#include <xnet/DHCPLeaseStore.hh>
+#include <xnet/DHCPMacList.hh>
+#include <xnet/DHCPRateLimiter.hh>
+#include <xnet/DHCPResponseCache.hh>
+#include <xnet/HotRestart.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/SharedMemory.hh>
+#include <xnet/TimingWheel.hh>
+#include <xnet/TopTalkers.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::DHCP {
+
+struct ServerConfig
+{
+    IPv4::Address server_address{};
+    IPv4::Address subnet_mask{255, 255, 255, 0};
+    std::optional<IPv4::Address> router;
+
+    IPv4::Address pool_start{};
+    uint32_t pool_size = 0;
+
+    std::chrono::seconds lease_time{3600};
+    std::chrono::seconds offer_hold{30};
+    // Addresses a client declined as already in use stay out of the pool
+    std::chrono::seconds decline_holdoff{600};
+    std::chrono::milliseconds timer_tick{100};
+
+    UDP::Endpoint bind_to{IPv4::Address(), server_port};
+    // Answer to the datagram source instead of broadcasting, loopback tests
+    bool reply_to_source = false;
+
+    size_t nb_workers = 1;
+    int socket_buffer = 4 << 20;
+
+    // Per shard lease database `<path>.<shard>`, leases are volatile if empty
+    std::string lease_store_path;
+
+    // Replies replayed to retransmissions, slots per shard, 0 disables
+    size_t response_cache_size = 4096;
+    std::chrono::milliseconds response_cache_ttl{2000};
+
+    // Ingress token buckets by chaddr and by giaddr, off while rate is 0
+    TokenBucketConfig client_limit;
+    TokenBucketConfig relay_limit;
+    size_t rate_limiter_size = 16384;
+
+    // chaddr allow or deny list, lists published there apply immediately
+    std::shared_ptr<const MacListRegistry> mac_list;
+
+    // Hot restart, see Server. Both are off if empty
+    std::string shared_state_name;
+    std::string handover_path;
+
+    // Priority queues between the socket and lease processing, see
+    // AdmissionQueue. Without them requests are served in arrival order
+    std::optional<AdmissionConfig> admission = AdmissionConfig();
+
+    // Heavy hitter sketches, workers publish their counts every interval
+    std::optional<TopTalkersConfig> top_talkers;
+    std::chrono::milliseconds top_talkers_interval{1000};
+};
+
+/*
+ * chaddr based shard selection. The kernel runs the same hash as classic BPF
+ * on the reuseport group, so both functions must stay in sync.
+ */
+constexpr uint32_t
+    shard_of(const ClientHardwareAddr &chaddr, uint32_t nb_shards)
+{
+    auto data = chaddr.data();
+    std::array<std::byte, 4> word{data[0], data[1], data[2], data[3]};
+    std::array<std::byte, 2> half{data[4], data[5]};
+
+    uint32_t hash = betoh<uint32_t>(word) ^ betoh<uint16_t>(half);
+    hash *= 0x9e3779b1;
+    hash >>= 16;
+    return hash % nb_shards;
+}
+
+constexpr std::array<sock_filter, 8> steering_program(uint32_t nb_shards)
+{
+    constexpr uint32_t chaddr_offset = 28;
+    return std::array<sock_filter, 8>{
+        sock_filter{BPF_LD | BPF_W | BPF_ABS, 0, 0, chaddr_offset},
+        sock_filter{BPF_MISC | BPF_TAX, 0, 0, 0},
+        sock_filter{BPF_LD | BPF_H | BPF_ABS, 0, 0, chaddr_offset + 4},
+        sock_filter{BPF_ALU | BPF_XOR | BPF_X, 0, 0, 0},
+        sock_filter{BPF_ALU | BPF_MUL | BPF_K, 0, 0, 0x9e3779b1},
+        sock_filter{BPF_ALU | BPF_RSH | BPF_K, 0, 0, 16},
+        sock_filter{BPF_ALU | BPF_MOD | BPF_K, 0, 0, nb_shards},
+        sock_filter{BPF_RET | BPF_A, 0, 0, 0},
+    };
+}
+
+enum class LeaseState : uint8_t
+{
+    FREE,
+    OFFERED,
+    BOUND,
+    DECLINED
+};
+
+struct Lease
+{
+    ClientHardwareAddr chaddr;
+    uint32_t xid{};
+    LeaseState state = LeaseState::FREE;
+    TimerNode timer;
+};
+
+struct LeaseTableHeader
+{
+    uint64_t capacity;
+    uint64_t nb_free;
+    uint64_t free_cursor;
+    TimingWheelState wheel;
+};
+
+/*
+ * Offsets of the parts of a lease table inside one flat memory block. Only
+ * indices link the parts, so the block may be mapped anywhere.
+ */
+struct LeaseTableLayout
+{
+    size_t capacity;
+    size_t index_size;
+    size_t bitmap_words;
+    size_t leases_offset;
+    size_t index_offset;
+    size_t bitmap_offset;
+    size_t size;
+
+    static constexpr size_t alignment = 64;
+
+    static constexpr LeaseTableLayout of(size_t capacity)
+    {
+        auto align = [](size_t offset) {
+            return (offset + alignment - 1) / alignment * alignment;
+        };
+
+        LeaseTableLayout output{};
+        output.capacity = capacity;
+        output.index_size = std::bit_ceil(std::max<size_t>(16, capacity * 2));
+        output.bitmap_words = (capacity + 63) / 64;
+
+        output.leases_offset = align(sizeof(LeaseTableHeader));
+        output.index_offset =
+            align(output.leases_offset + capacity * sizeof(Lease));
+        output.bitmap_offset = align(
+            output.index_offset + output.index_size * sizeof(uint32_t));
+        output.size = align(
+            output.bitmap_offset + output.bitmap_words * sizeof(uint64_t));
+        return output;
+    }
+};
+
+/*
+ * Addresses and leases of one shard. Owns every `shard + k * nb_shards`-th
+ * pool address, touched by a single thread only.
+ *
+ * State lives in a LeaseTableLayout block, either heap owned or provided by
+ * the caller (shared memory) and possibly already initialized.
+ */
+struct LeaseTable
+{
+    // Heap backed unless `memory` (at least LeaseTableLayout::size) is given
+    LeaseTable(
+        const ServerConfig &config,
+        uint32_t shard,
+        uint32_t nb_shards,
+        std::span<std::byte> memory = {},
+        bool initialize = true)
+        : m_pool_start(to_u32(config.pool_start)), m_shard(shard),
+          m_nb_shards(nb_shards),
+          m_layout(LeaseTableLayout::of(capacity_of(config, shard, nb_shards))),
+          m_owned(memory.empty() ? new std::byte[m_layout.size] : nullptr),
+          m_memory(
+              memory.empty() ? std::span(m_owned.get(), m_layout.size)
+                             : memory),
+          m_header(header_in(m_memory)),
+          m_leases(part<Lease>(m_layout.leases_offset, m_layout.capacity)),
+          m_index(part<uint32_t>(m_layout.index_offset, m_layout.index_size)),
+          m_free(part<uint64_t>(m_layout.bitmap_offset, m_layout.bitmap_words)),
+          m_wheel(m_leases, m_header.wheel)
+    {
+        assert(m_memory.size() >= m_layout.size);
+        if (initialize || m_owned) {
+            reset();
+        }
+    }
+
+    LeaseTable(const LeaseTable &) = delete;
+    LeaseTable &operator=(const LeaseTable &) = delete;
+
+    static size_t capacity_of(
+        const ServerConfig &config, uint32_t shard, uint32_t nb_shards)
+    {
+        if (config.pool_size <= shard) {
+            return 0;
+        }
+        return (config.pool_size - shard + nb_shards - 1) / nb_shards;
+    }
+
+    size_t capacity() const
+    {
+        return m_leases.size();
+    }
+
+    size_t nb_free() const
+    {
+        return m_header.nb_free;
+    }
+
+    Lease &lease(uint32_t idx)
+    {
+        return m_leases[idx];
+    }
+
+    const Lease &lease(uint32_t idx) const
+    {
+        return m_leases[idx];
+    }
+
+    TimingWheel<Lease, &Lease::timer> &timers()
+    {
+        return m_wheel;
+    }
+
+    IPv4::Address address_of(uint32_t idx) const
+    {
+        return from_u32(m_pool_start + m_shard + idx * m_nb_shards);
+    }
+
+    std::optional<uint32_t> index_of(IPv4::Address address) const
+    {
+        uint32_t addr = to_u32(address);
+        if (addr < m_pool_start + m_shard) {
+            return std::nullopt;
+        }
+
+        uint32_t offset = addr - m_pool_start - m_shard;
+        if (offset % m_nb_shards != 0 ||
+            offset / m_nb_shards >= m_leases.size()) {
+            return std::nullopt;
+        }
+        return offset / m_nb_shards;
+    }
+
+    std::optional<uint32_t> find(const ClientHardwareAddr &chaddr) const
+    {
+        size_t mask = m_index.size() - 1;
+        for (size_t pos = hash(chaddr) & mask;; pos = (pos + 1) & mask) {
+            uint32_t idx = m_index[pos];
+            if (idx == TimerNode::no_index) {
+                return std::nullopt;
+            }
+            if (m_leases[idx].chaddr == chaddr) {
+                return idx;
+            }
+        }
+    }
+
+    // Lowest free address first, the cursor keeps the bitmap scan short
+    std::optional<uint32_t> allocate(const ClientHardwareAddr &chaddr)
+    {
+        if (m_header.nb_free == 0) {
+            return std::nullopt;
+        }
+
+        size_t word = m_header.free_cursor;
+        while (m_free[word] == 0) {
+            word = (word + 1) % m_free.size();
+        }
+        m_header.free_cursor = word;
+
+        uint32_t idx = word * 64 + std::countr_zero(m_free[word]);
+        take(idx);
+
+        Lease &l = m_leases[idx];
+        l.chaddr = chaddr;
+        l.state = LeaseState::OFFERED;
+        insert_index(idx);
+        return idx;
+    }
+
+    // Rebinds a lease loaded from storage, call rebuild_free_list() after
+    bool restore(uint32_t idx, const ClientHardwareAddr &chaddr)
+    {
+        if (idx >= m_leases.size() || find(chaddr)) {
+            return false;
+        }
+
+        Lease &l = m_leases[idx];
+        l.chaddr = chaddr;
+        l.state = LeaseState::BOUND;
+        insert_index(idx);
+        return true;
+    }
+
+    void rebuild_free_list()
+    {
+        std::ranges::fill(m_free, 0);
+        m_header.nb_free = 0;
+        m_header.free_cursor = 0;
+        for (uint32_t idx = 0; idx < m_leases.size(); idx++) {
+            if (m_leases[idx].state == LeaseState::FREE) {
+                give_back(idx);
+            }
+        }
+    }
+
+    void release(uint32_t idx)
+    {
+        Lease &l = m_leases[idx];
+        if (l.state == LeaseState::FREE) {
+            return;
+        }
+
+        m_wheel.cancel(idx);
+        if (l.state != LeaseState::DECLINED) {
+            erase_index(l.chaddr);
+        }
+        l.state = LeaseState::FREE;
+        give_back(idx);
+    }
+
+    /*
+     * Detaches the lease from its client without freeing the address, which
+     * comes back with release(). The client may get another one meanwhile.
+     */
+    void quarantine(uint32_t idx)
+    {
+        Lease &l = m_leases[idx];
+        if (l.state == LeaseState::FREE || l.state == LeaseState::DECLINED) {
+            return;
+        }
+
+        erase_index(l.chaddr);
+        l.state = LeaseState::DECLINED;
+    }
+
+  private:
+    uint32_t m_pool_start;
+    uint32_t m_shard;
+    uint32_t m_nb_shards;
+    LeaseTableLayout m_layout;
+    std::unique_ptr<std::byte[]> m_owned;
+    std::span<std::byte> m_memory;
+    LeaseTableHeader &m_header;
+    std::span<Lease> m_leases;
+    std::span<uint32_t> m_index;
+    std::span<uint64_t> m_free;
+    TimingWheel<Lease, &Lease::timer> m_wheel;
+
+    static LeaseTableHeader &header_in(std::span<std::byte> memory)
+    {
+        return *(LeaseTableHeader *)memory.data();
+    }
+
+    template <typename T>
+    std::span<T> part(size_t offset, size_t count)
+    {
+        return std::span<T>((T *)(m_memory.data() + offset), count);
+    }
+
+    void reset()
+    {
+        new (&m_header) LeaseTableHeader{};
+        m_header.capacity = m_layout.capacity;
+        std::uninitialized_default_construct(m_leases.begin(), m_leases.end());
+        std::ranges::fill(m_index, TimerNode::no_index);
+        rebuild_free_list();
+    }
+
+    void take(uint32_t idx)
+    {
+        m_free[idx / 64] &= ~(uint64_t(1) << (idx % 64));
+        m_header.nb_free--;
+    }
+
+    void give_back(uint32_t idx)
+    {
+        m_free[idx / 64] |= uint64_t(1) << (idx % 64);
+        m_header.nb_free++;
+    }
+
+    static constexpr uint32_t to_u32(IPv4::Address a)
+    {
+        return betoh<uint32_t>(a.data_msbf());
+    }
+
+    static constexpr IPv4::Address from_u32(uint32_t a)
+    {
+        return IPv4::Address(htobe<uint32_t>(a));
+    }
+
+    void insert_index(uint32_t idx)
+    {
+        size_t mask = m_index.size() - 1;
+        size_t pos = hash(m_leases[idx].chaddr) & mask;
+        while (m_index[pos] != TimerNode::no_index) {
+            pos = (pos + 1) & mask;
+        }
+        m_index[pos] = idx;
+    }
+
+    // Backward shift deletion, keeps probe chains tombstone free
+    void erase_index(const ClientHardwareAddr &chaddr)
+    {
+        size_t mask = m_index.size() - 1;
+        size_t pos = hash(chaddr) & mask;
+        while (m_index[pos] != TimerNode::no_index &&
+               !(m_leases[m_index[pos]].chaddr == chaddr)) {
+            pos = (pos + 1) & mask;
+        }
+        if (m_index[pos] == TimerNode::no_index) {
+            return;
+        }
+
+        size_t hole = pos;
+        for (size_t next = (hole + 1) & mask;
+             m_index[next] != TimerNode::no_index;
+             next = (next + 1) & mask) {
+            size_t home = hash(m_leases[m_index[next]].chaddr) & mask;
+            bool movable = ((next - home) & mask) >= ((next - hole) & mask);
+            if (movable) {
+                m_index[hole] = m_index[next];
+                hole = next;
+            }
+        }
+        m_index[hole] = TimerNode::no_index;
+    }
+};
+
+struct ShardStats
+{
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> receive_errors{0};
+    std::atomic<uint64_t> malformed{0};
+    std::atomic<uint64_t> offers{0};
+    std::atomic<uint64_t> acks{0};
+    std::atomic<uint64_t> naks{0};
+    std::atomic<uint64_t> releases{0};
+    std::atomic<uint64_t> declines{0};
+    std::atomic<uint64_t> pool_exhausted{0};
+    std::atomic<uint64_t> expired{0};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> send_errors{0};
+    std::atomic<uint64_t> store_failures{0};
+    std::atomic<uint64_t> rate_limited{0};
+    std::atomic<uint64_t> mac_rejected{0};
+};
+
+/*
+ * Lease logic of one shard, independent of how packets arrive. `handle`
+ * writes the reply DHCP payload into `reply` and returns its size.
+ */
+struct ShardEngine
+{
+    /*
+     * `table_memory` places the lease table outside the heap. With `attach`
+     * it already holds a live table, which is taken over as is: no reload
+     * from the store, due timers fire on the first expire().
+     */
+    ShardEngine(
+        const ServerConfig &config,
+        uint32_t shard,
+        uint32_t nb_shards,
+        std::optional<LeaseStore> store = std::nullopt,
+        std::span<std::byte> table_memory = {},
+        bool attach = false)
+        : m_config(config),
+          m_table(config, shard, nb_shards, table_memory, !attach),
+          m_clock(config.timer_tick), m_store(std::move(store))
+    {
+        if (config.response_cache_size != 0) {
+            m_cache.emplace(config.response_cache_size);
+        }
+        if (config.client_limit.rate > 0 || config.relay_limit.rate > 0) {
+            m_limiter.emplace(
+                config.client_limit,
+                config.relay_limit,
+                config.rate_limiter_size);
+        }
+        if (config.mac_list) {
+            m_mac_list.emplace(config.mac_list);
+        }
+
+        if (attach) {
+            return;
+        }
+
+        m_table.timers().advance(m_clock.now(), [](auto) {});
+        if (m_store) {
+            restore();
+        }
+    }
+
+    static constexpr size_t max_reply_size = 576;
+    static_assert(max_reply_size <= ResponseCache::max_response_size);
+
+    LeaseTable &table()
+    {
+        return m_table;
+    }
+
+    const ShardStats &stats() const
+    {
+        return m_stats;
+    }
+
+    ShardStats &stats()
+    {
+        return m_stats;
+    }
+
+    const std::optional<ResponseCache> &response_cache() const
+    {
+        return m_cache;
+    }
+
+    const std::optional<IngressLimiter> &limiter() const
+    {
+        return m_limiter;
+    }
+
+    /*
+     * Makes lease changes of the handled batch durable, replies must not
+     * leave before this succeeds
+     */
+    bool commit()
+    {
+        if (!m_store || m_store->commit()) {
+            return true;
+        }
+        m_stats.store_failures.fetch_add(1, std::memory_order_relaxed);
+
+        // Some cached ACKs may describe leases that were not persisted
+        if (m_cache) {
+            m_cache->clear();
+        }
+        return false;
+    }
+
+    // Lets background store work settle before another process takes over
+    void quiesce()
+    {
+        if (m_store) {
+            m_store->wait_compaction();
+        }
+    }
+
+    // Releases leases and offers whose timer ran out
+    void expire()
+    {
+        m_now_us = coarse_monotonic_us();
+        m_table.timers().advance(
+            m_clock.refresh(), [this](std::span<const uint32_t> expired) {
+                for (uint32_t idx : expired) {
+                    m_table.release(idx);
+                }
+                m_stats.expired.fetch_add(
+                    expired.size(), std::memory_order_relaxed);
+            });
+    }
+
+    std::optional<size_t> handle(
+        std::span<const std::byte> request,
+        const UDP::Endpoint &peer,
+        std::span<std::byte> reply,
+        UDP::Endpoint &reply_to)
+    {
+        m_stats.received.fetch_add(1, std::memory_order_relaxed);
+
+        PacketView packet(request);
+        auto header_opt = packet.header_view();
+        if (!header_opt || header_opt->op() != 1) {
+            m_stats.malformed.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        HeaderView header = header_opt.value();
+        if (m_limiter && !m_limiter->allow(header, m_now_us)) {
+            m_stats.rate_limited.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        if (m_mac_list && !m_mac_list->admits(header)) {
+            m_stats.mac_rejected.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        auto type_opt = packet.message_type();
+        if (!type_opt) {
+            m_stats.malformed.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        ClientHardwareAddr chaddr = header.chaddr().value();
+
+        switch (type_opt.value()) {
+        case MessageType::DHCPDISCOVER:
+        case MessageType::DHCPREQUEST:
+            return handle_cached(packet, header, chaddr, peer, reply, reply_to);
+        case MessageType::DHCPDECLINE:
+            if (auto idx = m_table.find(chaddr)) {
+                decline(*idx);
+            }
+            return std::nullopt;
+        case MessageType::DHCPRELEASE:
+            if (auto idx = m_table.find(chaddr)) {
+                if (m_store && m_table.lease(*idx).state == LeaseState::BOUND) {
+                    m_store->update(*idx, StoredLease{});
+                }
+                m_table.release(*idx);
+                m_stats.releases.fetch_add(1, std::memory_order_relaxed);
+            }
+            return std::nullopt;
+        case MessageType::DHCPINFORM:
+            return write_reply(
+                header,
+                MessageType::DHCPACK,
+                IPv4::Address(),
+                peer,
+                reply,
+                reply_to);
+        default:
+            m_stats.malformed.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+    }
+
+  private:
+    const ServerConfig &m_config;
+    LeaseTable m_table;
+    CoarseClock m_clock;
+    std::optional<LeaseStore> m_store;
+    std::optional<ResponseCache> m_cache;
+    std::optional<IngressLimiter> m_limiter;
+    std::optional<MacListReader> m_mac_list;
+    uint64_t m_now_us = coarse_monotonic_us();
+    ShardStats m_stats;
+
+    static uint64_t unix_now()
+    {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::seconds>(now).count();
+    }
+
+    void restore()
+    {
+        uint64_t now = unix_now();
+        auto leases = m_store->leases();
+        size_t nb_slots = std::min<size_t>(leases.size(), m_table.capacity());
+        for (uint32_t idx = 0; idx < nb_slots; idx++) {
+            const StoredLease &stored = leases[idx];
+            if (stored.state != uint8_t(LeaseState::BOUND) ||
+                stored.expires <= now) {
+                continue;
+            }
+
+            if (!m_table.restore(idx, ClientHardwareAddr(stored.chaddr))) {
+                continue;
+            }
+            m_table.timers().schedule(
+                idx,
+                ticks_after(std::chrono::seconds(stored.expires - now)));
+        }
+        m_table.rebuild_free_list();
+    }
+
+    // The address is in use by someone else, keep it out of the pool
+    void decline(uint32_t idx)
+    {
+        if (m_store && m_table.lease(idx).state == LeaseState::BOUND) {
+            m_store->update(idx, StoredLease{});
+        }
+        m_table.quarantine(idx);
+        m_table.timers().schedule(idx, ticks_after(m_config.decline_holdoff));
+        m_stats.declines.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t ticks_after(std::chrono::nanoseconds d) const
+    {
+        return m_clock.ticks_from_now(d);
+    }
+
+    // Retransmissions get the bytes of the first reply back
+    std::optional<size_t> handle_cached(
+        const PacketView &packet,
+        const HeaderView &header,
+        const ClientHardwareAddr &chaddr,
+        const UDP::Endpoint &peer,
+        std::span<std::byte> reply,
+        UDP::Endpoint &reply_to)
+    {
+        MessageType type = packet.message_type().value();
+        ResponseKey key{chaddr, header.xid().value(), type};
+        if (m_cache) {
+            auto size = m_cache->lookup(key, m_clock.now(), reply, reply_to);
+            if (size) {
+                return size;
+            }
+        }
+
+        auto size = type == MessageType::DHCPDISCOVER
+                        ? discover(header, chaddr, peer, reply, reply_to)
+                        : request_lease(
+                              packet, header, chaddr, peer, reply, reply_to);
+        if (size && m_cache) {
+            m_cache->store(
+                key,
+                ticks_after(m_config.response_cache_ttl),
+                reply.first(size.value()),
+                reply_to);
+        }
+        return size;
+    }
+
+    std::optional<size_t> discover(
+        const HeaderView &header,
+        const ClientHardwareAddr &chaddr,
+        const UDP::Endpoint &peer,
+        std::span<std::byte> reply,
+        UDP::Endpoint &reply_to)
+    {
+        auto idx_opt = m_table.find(chaddr);
+        if (!idx_opt) {
+            idx_opt = m_table.allocate(chaddr);
+            if (!idx_opt) {
+                m_stats.pool_exhausted.fetch_add(1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+        }
+
+        uint32_t idx = idx_opt.value();
+        Lease &l = m_table.lease(idx);
+        l.xid = header.xid().value();
+        if (l.state == LeaseState::OFFERED) {
+            m_table.timers().schedule(idx, ticks_after(m_config.offer_hold));
+        }
+
+        m_stats.offers.fetch_add(1, std::memory_order_relaxed);
+        return write_reply(
+            header,
+            MessageType::DHCPOFFER,
+            m_table.address_of(idx),
+            peer,
+            reply,
+            reply_to);
+    }
+
+    std::optional<size_t> request_lease(
+        const PacketView &packet,
+        const HeaderView &header,
+        const ClientHardwareAddr &chaddr,
+        const UDP::Endpoint &peer,
+        std::span<std::byte> reply,
+        UDP::Endpoint &reply_to)
+    {
+        auto server_id = packet.find_option(OptionCode::SERVER_IDENTIFIER);
+        if (server_id && server_id->size() == 4 &&
+            !std::ranges::equal(
+                *server_id, m_config.server_address.data_msbf())) {
+            // Client selected another server
+            if (auto idx = m_table.find(chaddr)) {
+                if (m_table.lease(*idx).state == LeaseState::OFFERED) {
+                    m_table.release(*idx);
+                }
+            }
+            return std::nullopt;
+        }
+
+        std::optional<IPv4::Address> requested;
+        auto requested_opt = packet.find_option(OptionCode::REQUESTED_ADDRESS);
+        if (requested_opt && requested_opt->size() == 4) {
+            std::array<std::byte, 4> data{};
+            std::ranges::copy(*requested_opt, data.begin());
+            requested = IPv4::Address(data);
+        } else if (header.ciaddr().value() != IPv4::Address()) {
+            requested = header.ciaddr().value();
+        }
+
+        auto idx_opt = m_table.find(chaddr);
+        if (!idx_opt || !requested ||
+            m_table.address_of(*idx_opt) != requested.value()) {
+            m_stats.naks.fetch_add(1, std::memory_order_relaxed);
+            return write_reply(
+                header,
+                MessageType::DHCPNAK,
+                IPv4::Address(),
+                peer,
+                reply,
+                reply_to);
+        }
+
+        uint32_t idx = idx_opt.value();
+        Lease &l = m_table.lease(idx);
+        l.state = LeaseState::BOUND;
+        l.xid = header.xid().value();
+        m_table.timers().schedule(idx, ticks_after(m_config.lease_time));
+
+        if (m_store) {
+            StoredLease stored;
+            stored.chaddr = chaddr.data();
+            stored.expires = unix_now() + m_config.lease_time.count();
+            stored.state = uint8_t(LeaseState::BOUND);
+            stored.hlen = header.hlen().value();
+            m_store->update(idx, stored);
+        }
+
+        m_stats.acks.fetch_add(1, std::memory_order_relaxed);
+        return write_reply(
+            header,
+            MessageType::DHCPACK,
+            m_table.address_of(idx),
+            peer,
+            reply,
+            reply_to);
+    }
+
+    std::optional<size_t> write_reply(
+        const HeaderView &request,
+        MessageType type,
+        IPv4::Address yiaddr,
+        const UDP::Endpoint &peer,
+        std::span<std::byte> reply,
+        UDP::Endpoint &reply_to)
+    {
+        if (reply.size() < header_size) {
+            return std::nullopt;
+        }
+
+        Header h = request.parse().value();
+        h.op = 2;
+        h.hops = 0;
+        h.secs = 0;
+        h.yiaddr = yiaddr;
+        h.siaddr = IPv4::Address();
+        h.sname = {};
+        h.file = {};
+        if (type == MessageType::DHCPNAK) {
+            h.ciaddr = IPv4::Address();
+        }
+
+        auto header_data = serialize(h);
+        std::ranges::copy(header_data, reply.begin());
+
+        OptionsWriter options(reply.subspan(header_size));
+        bool written = options.write_cookie();
+        written = written && options.write(OptionCode::MESSAGE_TYPE, type);
+        written = written && options.write(
+                                 OptionCode::SERVER_IDENTIFIER,
+                                 m_config.server_address);
+
+        if (type != MessageType::DHCPNAK) {
+            written = written && options.write(
+                                     OptionCode::SUBNET_MASK,
+                                     m_config.subnet_mask);
+            if (m_config.router) {
+                written = written &&
+                          options.write(OptionCode::ROUTER, *m_config.router);
+            }
+        }
+
+        if (type == MessageType::DHCPOFFER || yiaddr != IPv4::Address()) {
+            uint32_t lease_time = m_config.lease_time.count();
+            written =
+                written && options.write(OptionCode::LEASE_TIME, lease_time);
+            written = written &&
+                      options.write(OptionCode::RENEWAL_TIME, lease_time / 2);
+            written = written && options.write(
+                                     OptionCode::REBINDING_TIME,
+                                     lease_time / 8 * 7);
+        }
+
+        written = written && options.write_end();
+        if (!written) {
+            return std::nullopt;
+        }
+
+        reply_to = reply_destination(h, type, peer);
+        return header_size + options.size();
+    }
+
+    UDP::Endpoint reply_destination(
+        const Header &h, MessageType type, const UDP::Endpoint &peer) const
+    {
+        if (m_config.reply_to_source) {
+            return peer;
+        }
+
+        if (h.giaddr != IPv4::Address()) {
+            return UDP::Endpoint{h.giaddr, server_port};
+        }
+
+        if (type != MessageType::DHCPNAK && h.ciaddr != IPv4::Address()) {
+            return UDP::Endpoint{h.ciaddr, client_port};
+        }
+
+        return UDP::Endpoint{IPv4::Address(255, 255, 255, 255), client_port};
+    }
+};
+
+/*
+ * Header of the shared memory region of a hot restartable server, followed
+ * by one LeaseTableLayout block per shard.
+ */
+struct SharedStateHeader
+{
+    static constexpr uint64_t magic_value = 0x78646863'70736d31; // xdhcpsm1
+
+    uint64_t magic;
+    uint64_t fingerprint;
+    uint64_t size;
+    std::atomic<uint32_t> ready;
+};
+
+struct SharedStateLayout
+{
+    std::vector<size_t> table_offsets;
+    size_t size;
+
+    static SharedStateLayout of(const ServerConfig &config)
+    {
+        constexpr size_t alignment = LeaseTableLayout::alignment;
+
+        SharedStateLayout output{};
+        output.size = (sizeof(SharedStateHeader) + alignment - 1) / alignment *
+                      alignment;
+
+        uint32_t nb_shards = config.nb_workers;
+        for (uint32_t shard = 0; shard < nb_shards; shard++) {
+            output.table_offsets.push_back(output.size);
+            size_t capacity =
+                LeaseTable::capacity_of(config, shard, nb_shards);
+            output.size += LeaseTableLayout::of(capacity).size;
+        }
+        return output;
+    }
+
+    // Anything that changes the meaning of the bytes in the region
+    static uint64_t fingerprint(const ServerConfig &config)
+    {
+        std::array<uint64_t, 7> fields{
+            betoh<uint32_t>(config.pool_start.data_msbf()),
+            config.pool_size,
+            config.nb_workers,
+            uint64_t(config.timer_tick.count()),
+            sizeof(Lease),
+            sizeof(LeaseTableHeader),
+            TimingWheelLayout::levels,
+        };
+        return hash_bytes(std::as_bytes(std::span(fields)));
+    }
+};
+
+/*
+ * Reference multi-threaded server. Every worker owns a SO_REUSEPORT socket,
+ * the steering program pins each chaddr to one worker, so a ShardEngine is
+ * never shared between threads.
+ *
+ * Hot restart: with `shared_state_name` the lease tables live in a named
+ * shared memory region, with `handover_path` a successor started with the
+ * same config gets the sockets of the running server over SCM_RIGHTS and
+ * attaches to that region. Requests queued meanwhile stay in the sockets.
+ * The running server resumes if its successor fails to start. The
+ * successor replays the lease stores only once the handover is committed.
+ */
+struct Server
+{
+    static constexpr size_t batch_size = 64;
+
+    Server(ServerConfig config) : m_config(config)
+    {
+        m_config.nb_workers = std::max<size_t>(1, m_config.nb_workers);
+    }
+
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+
+    ~Server()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        if (!m_workers.empty()) {
+            return false;
+        }
+        if (!m_config.client_limit.valid() || !m_config.relay_limit.valid()) {
+            return false;
+        }
+
+        uint32_t nb_shards = m_config.nb_workers;
+
+        // What can fail without the sockets fails before a predecessor stops
+        if (!m_config.lease_store_path.empty()) {
+            for (uint32_t shard = 0; shard < nb_shards; shard++) {
+                if (!LeaseStore::check(store_options(shard))) {
+                    return false;
+                }
+            }
+        }
+        bool attach = false;
+        if (!m_config.shared_state_name.empty() && !map_shared_state(attach)) {
+            return false;
+        }
+
+        std::vector<UDP::Socket> sockets;
+        std::optional<HotRestart::Handover> handover;
+        if (!m_config.handover_path.empty()) {
+            // The predecessor has stopped its workers once this returns
+            auto requested =
+                HotRestart::request_handover(m_config.handover_path);
+            if (requested) {
+                handover.emplace(std::move(requested.value()));
+            }
+        }
+        if (handover) {
+            for (int fd : handover->fds) {
+                sockets.push_back(UDP::Socket::adopt(fd));
+            }
+            // Dropping `handover` from here on gives them back
+            if (sockets.size() != nb_shards) {
+                m_shared.reset();
+                return false;
+            }
+        }
+        bool adopted = handover.has_value();
+
+        if (!adopted && !open_sockets(sockets)) {
+            m_shared.reset();
+            return false;
+        }
+        if (adopted) {
+            m_config.bind_to.port = sockets.front().local_endpoint()->port;
+        }
+
+        // Adopted sockets keep the program attached to their group
+        auto program = steering_program(nb_shards);
+        if (!adopted && !sockets.front().attach_reuseport_cbpf(program)) {
+            m_shared.reset();
+            return false;
+        }
+
+        /*
+         * The stores are replayed only once the predecessor acknowledged,
+         * it no longer writes to them then. check() ruled out the likely
+         * failures, what is left is an I/O error and costs the service.
+         */
+        if (handover && !handover->commit()) {
+            m_shared.reset();
+            return false;
+        }
+
+        if (m_config.top_talkers) {
+            m_talkers.emplace(m_config.top_talkers.value());
+        }
+
+        for (uint32_t shard = 0; shard < nb_shards; shard++) {
+            std::optional<LeaseStore> store;
+            if (!m_config.lease_store_path.empty()) {
+                auto opened = LeaseStore::open(store_options(shard));
+                if (!opened) {
+                    m_workers.clear();
+                    m_shared.reset();
+                    return false;
+                }
+                store.emplace(std::move(opened.value()));
+            }
+
+            std::span<std::byte> table_memory;
+            if (m_shared) {
+                auto layout = SharedStateLayout::of(m_config);
+                table_memory =
+                    m_shared->data().subspan(layout.table_offsets[shard]);
+            }
+
+            m_workers.push_back(std::make_unique<Worker>(
+                m_config,
+                shard,
+                nb_shards,
+                std::move(sockets[shard]),
+                std::move(store),
+                table_memory,
+                attach,
+                m_talkers ? &m_talkers.value() : nullptr));
+        }
+
+        /*
+         * Past a commit the sockets are only served from here, so a
+         * listener that fails to come up only costs the next handover
+         */
+        std::optional<HotRestart::Listener> listener;
+        if (!m_config.handover_path.empty()) {
+            auto listening =
+                HotRestart::Listener::listen(m_config.handover_path);
+            if (listening) {
+                listener.emplace(std::move(listening.value()));
+            } else if (!adopted) {
+                m_workers.clear();
+                m_shared.reset();
+                return false;
+            }
+        }
+
+        if (m_shared) {
+            m_shared->object_at<SharedStateHeader>(0).ready.store(
+                1, std::memory_order_release);
+        }
+
+        start_workers();
+
+        if (listener) {
+            m_handover = std::jthread(
+                [this, l = std::move(listener.value())](
+                    std::stop_token st) mutable { serve_handover(st, l); });
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        m_handover.request_stop();
+        if (m_handover.joinable()) {
+            m_handover.join();
+        }
+
+        for (auto &worker : m_workers) {
+            worker->thread.request_stop();
+        }
+        m_workers.clear();
+        m_shared.reset();
+    }
+
+    // Workers are stopped and their sockets belong to a successor
+    bool handed_over() const
+    {
+        return m_handed_over.load(std::memory_order_acquire);
+    }
+
+    /*
+     * A worker stopped on a socket error it cannot recover from, the
+     * clients steered to its shard get no answer until a restart
+     */
+    bool failed() const
+    {
+        for (const auto &worker : m_workers) {
+            if (worker->failed.load(std::memory_order_acquire)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    UDP::Endpoint endpoint() const
+    {
+        return m_config.bind_to;
+    }
+
+    size_t nb_workers() const
+    {
+        return m_workers.size();
+    }
+
+    const ShardStats &stats(size_t worker) const
+    {
+        return m_workers[worker]->engine.stats();
+    }
+
+    const std::optional<ResponseCache> &response_cache(size_t worker) const
+    {
+        return m_workers[worker]->engine.response_cache();
+    }
+
+    // Only the stats of the queue may be read while the server runs
+    const std::optional<AdmissionQueue> &admission(size_t worker) const
+    {
+        return m_workers[worker]->admission;
+    }
+
+    // Counts published by the workers so far, empty if disabled
+    std::optional<TopTalkersSnapshot> top_talkers() const
+    {
+        if (!m_talkers) {
+            return std::nullopt;
+        }
+        return m_talkers->snapshot();
+    }
+
+  private:
+    struct Worker
+    {
+        Worker(
+            const ServerConfig &config,
+            uint32_t shard,
+            uint32_t nb_shards,
+            UDP::Socket s,
+            std::optional<LeaseStore> store,
+            std::span<std::byte> table_memory,
+            bool attach,
+            TopTalkersTotal *talkers_total)
+            : socket(std::move(s)),
+              engine(
+                  config,
+                  shard,
+                  nb_shards,
+                  std::move(store),
+                  table_memory,
+                  attach),
+              talkers_total(talkers_total),
+              talkers_interval(config.top_talkers_interval)
+        {
+            if (config.admission) {
+                admission.emplace(config.admission.value());
+                for (size_t capacity : config.admission->capacity) {
+                    pull_limit += capacity;
+                }
+            }
+            if (talkers_total) {
+                talkers.emplace(config.top_talkers.value());
+            }
+        }
+
+        UDP::Socket socket;
+        ShardEngine engine;
+        std::optional<AdmissionQueue> admission;
+        size_t pull_limit = 0;
+        std::optional<TopTalkers> talkers;
+        TopTalkersTotal *talkers_total;
+        std::chrono::milliseconds talkers_interval;
+        std::atomic<bool> failed{false};
+        std::jthread thread;
+
+        void run(std::stop_token st)
+        {
+            auto rx = std::make_unique<UDP::RecvBatch<batch_size>>();
+            auto tx_buffers = std::make_unique<
+                std::array<
+                    std::array<std::byte, ShardEngine::max_reply_size>,
+                    batch_size>>();
+            UDP::SendBatch<batch_size> tx;
+            auto next_publish =
+                std::chrono::steady_clock::now() + talkers_interval;
+
+            auto process = [&](std::span<const std::byte> payload,
+                               const UDP::Endpoint &peer) {
+                auto &buffer = (*tx_buffers)[tx.size()];
+                UDP::Endpoint reply_to;
+                auto reply_size =
+                    engine.handle(payload, peer, buffer, reply_to);
+                if (reply_size) {
+                    tx.push(
+                        std::span<const std::byte>(
+                            buffer.data(), reply_size.value()),
+                        reply_to);
+                }
+            };
+
+            while (!st.stop_requested()) {
+                engine.expire();
+
+                /*
+                 * With admission queues, empty the socket into them (up to
+                 * their size) so the kernel never drops blindly, then serve
+                 * one batch by priority
+                 */
+                size_t nb_pulled = 0;
+                bool wait = !admission || admission->empty();
+                std::optional<size_t> nb_received;
+                int receive_error = 0;
+                while (true) {
+                    nb_received = socket.recv_batch(*rx, wait);
+                    if (!nb_received) {
+                        receive_error = errno;
+                        break;
+                    }
+
+                    if (talkers) {
+                        observe_talkers(*rx, next_publish);
+                    }
+                    if (!admission) {
+                        for (size_t idx = 0; idx < rx->size(); idx++) {
+                            process(rx->payload(idx), rx->peer(idx));
+                        }
+                        break;
+                    }
+
+                    for (size_t idx = 0; idx < rx->size(); idx++) {
+                        admission->push(rx->payload(idx), rx->peer(idx));
+                    }
+                    nb_pulled += rx->size();
+                    wait = false;
+                    if (rx->size() < batch_size || nb_pulled >= pull_limit) {
+                        break;
+                    }
+                }
+                // Transient errors (ENOBUFS, ENOMEM...) must not end the shard
+                if (!nb_received) {
+                    engine.stats().receive_errors.fetch_add(
+                        1, std::memory_order_relaxed);
+                    if (is_fatal(receive_error)) {
+                        failed.store(true, std::memory_order_release);
+                        break;
+                    }
+                }
+
+                if (admission) {
+                    admission->drain(
+                        batch_size,
+                        [&](std::span<const std::byte> payload,
+                            const UDP::Endpoint &peer,
+                            AdmissionClass) { process(payload, peer); });
+                }
+
+                if (!engine.commit()) {
+                    tx.clear();
+                }
+
+                if (tx.size() != 0) {
+                    size_t size = tx.size();
+                    size_t nb_sent = socket.send_batch(tx);
+                    engine.stats().sent.fetch_add(
+                        nb_sent, std::memory_order_relaxed);
+                    engine.stats().send_errors.fetch_add(
+                        size - nb_sent, std::memory_order_relaxed);
+                }
+            }
+
+            if (talkers) {
+                talkers_total->publish(*talkers);
+            }
+        }
+
+        // The socket itself is unusable, retrying would only spin
+        static bool is_fatal(int error)
+        {
+            return error == EBADF || error == ENOTSOCK || error == EFAULT ||
+                   error == EINVAL;
+        }
+
+        void observe_talkers(
+            const UDP::RecvBatch<batch_size> &rx,
+            std::chrono::steady_clock::time_point &next_publish)
+        {
+            for (size_t idx = 0; idx < rx.size(); idx++) {
+                talkers->observe_source(rx.peer(idx).address);
+                talkers->observe(HeaderView(rx.payload(idx)));
+            }
+            publish_talkers(next_publish);
+        }
+
+        void publish_talkers(std::chrono::steady_clock::time_point &next)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next) {
+                talkers_total->publish(*talkers);
+                next = now + talkers_interval;
+            }
+        }
+    };
+
+    ServerConfig m_config;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::optional<SharedRegion> m_shared;
+    std::optional<TopTalkersTotal> m_talkers;
+    std::jthread m_handover;
+    std::atomic<bool> m_handed_over{false};
+
+    LeaseStoreOptions store_options(uint32_t shard) const
+    {
+        LeaseStoreOptions options;
+        options.path = m_config.lease_store_path + "." + std::to_string(shard);
+        options.nb_records =
+            LeaseTable::capacity_of(m_config, shard, m_config.nb_workers);
+        return options;
+    }
+
+    bool open_sockets(std::vector<UDP::Socket> &sockets)
+    {
+        UDP::SocketOptions options;
+        options.bind_to = m_config.bind_to;
+        options.reuse_port = true;
+        options.broadcast = true;
+        options.receive_buffer = m_config.socket_buffer;
+        options.send_buffer = m_config.socket_buffer;
+        options.receive_timeout = std::chrono::milliseconds(10);
+
+        for (size_t shard = 0; shard < m_config.nb_workers; shard++) {
+            auto socket = UDP::Socket::open(options);
+            if (!socket) {
+                return false;
+            }
+
+            if (shard == 0 && options.bind_to.port == 0) {
+                // Ephemeral port, the rest of the group joins the same one
+                options.bind_to.port = socket->local_endpoint()->port;
+                m_config.bind_to.port = options.bind_to.port;
+            }
+            sockets.push_back(std::move(socket.value()));
+        }
+        return true;
+    }
+
+    // Sets `attach` when the region holds the tables of a predecessor
+    bool map_shared_state(bool &attach)
+    {
+        auto layout = SharedStateLayout::of(m_config);
+        bool created = false;
+        auto region = SharedRegion::open(
+            m_config.shared_state_name, layout.size, created);
+        if (!region) {
+            return false;
+        }
+
+        auto &header = region->object_at<SharedStateHeader>(0);
+        uint64_t fingerprint = SharedStateLayout::fingerprint(m_config);
+        if (created) {
+            new (&header) SharedStateHeader{};
+        } else if (header.magic != SharedStateHeader::magic_value ||
+                   header.fingerprint != fingerprint ||
+                   header.size != layout.size) {
+            return false;
+        }
+
+        // A predecessor that died while initializing left nothing usable
+        attach = !created && header.ready.load(std::memory_order_acquire) != 0;
+        if (!attach) {
+            header.magic = SharedStateHeader::magic_value;
+            header.fingerprint = fingerprint;
+            header.size = layout.size;
+        }
+
+        m_shared.emplace(std::move(region.value()));
+        return true;
+    }
+
+    void serve_handover(std::stop_token st, HotRestart::Listener &listener)
+    {
+        while (!st.stop_requested()) {
+            auto successor = listener.accept(std::chrono::milliseconds(100));
+            if (!successor) {
+                continue;
+            }
+
+            std::vector<int> fds;
+            for (auto &worker : m_workers) {
+                worker->thread.request_stop();
+                worker->thread.join();
+                worker->engine.quiesce();
+                fds.push_back(worker->socket.fd());
+            }
+
+            if (!HotRestart::Listener::hand_over(successor.value(), fds)) {
+                start_workers();
+                continue;
+            }
+            m_handed_over.store(true, std::memory_order_release);
+            return;
+        }
+    }
+
+    void start_workers()
+    {
+        for (auto &worker : m_workers) {
+            worker->thread = std::jthread(
+                [w = worker.get()](std::stop_token st) { w->run(st); });
+        }
+    }
+};
+
+} // namespace xnet::DHCP
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <time.h>
+
+#include <xnet/Histogram.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/IPv4TOS.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet {
+
+struct EgressClassConfig
+{
+    // Bytes credited per round robin visit
+    uint32_t quantum = 1500;
+    // Packets queued before tail drop
+    uint32_t capacity = 1024;
+    // Served ahead of every round robin class, in class order
+    bool strict = false;
+};
+
+struct EgressConfig
+{
+    static constexpr size_t max_classes = 8;
+
+    // Network control and voice, interactive, best effort, bulk
+    std::vector<EgressClassConfig> classes{
+        {1500, 256, true},
+        {3000, 1024, false},
+        {1500, 1024, false},
+        {500, 1024, false},
+    };
+
+    // CS5-CS7 and EF, CS3/CS4 and their AFs, CS1 and LE as bulk
+    std::array<uint8_t, 64> class_of_dscp = []() {
+        std::array<uint8_t, 64> output{};
+        for (uint8_t dscp = 0; dscp < output.size(); dscp++) {
+            uint8_t precedence = dscp >> 3;
+            if (precedence >= 5) {
+                output[dscp] = 0;
+            } else if (precedence >= 3) {
+                output[dscp] = 1;
+            } else if (dscp == 8 || dscp == 1) {
+                output[dscp] = 3;
+            } else {
+                output[dscp] = 2;
+            }
+        }
+        return output;
+    }();
+
+    /*
+     * The RFC 1349 low delay bit overrides the DSCP. AF12, AF22, AF32 and
+     * AF42 carry the same bit, disable this where DSCP is used end to end.
+     */
+    bool low_delay_override = true;
+    uint8_t low_delay_class = 0;
+};
+
+// Caller owned datagram, `user_data` tells it which buffer came back
+struct EgressPacket
+{
+    std::span<const std::byte> data;
+    UDP::Endpoint peer;
+    uint64_t user_data = 0;
+};
+
+struct EgressClassStats
+{
+    uint64_t enqueued = 0;
+    uint64_t dequeued = 0;
+    uint64_t dropped = 0;
+    uint64_t bytes = 0;
+    // Occupancy right now
+    size_t queued = 0;
+    size_t queued_bytes = 0;
+    // Enqueue to dequeue, nanoseconds
+    LatencyHistogram latency;
+};
+
+/*
+ * Per class egress queues in front of a TX batch. Strict classes drain
+ * first, the others share what is left by deficit round robin (Shreedhar &
+ * Varghese), so each gets bandwidth in proportion to its quantum whatever
+ * its packet sizes. A round robin visit cut short by a full batch resumes on
+ * the next dequeue without a new quantum.
+ *
+ * Packets are only referenced, their buffers belong to the caller until
+ * dequeued. Single threaded.
+ */
+struct EgressScheduler
+{
+    static std::optional<EgressScheduler> create(const EgressConfig &config)
+    {
+        size_t nb_classes = config.classes.size();
+        if (nb_classes == 0 || nb_classes > EgressConfig::max_classes ||
+            config.low_delay_class >= nb_classes) {
+            return std::nullopt;
+        }
+        for (uint8_t cls : config.class_of_dscp) {
+            if (cls >= nb_classes) {
+                return std::nullopt;
+            }
+        }
+        for (const EgressClassConfig &c : config.classes) {
+            if (c.capacity == 0 || (!c.strict && c.quantum == 0)) {
+                return std::nullopt;
+            }
+        }
+        return EgressScheduler(config);
+    }
+
+    size_t nb_classes() const
+    {
+        return m_classes.size();
+    }
+
+    const EgressClassStats &stats(size_t cls) const
+    {
+        return m_classes[cls].stats;
+    }
+
+    size_t queued() const
+    {
+        return m_queued;
+    }
+
+    uint8_t classify(IPv4::TypeOfService tos) const
+    {
+        if (m_config.low_delay_override && tos.low_delay()) {
+            return m_config.low_delay_class;
+        }
+        return m_config.class_of_dscp[tos.dscp()];
+    }
+
+    // Classified by the TOS byte of the IPv4 header `packet.data` starts with
+    bool enqueue(const EgressPacket &packet)
+    {
+        if (packet.data.size() < IPv4::minimal_header_size) {
+            return false;
+        }
+        return enqueue(packet, std::to_integer<uint8_t>(packet.data[1]));
+    }
+
+    // For payloads sent with the TOS set on the socket
+    bool enqueue(const EgressPacket &packet, IPv4::TypeOfService tos)
+    {
+        Class &c = m_classes[classify(tos)];
+        if (c.tail - c.head == c.config.capacity) {
+            c.stats.dropped++;
+            return false;
+        }
+
+        c.ring[c.tail++ & c.mask] = Entry{packet, monotonic_ns()};
+        c.stats.enqueued++;
+        c.stats.queued++;
+        c.stats.queued_bytes += packet.data.size();
+        m_queued++;
+
+        if (!c.config.strict && !c.active) {
+            c.active = true;
+            m_active[(m_active_head + m_nb_active++) % m_active.size()] =
+                &c - m_classes.data();
+        }
+        return true;
+    }
+
+    // Fills `output` in scheduling order, returns the number of packets
+    size_t dequeue(std::span<EgressPacket> output)
+    {
+        if (m_queued == 0) {
+            return 0;
+        }
+        uint64_t now = monotonic_ns();
+        size_t nb_out = 0;
+
+        for (Class &c : m_classes) {
+            if (!c.config.strict) {
+                continue;
+            }
+            while (nb_out != output.size() && c.head != c.tail) {
+                output[nb_out++] = pop(c, now);
+            }
+        }
+
+        while (nb_out != output.size() && m_nb_active != 0) {
+            Class &c = m_classes[m_active[m_active_head]];
+            if (!c.visited) {
+                c.deficit += c.config.quantum;
+                c.visited = true;
+            }
+
+            while (nb_out != output.size() && c.head != c.tail) {
+                size_t size = c.ring[c.head & c.mask].packet.data.size();
+                if (size > c.deficit) {
+                    break;
+                }
+                c.deficit -= size;
+                output[nb_out++] = pop(c, now);
+            }
+
+            if (c.head == c.tail) {
+                c.deficit = 0;
+                c.visited = false;
+                c.active = false;
+                m_active_head = (m_active_head + 1) % m_active.size();
+                m_nb_active--;
+            } else if (nb_out != output.size()) {
+                // Out of credit, next class
+                c.visited = false;
+                uint8_t cls = m_active[m_active_head];
+                m_active_head = (m_active_head + 1) % m_active.size();
+                m_active[(m_active_head + m_nb_active - 1) % m_active.size()] =
+                    cls;
+            }
+        }
+        return nb_out;
+    }
+
+    /*
+     * Dequeues as many packets as `batch` has room for and pushes them,
+     * `sent` receives their descriptors to reclaim the buffers once sent
+     */
+    template <size_t capacity>
+    size_t
+        dequeue(UDP::SendBatch<capacity> &batch, std::span<EgressPacket> sent)
+    {
+        size_t room = std::min(capacity - batch.size(), sent.size());
+        size_t nb_out = dequeue(sent.first(room));
+        for (size_t idx = 0; idx < nb_out; idx++) {
+            batch.push(sent[idx].data, sent[idx].peer);
+        }
+        return nb_out;
+    }
+
+  private:
+    struct Entry
+    {
+        EgressPacket packet;
+        uint64_t enqueued;
+    };
+
+    struct Class
+    {
+        EgressClassConfig config;
+        std::vector<Entry> ring;
+        size_t mask = 0;
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        uint64_t deficit = 0;
+        bool visited = false;
+        bool active = false;
+        EgressClassStats stats;
+    };
+
+    EgressConfig m_config;
+    std::vector<Class> m_classes;
+    // Round robin order of the backlogged non strict classes
+    std::array<uint8_t, EgressConfig::max_classes> m_active{};
+    size_t m_active_head = 0;
+    size_t m_nb_active = 0;
+    size_t m_queued = 0;
+
+    EgressScheduler(const EgressConfig &config)
+        : m_config(config), m_classes(config.classes.size())
+    {
+        for (size_t cls = 0; cls < m_classes.size(); cls++) {
+            Class &c = m_classes[cls];
+            c.config = config.classes[cls];
+            c.ring.resize(std::bit_ceil<size_t>(c.config.capacity));
+            c.mask = c.ring.size() - 1;
+        }
+    }
+
+    static uint64_t monotonic_ns()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+    }
+
+    EgressPacket pop(Class &c, uint64_t now)
+    {
+        const Entry &e = c.ring[c.head++ & c.mask];
+        size_t size = e.packet.data.size();
+        c.stats.dequeued++;
+        c.stats.bytes += size;
+        c.stats.queued--;
+        c.stats.queued_bytes -= size;
+        c.stats.latency.record(now - std::min(now, e.enqueued));
+        m_queued--;
+        return e.packet;
+    }
+};
+
+} // namespace xnet
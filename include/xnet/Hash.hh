@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/ByteOrder.hh>
+
+namespace xnet {
+
+// Finalizer of splitmix64, good enough to spread table indices
+constexpr uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111eb;
+    x ^= x >> 31;
+    return x;
+}
+
+constexpr uint64_t
+    hash_bytes(std::span<const std::byte> data, uint64_t seed = 0)
+{
+    uint64_t output = mix64(seed ^ data.size());
+
+    size_t offset = 0;
+    for (; offset + sizeof(uint64_t) <= data.size();
+         offset += sizeof(uint64_t)) {
+        std::array<std::byte, sizeof(uint64_t)> word{};
+        for (size_t idx = 0; idx < word.size(); idx++) {
+            word[idx] = data[offset + idx];
+        }
+        output = mix64(output ^ letoh<uint64_t>(word));
+    }
+
+    if (offset != data.size()) {
+        std::array<std::byte, sizeof(uint64_t)> word{};
+        for (size_t idx = 0; offset + idx < data.size(); idx++) {
+            word[idx] = data[offset + idx];
+        }
+        output = mix64(output ^ letoh<uint64_t>(word));
+    }
+
+    return output;
+}
+
+namespace CRC32CDetail {
+constexpr std::array<uint32_t, 256> table = []() {
+    std::array<uint32_t, 256> output{};
+    for (uint32_t idx = 0; idx < output.size(); idx++) {
+        uint32_t crc = idx;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) != 0 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+        }
+        output[idx] = crc;
+    }
+    return output;
+}();
+} // namespace CRC32CDetail
+
+// CRC-32C (Castagnoli), the checksum of iSCSI/ext4 journals
+constexpr uint32_t crc32c(std::span<const std::byte> data, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (std::byte b : data) {
+        crc = CRC32CDetail::table[(crc ^ std::to_integer<uint8_t>(b)) & 0xff] ^
+              (crc >> 8);
+    }
+    return ~crc;
+}
+
+} // namespace xnet
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <limits>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xnet {
+
+/*
+ * Log-linear histogram of nanosecond latencies, HdrHistogram style: every
+ * power of two range is split into `sub_buckets` linear buckets, so values
+ * are kept with a relative error below 1/sub_buckets. Fixed size, records
+ * never allocate. Not thread safe, keep one per thread and merge().
+ */
+struct LatencyHistogram
+{
+    static constexpr size_t sub_bucket_bits = 5;
+    static constexpr size_t sub_buckets = size_t(1) << sub_bucket_bits;
+    static constexpr size_t ranges = 64 - sub_bucket_bits;
+    static constexpr size_t nb_buckets = (ranges + 1) * sub_buckets;
+
+    void record(uint64_t value)
+    {
+        m_buckets[bucket_of(value)]++;
+        m_count++;
+        m_sum += value;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (size_t idx = 0; idx < nb_buckets; idx++) {
+            m_buckets[idx] += other.m_buckets[idx];
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    void clear()
+    {
+        *this = LatencyHistogram();
+    }
+
+    uint64_t count() const
+    {
+        return m_count;
+    }
+
+    uint64_t min() const
+    {
+        return m_count == 0 ? 0 : m_min;
+    }
+
+    uint64_t max() const
+    {
+        return m_max;
+    }
+
+    uint64_t mean() const
+    {
+        return m_count == 0 ? 0 : m_sum / m_count;
+    }
+
+    // Upper bound of the bucket holding the `quantile` (0..1) value
+    uint64_t percentile(double quantile) const
+    {
+        if (m_count == 0) {
+            return 0;
+        }
+
+        quantile = std::clamp(quantile, 0.0, 1.0);
+        uint64_t rank = std::max<uint64_t>(1, quantile * m_count + 0.5);
+        uint64_t seen = 0;
+        for (size_t idx = 0; idx < nb_buckets; idx++) {
+            seen += m_buckets[idx];
+            if (seen >= rank) {
+                return std::min(upper_bound_of(idx), m_max);
+            }
+        }
+        return m_max;
+    }
+
+    static constexpr size_t bucket_of(uint64_t value)
+    {
+        if (value < sub_buckets) {
+            return value;
+        }
+        size_t range = std::bit_width(value) - sub_bucket_bits;
+        size_t sub = (value >> (range - 1)) - sub_buckets;
+        return range * sub_buckets + sub;
+    }
+
+    static constexpr uint64_t upper_bound_of(size_t bucket)
+    {
+        size_t range = bucket / sub_buckets;
+        uint64_t sub = bucket % sub_buckets;
+        if (range == 0) {
+            return sub;
+        }
+        uint64_t base = (sub_buckets + sub) << (range - 1);
+        return base + (uint64_t(1) << (range - 1)) - 1;
+    }
+
+  private:
+    std::array<uint64_t, nb_buckets> m_buckets{};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = std::numeric_limits<uint64_t>::max();
+    uint64_t m_max = 0;
+};
+
+} // namespace xnet
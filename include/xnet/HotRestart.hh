@@ -0,0 +1,299 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Process to process socket handover over a Unix stream socket. The
+ * successor connects and asks, the running process stops touching its
+ * sockets and passes them with SCM_RIGHTS. Both hold the sockets until the
+ * successor commits, a successor that fails to start first leaves them to
+ * the running process, which resumes.
+ */
+namespace xnet::HotRestart {
+
+static constexpr size_t max_fds = 253; // SCM_MAX_FD
+
+static constexpr std::byte handover_request{'H'};
+static constexpr std::byte handover_reply{'R'};
+static constexpr std::byte handover_commit{'C'};
+static constexpr std::byte handover_ack{'A'};
+
+// How long the running process waits for a commit before it resumes
+static constexpr std::chrono::milliseconds commit_timeout{5000};
+
+inline std::optional<sockaddr_un> unix_address(const std::string &path)
+{
+    sockaddr_un output{};
+    output.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(output.sun_path)) {
+        return std::nullopt;
+    }
+    std::memcpy(output.sun_path, path.data(), path.size());
+    return output;
+}
+
+inline bool send_fds(int socket, std::span<const int> fds, std::byte payload)
+{
+    if (fds.size() > max_fds) {
+        return false;
+    }
+
+    std::vector<std::byte> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    iovec iov{&payload, sizeof(payload)};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (!fds.empty()) {
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    }
+
+    while (true) {
+        if (::sendmsg(socket, &msg, MSG_NOSIGNAL) == sizeof(payload)) {
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+// Received descriptors are owned by the caller, close-on-exec set
+inline std::optional<std::vector<int>>
+    receive_fds(int socket, std::byte &payload)
+{
+    std::vector<std::byte> control(CMSG_SPACE(sizeof(int) * max_fds));
+    iovec iov{&payload, sizeof(payload)};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    ssize_t received = 0;
+    do {
+        received = ::recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+
+    if (received != sizeof(payload)) {
+        return std::nullopt;
+    }
+
+    std::vector<int> output;
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t nb_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        size_t first = output.size();
+        output.resize(first + nb_fds);
+        std::memcpy(
+            output.data() + first, CMSG_DATA(cmsg), nb_fds * sizeof(int));
+    }
+
+    if ((msg.msg_flags & MSG_CTRUNC) != 0) {
+        for (int fd : output) {
+            ::close(fd);
+        }
+        return std::nullopt;
+    }
+
+    return output;
+}
+
+/*
+ * Successor side of a handover in progress. `fds` belong to the caller, the
+ * predecessor only lets go of its copies on commit().
+ */
+struct Handover
+{
+    std::vector<int> fds;
+
+    Handover(std::vector<int> received, int connection)
+        : fds(std::move(received)), m_fd(connection)
+    {
+    }
+
+    Handover(Handover &&other)
+        : fds(std::move(other.fds)), m_fd(std::exchange(other.m_fd, -1))
+    {
+    }
+
+    Handover &operator=(Handover &&) = delete;
+
+    // Dropped uncommitted, the predecessor resumes serving
+    ~Handover()
+    {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    // True once the predecessor acknowledged it stays stopped
+    bool commit()
+    {
+        std::byte payload{};
+        bool committed = send_fds(m_fd, {}, handover_commit) &&
+                         receive_fds(m_fd, payload).has_value() &&
+                         payload == handover_ack;
+        ::close(std::exchange(m_fd, -1));
+        return committed;
+    }
+
+  private:
+    int m_fd = -1;
+};
+
+/*
+ * Successor side: asks the process listening on `path` for its sockets.
+ * Nothing listening there means a cold start.
+ */
+inline std::optional<Handover> request_handover(const std::string &path)
+{
+    auto addr = unix_address(path);
+    if (!addr) {
+        return std::nullopt;
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    if (::connect(fd, (const sockaddr *)&addr.value(), sizeof(sockaddr_un)) !=
+            0 ||
+        !send_fds(fd, {}, handover_request)) {
+        ::close(fd);
+        return std::nullopt;
+    }
+
+    std::byte payload{};
+    auto output = receive_fds(fd, payload);
+    if (!output || payload != handover_reply) {
+        for (int received : output.value_or(std::vector<int>())) {
+            ::close(received);
+        }
+        ::close(fd);
+        return std::nullopt;
+    }
+    return Handover(std::move(output.value()), fd);
+}
+
+// Running process side, waits for a successor on `path`
+struct Listener
+{
+    static std::optional<Listener> listen(const std::string &path)
+    {
+        auto addr = unix_address(path);
+        if (!addr) {
+            return std::nullopt;
+        }
+
+        Listener output(
+            ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0),
+            path);
+        if (output.m_fd < 0) {
+            return std::nullopt;
+        }
+
+        // A predecessor that handed over has no use for the path anymore
+        ::unlink(path.c_str());
+        if (::bind(
+                output.m_fd,
+                (const sockaddr *)&addr.value(),
+                sizeof(sockaddr_un)) != 0 ||
+            ::listen(output.m_fd, 1) != 0) {
+            return std::nullopt;
+        }
+
+        return output;
+    }
+
+    Listener(Listener &&other)
+        : m_fd(std::exchange(other.m_fd, -1)), m_path(std::move(other.m_path))
+    {
+    }
+
+    Listener &operator=(Listener &&) = delete;
+
+    ~Listener()
+    {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    // Connected successor that asked for a handover, if one came in time
+    std::optional<int> accept(std::chrono::milliseconds timeout)
+    {
+        pollfd pfd{m_fd, POLLIN, 0};
+        if (::poll(&pfd, 1, timeout.count()) <= 0) {
+            return std::nullopt;
+        }
+
+        int fd = ::accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+
+        std::byte payload{};
+        auto fds = receive_fds(fd, payload);
+        if (!fds || payload != handover_request) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        return fd;
+    }
+
+    /*
+     * Passes `fds` and waits for the successor to commit. False means it
+     * did not, the sockets are still this process's to serve.
+     */
+    static bool hand_over(int successor, std::span<const int> fds)
+    {
+        std::byte payload{};
+        pollfd pfd{successor, POLLIN, 0};
+        bool committed = send_fds(successor, fds, handover_reply) &&
+                         ::poll(&pfd, 1, commit_timeout.count()) > 0 &&
+                         receive_fds(successor, payload).has_value() &&
+                         payload == handover_commit &&
+                         send_fds(successor, {}, handover_ack);
+        ::close(successor);
+        return committed;
+    }
+
+  private:
+    int m_fd = -1;
+    std::string m_path;
+
+    Listener(int fd, std::string path) : m_fd(fd), m_path(std::move(path))
+    {
+    }
+};
+
+} // namespace xnet::HotRestart
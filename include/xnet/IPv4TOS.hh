@@ -1,3 +1,5 @@
+#pragma once
+
 #include <cstdint>
 
 namespace xnet {
@@ -28,6 +30,17 @@ struct TypeOfService
         return (m_val >> 5) & 0b00000111;
     }
 
+    // Same byte read as Differentiated Services (RFC 2474) and ECN (RFC 3168)
+    constexpr uint8_t dscp() const
+    {
+        return m_val >> 2;
+    }
+
+    constexpr uint8_t ecn() const
+    {
+        return m_val & 0b00000011;
+    }
+
     bool low_delay() const
     {
         return (m_val & 0b00010000) != 0;
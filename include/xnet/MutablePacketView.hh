@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <netinet/in.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/Checksum.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/UDP.hh>
+
+/*
+ * Writable counterparts of the PacketView types for rewrite paths (NAT,
+ * relaying, remarking). Setters store the big-endian field in place and
+ * fold the change into the checksums covering it (RFC 1624), so a rewrite
+ * costs a few stores instead of parse, serialize and a full checksum.
+ */
+
+namespace xnet::UDP {
+
+struct MutablePacketView
+{
+    // `data` must hold at least the header and the length it announces
+    static std::optional<MutablePacketView> create(std::span<std::byte> data)
+    {
+        auto header = PacketView(data).parse_header();
+        if (!header || header->length > data.size()) {
+            return std::nullopt;
+        }
+        return MutablePacketView(data.first(header->length));
+    }
+
+    std::span<std::byte> data() const
+    {
+        return m_data;
+    }
+
+    std::span<std::byte> payload() const
+    {
+        return m_data.subspan(header_size);
+    }
+
+    uint16_t source_port() const
+    {
+        return load_be<uint16_t>(m_data, 0);
+    }
+
+    uint16_t destination_port() const
+    {
+        return load_be<uint16_t>(m_data, 2);
+    }
+
+    uint16_t checksum() const
+    {
+        return load_be<uint16_t>(m_data, 6);
+    }
+
+    void set_source_port(uint16_t port)
+    {
+        set_u16(0, port);
+    }
+
+    void set_destination_port(uint16_t port)
+    {
+        set_u16(2, port);
+    }
+
+    void set_ports(uint16_t source, uint16_t destination)
+    {
+        set_u16(0, source);
+        set_u16(2, destination);
+    }
+
+    // Folds a change of covered data, e.g. a pseudo header address
+    void adjust_checksum(uint16_t old_sum, uint16_t new_sum)
+    {
+        uint16_t checksum = load_be<uint16_t>(m_data, 6);
+        if (checksum == 0) {
+            return;
+        }
+        checksum = Checksum::update(checksum, old_sum, new_sum);
+        store_be<uint16_t>(m_data, 6, Checksum::udp_nonzero(checksum));
+    }
+
+  private:
+    std::span<std::byte> m_data;
+
+    MutablePacketView(std::span<std::byte> data) : m_data(data)
+    {
+    }
+
+    void set_u16(size_t offset, uint16_t value)
+    {
+        uint16_t old_value = load_be<uint16_t>(m_data, offset);
+        store_be<uint16_t>(m_data, offset, value);
+        adjust_checksum(old_value, value);
+    }
+};
+
+} // namespace xnet::UDP
+
+namespace xnet::IPv4 {
+
+struct MutablePacketView
+{
+    // Validated like PacketView::is_valid(), trimmed to the total size
+    static std::optional<MutablePacketView> create(std::span<std::byte> data)
+    {
+        PacketView packet(data);
+        if (packet.is_not_valid()) {
+            return std::nullopt;
+        }
+        size_t header_size = packet.header_view().header_size().value();
+        size_t payload_size = packet.payload_data()->size();
+        return MutablePacketView(
+            data.first(header_size + payload_size), header_size);
+    }
+
+    std::span<std::byte> data() const
+    {
+        return m_data;
+    }
+
+    HeaderView header_view() const
+    {
+        return HeaderView(m_data);
+    }
+
+    std::span<std::byte> payload() const
+    {
+        return m_data.subspan(m_header_size);
+    }
+
+    /*
+     * The UDP datagram when this is UDP and the first fragment, the one
+     * carrying the UDP header
+     */
+    std::optional<UDP::MutablePacketView> udp() const
+    {
+        uint8_t protocol = std::to_integer<uint8_t>(m_data[9]);
+        uint16_t fragment_offset = load_be<uint16_t>(m_data, 6) & 0x1fff;
+        if (protocol != IPPROTO_UDP || fragment_offset != 0) {
+            return std::nullopt;
+        }
+        return UDP::MutablePacketView::create(payload());
+    }
+
+    uint8_t tos() const
+    {
+        return std::to_integer<uint8_t>(m_data[1]);
+    }
+
+    uint8_t ttl() const
+    {
+        return std::to_integer<uint8_t>(m_data[8]);
+    }
+
+    Address source_address() const
+    {
+        return read_address(12);
+    }
+
+    Address destination_address() const
+    {
+        return read_address(16);
+    }
+
+    void set_tos(uint8_t tos)
+    {
+        set_u8(1, tos);
+    }
+
+    void set_ttl(uint8_t ttl)
+    {
+        set_u8(8, ttl);
+    }
+
+    // False when the TTL is already zero and the packet must be dropped
+    bool decrement_ttl()
+    {
+        uint8_t old_ttl = ttl();
+        if (old_ttl == 0) {
+            return false;
+        }
+        set_ttl(old_ttl - 1);
+        return true;
+    }
+
+    // Addresses are in the UDP pseudo header, its checksum follows them
+    void set_source_address(Address address)
+    {
+        set_address(12, address);
+    }
+
+    void set_destination_address(Address address)
+    {
+        set_address(16, address);
+    }
+
+  private:
+    std::span<std::byte> m_data;
+    size_t m_header_size;
+
+    MutablePacketView(std::span<std::byte> data, size_t header_size)
+        : m_data(data), m_header_size(header_size)
+    {
+    }
+
+    Address read_address(size_t offset) const
+    {
+        std::array<std::byte, 4> output;
+        std::ranges::copy(m_data.subspan(offset, 4), output.begin());
+        return Address(output);
+    }
+
+    void adjust_checksum(uint16_t old_sum, uint16_t new_sum)
+    {
+        uint16_t checksum = load_be<uint16_t>(m_data, 10);
+        checksum = Checksum::update(checksum, old_sum, new_sum);
+        store_be<uint16_t>(m_data, 10, checksum);
+    }
+
+    // Single bytes are summed as the 16-bit word they share
+    void set_u8(size_t offset, uint8_t value)
+    {
+        size_t word = offset & ~size_t(1);
+        uint16_t old_value = load_be<uint16_t>(m_data, word);
+        m_data[offset] = std::byte(value);
+        adjust_checksum(old_value, load_be<uint16_t>(m_data, word));
+    }
+
+    void set_address(size_t offset, Address address)
+    {
+        auto bytes = address.data_msbf();
+        uint16_t old_sum = Checksum::partial(m_data.subspan(offset, 4));
+        uint16_t new_sum = Checksum::partial(bytes);
+        std::ranges::copy(bytes, m_data.begin() + offset);
+        adjust_checksum(old_sum, new_sum);
+
+        if (auto datagram = udp()) {
+            datagram->adjust_checksum(old_sum, new_sum);
+        }
+    }
+};
+
+} // namespace xnet::IPv4
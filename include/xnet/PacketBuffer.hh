@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <netinet/in.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/Checksum.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/UDP.hh>
+
+namespace xnet {
+
+/*
+ * Owned packet storage with room reserved on both sides of the data, so
+ * protocol layers grow the packet in place: the payload is written first
+ * and each lower layer prepends its header into the headroom.
+ *
+ *     PacketBuffer packet;
+ *     auto dhcp = packet.append(DHCP::header_size).value();
+ *     ...
+ *     UDP::encapsulate(packet, source, 67, destination, 68);
+ *     IPv4::encapsulate(packet, ip);
+ *
+ * Views (IPv4::PacketView, UDP::PacketView, DHCP::PacketView) are built over
+ * data() directly and stay valid until the buffer is modified.
+ */
+struct PacketBuffer
+{
+    // Room for Ethernet, outer IPv4, UDP and a tunnel header
+    static constexpr size_t default_headroom = 128;
+    static constexpr size_t default_capacity = 2048;
+
+    explicit PacketBuffer(
+        size_t capacity = default_capacity,
+        size_t headroom = default_headroom)
+        : m_storage(std::make_unique_for_overwrite<std::byte[]>(capacity)),
+          m_capacity(capacity), m_begin(std::min(headroom, capacity)),
+          m_end(m_begin)
+    {
+    }
+
+    // The one copy: `data` lands between `headroom` and `tailroom` bytes
+    static PacketBuffer copy_of(
+        std::span<const std::byte> data,
+        size_t headroom = default_headroom,
+        size_t tailroom = 0)
+    {
+        PacketBuffer output(headroom + data.size() + tailroom, headroom);
+        std::ranges::copy(data, output.m_storage.get() + output.m_begin);
+        output.m_end += data.size();
+        return output;
+    }
+
+    PacketBuffer(PacketBuffer &&other)
+        : m_storage(std::move(other.m_storage)),
+          m_capacity(std::exchange(other.m_capacity, 0)),
+          m_begin(std::exchange(other.m_begin, 0)),
+          m_end(std::exchange(other.m_end, 0))
+    {
+    }
+
+    PacketBuffer &operator=(PacketBuffer &&other)
+    {
+        if (this != &other) {
+            m_storage = std::move(other.m_storage);
+            m_capacity = std::exchange(other.m_capacity, 0);
+            m_begin = std::exchange(other.m_begin, 0);
+            m_end = std::exchange(other.m_end, 0);
+        }
+        return *this;
+    }
+
+    size_t size() const
+    {
+        return m_end - m_begin;
+    }
+
+    bool empty() const
+    {
+        return m_end == m_begin;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    size_t headroom() const
+    {
+        return m_begin;
+    }
+
+    size_t tailroom() const
+    {
+        return m_capacity - m_end;
+    }
+
+    std::span<std::byte> data()
+    {
+        return std::span<std::byte>(m_storage.get() + m_begin, size());
+    }
+
+    std::span<const std::byte> data() const
+    {
+        return std::span<const std::byte>(m_storage.get() + m_begin, size());
+    }
+
+    template <typename View>
+    View view() const
+    {
+        return View(data());
+    }
+
+    // Grows the front by `n` bytes, returns them for the caller to fill
+    std::optional<std::span<std::byte>> prepend(size_t n)
+    {
+        if (n > headroom()) {
+            return std::nullopt;
+        }
+        m_begin -= n;
+        return std::span<std::byte>(m_storage.get() + m_begin, n);
+    }
+
+    // Grows the back by `n` bytes, returns them for the caller to fill
+    std::optional<std::span<std::byte>> append(size_t n)
+    {
+        if (n > tailroom()) {
+            return std::nullopt;
+        }
+        m_end += n;
+        return std::span<std::byte>(m_storage.get() + m_end - n, n);
+    }
+
+    bool append(std::span<const std::byte> data)
+    {
+        auto room = append(data.size());
+        if (!room) {
+            return false;
+        }
+        std::ranges::copy(data, room->begin());
+        return true;
+    }
+
+    // Drops `n` bytes from the front, e.g. a header after decapsulation
+    bool trim_front(size_t n)
+    {
+        if (n > size()) {
+            return false;
+        }
+        m_begin += n;
+        return true;
+    }
+
+    // Drops `n` bytes from the back, e.g. what append() reserved but unused
+    bool trim_back(size_t n)
+    {
+        if (n > size()) {
+            return false;
+        }
+        m_end -= n;
+        return true;
+    }
+
+    // Empties the buffer and sets the headroom again for reuse
+    void reset(size_t headroom = default_headroom)
+    {
+        m_begin = std::min(headroom, m_capacity);
+        m_end = m_begin;
+    }
+
+  private:
+    std::unique_ptr<std::byte[]> m_storage;
+    size_t m_capacity;
+    size_t m_begin;
+    size_t m_end;
+};
+
+namespace UDP {
+
+/*
+ * Prepends a UDP header over the buffer contents, checksummed with the IPv4
+ * pseudo header of `source` and `destination`
+ */
+inline bool encapsulate(
+    PacketBuffer &packet,
+    IPv4::Address source,
+    uint16_t source_port,
+    IPv4::Address destination,
+    uint16_t destination_port)
+{
+    if (packet.size() > std::numeric_limits<uint16_t>::max() - header_size) {
+        return false;
+    }
+    uint16_t length = packet.size() + header_size;
+
+    auto header = packet.prepend(header_size);
+    if (!header) {
+        return false;
+    }
+    store_be<uint16_t>(*header, 0, source_port);
+    store_be<uint16_t>(*header, 2, destination_port);
+    store_be<uint16_t>(*header, 4, length);
+    store_be<uint16_t>(*header, 6, 0);
+
+    uint64_t sum = Checksum::pseudo_header_sum(
+        source, destination, IPPROTO_UDP, length);
+    sum = Checksum::add(sum, packet.data());
+    uint16_t checksum = Checksum::udp_nonzero(Checksum::finish(sum));
+    store_be<uint16_t>(*header, 6, checksum);
+    return true;
+}
+
+} // namespace UDP
+
+namespace IPv4 {
+
+/*
+ * Prepends a minimal IPv4 header built from `h`, the header size, total
+ * size and checksum are filled in
+ */
+inline bool encapsulate(PacketBuffer &packet, Header h)
+{
+    if (packet.size() >
+        std::numeric_limits<uint16_t>::max() - minimal_header_size) {
+        return false;
+    }
+    h.header_size = minimal_header_size;
+    h.total_size = packet.size() + minimal_header_size;
+    h.checksum = 0;
+    h.checksum = compute_checksum(h);
+
+    auto header = packet.prepend(minimal_header_size);
+    if (!header) {
+        return false;
+    }
+    std::ranges::copy(serialize(h), header->begin());
+    return true;
+}
+
+} // namespace IPv4
+
+} // namespace xnet
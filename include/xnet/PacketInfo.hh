@@ -0,0 +1,245 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <netinet/in.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/Checksum.hh>
+#include <xnet/DHCP.hh>
+#include <xnet/Hash.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/IPv4TOS.hh>
+#include <xnet/UDP.hh>
+
+namespace xnet {
+
+/*
+ * What one pass over an IPv4 packet found: where each layer starts, its
+ * length, what checked out and a flow hash. Stages after the dissector
+ * read fields through it instead of parsing the headers again, the packet
+ * bytes it was computed from must be passed back in.
+ */
+struct PacketInfo
+{
+    enum Flag : uint16_t
+    {
+        // Version, header size and total size fit the data
+        ipv4 = 1 << 0,
+        ip_checksum_ok = 1 << 1,
+        // More fragments or a fragment offset, ports are not hashed
+        fragment = 1 << 2,
+        // UDP header of an unfragmented packet or first fragment
+        udp = 1 << 3,
+        // The datagram was summed, only with verify_udp_checksum
+        udp_checksum_checked = 1 << 4,
+        // Meaningful only along with udp_checksum_checked
+        udp_checksum_ok = 1 << 5,
+        udp_checksum_none = 1 << 6,
+        // UDP from or to the DHCP ports
+        dhcp = 1 << 7,
+    };
+
+    uint16_t flags = 0;
+    uint8_t protocol = 0;
+    uint8_t type_of_service = 0;
+    uint16_t l3_offset = 0;
+    uint16_t l3_size = 0;
+    uint16_t l4_offset = 0;
+    uint16_t l4_size = 0;
+    uint16_t l7_offset = 0;
+    uint16_t l7_size = 0;
+    uint32_t flow_hash = 0;
+
+    bool has(Flag flag) const
+    {
+        return (flags & flag) != 0;
+    }
+
+    // IPv4 header through the end of its total size
+    std::span<const std::byte> l3(std::span<const std::byte> data) const
+    {
+        return data.subspan(l3_offset, l3_size);
+    }
+
+    std::span<const std::byte> l4(std::span<const std::byte> data) const
+    {
+        return data.subspan(l4_offset, l4_size);
+    }
+
+    // UDP payload, empty for other protocols
+    std::span<const std::byte> payload(std::span<const std::byte> data) const
+    {
+        return data.subspan(l7_offset, l7_size);
+    }
+
+    IPv4::Address source_address(std::span<const std::byte> data) const
+    {
+        return address_at(data, l3_offset + 12);
+    }
+
+    IPv4::Address destination_address(std::span<const std::byte> data) const
+    {
+        return address_at(data, l3_offset + 16);
+    }
+
+    // Zero unless the udp flag is set
+    uint16_t source_port(std::span<const std::byte> data) const
+    {
+        return has(udp) ? load_be<uint16_t>(data, l4_offset) : 0;
+    }
+
+    uint16_t destination_port(std::span<const std::byte> data) const
+    {
+        return has(udp) ? load_be<uint16_t>(data, l4_offset + 2) : 0;
+    }
+
+    IPv4::TypeOfService tos() const
+    {
+        return IPv4::TypeOfService(type_of_service);
+    }
+
+  private:
+    static IPv4::Address
+        address_at(std::span<const std::byte> data, size_t offset)
+    {
+        std::array<std::byte, 4> output{};
+        std::ranges::copy(data.subspan(offset, 4), output.begin());
+        return IPv4::Address(output);
+    }
+};
+
+struct DissectConfig
+{
+    // Sums the whole datagram, only worth it when nothing else will
+    bool verify_udp_checksum = false;
+};
+
+/*
+ * Bounds are checked once per layer and every field is loaded once, the
+ * IPv4 header starts `l3_offset` bytes into `data`. A packet that is not
+ * IPv4 comes back with no flags.
+ */
+inline PacketInfo dissect(
+    std::span<const std::byte> data,
+    size_t l3_offset = 0,
+    const DissectConfig &config = {})
+{
+    PacketInfo output;
+    if (l3_offset > data.size() || l3_offset > 0xffff ||
+        data.size() - l3_offset < IPv4::minimal_header_size) {
+        return output;
+    }
+    auto ip = data.subspan(l3_offset);
+
+    uint8_t version_ihl = std::to_integer<uint8_t>(ip[0]);
+    size_t header_size = (version_ihl & 0x0f) * 4;
+    uint16_t total_size = load_be<uint16_t>(ip, 2);
+    if (version_ihl >> 4 != 4 || header_size < IPv4::minimal_header_size ||
+        total_size < header_size || total_size > ip.size() ||
+        l3_offset + total_size > 0xffff) {
+        return output;
+    }
+
+    output.flags = PacketInfo::ipv4;
+    output.type_of_service = std::to_integer<uint8_t>(ip[1]);
+    output.protocol = std::to_integer<uint8_t>(ip[9]);
+    output.l3_offset = l3_offset;
+    output.l3_size = total_size;
+    output.l4_offset = l3_offset + header_size;
+    output.l4_size = total_size - header_size;
+    output.l7_offset = output.l4_offset + output.l4_size;
+
+    if (Checksum::fold(Checksum::add(0, ip.first(header_size))) == 0xffff) {
+        output.flags |= PacketInfo::ip_checksum_ok;
+    }
+    uint16_t fragment = load_be<uint16_t>(ip, 6);
+    if ((fragment & 0x3fff) != 0) {
+        output.flags |= PacketInfo::fragment;
+    }
+
+    uint32_t source = load_be<uint32_t>(ip, 12);
+    uint32_t destination = load_be<uint32_t>(ip, 16);
+    uint64_t hash =
+        mix64((uint64_t(source) << 32 | destination) ^ output.protocol);
+
+    auto l4 = ip.subspan(header_size, output.l4_size);
+    if (output.protocol != IPPROTO_UDP || (fragment & 0x1fff) != 0 ||
+        l4.size() < UDP::header_size) {
+        output.flow_hash = uint32_t(hash);
+        return output;
+    }
+    uint16_t source_port = load_be<uint16_t>(l4, 0);
+    uint16_t destination_port = load_be<uint16_t>(l4, 2);
+    uint16_t udp_length = load_be<uint16_t>(l4, 4);
+    uint16_t udp_checksum = load_be<uint16_t>(l4, 6);
+    bool is_fragment = output.has(PacketInfo::fragment);
+    if (udp_length < UDP::header_size ||
+        (!is_fragment && udp_length > l4.size())) {
+        output.flow_hash = uint32_t(hash);
+        return output;
+    }
+
+    output.flags |= PacketInfo::udp;
+    output.l7_offset = output.l4_offset + UDP::header_size;
+    output.l7_size =
+        std::min<size_t>(udp_length, l4.size()) - UDP::header_size;
+    if (!is_fragment) {
+        hash = mix64(hash ^ (uint32_t(source_port) << 16 | destination_port));
+    }
+    output.flow_hash = uint32_t(hash);
+
+    if (udp_checksum == 0) {
+        output.flags |= PacketInfo::udp_checksum_none;
+    } else if (config.verify_udp_checksum && !is_fragment) {
+        uint64_t sum = Checksum::pseudo_header_sum(
+            IPv4::Address(htobe<uint32_t>(source)),
+            IPv4::Address(htobe<uint32_t>(destination)),
+            IPPROTO_UDP,
+            udp_length);
+        sum = Checksum::add(sum, l4.first(udp_length));
+        output.flags |= PacketInfo::udp_checksum_checked;
+        if (Checksum::fold(sum) == 0xffff) {
+            output.flags |= PacketInfo::udp_checksum_ok;
+        }
+    }
+
+    bool is_dhcp = source_port == DHCP::server_port ||
+                   source_port == DHCP::client_port ||
+                   destination_port == DHCP::server_port ||
+                   destination_port == DHCP::client_port;
+    if (is_dhcp) {
+        output.flags |= PacketInfo::dhcp;
+    }
+    return output;
+}
+
+/*
+ * Dissects `packets` into `output`, prefetching the headers a few packets
+ * ahead so their cache misses overlap with the parsing
+ */
+inline void dissect_batch(
+    std::span<const std::span<const std::byte>> packets,
+    std::span<PacketInfo> output,
+    size_t l3_offset = 0,
+    const DissectConfig &config = {})
+{
+    constexpr size_t prefetch_distance = 4;
+    size_t count = std::min(packets.size(), output.size());
+    for (size_t idx = 0; idx < std::min(count, prefetch_distance); idx++) {
+        __builtin_prefetch(packets[idx].data());
+    }
+    for (size_t idx = 0; idx < count; idx++) {
+        if (idx + prefetch_distance < count) {
+            __builtin_prefetch(packets[idx + prefetch_distance].data());
+        }
+        output[idx] = dissect(packets[idx], l3_offset, config);
+    }
+}
+
+} // namespace xnet
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <xnet/IPv4.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::IPv4 {
+
+struct RawSocketOptions
+{
+    // IPPROTO_RAW sends caller built datagrams, IPPROTO_UDP also receives
+    int protocol = IPPROTO_RAW;
+    std::string_view interface{};
+    bool broadcast = false;
+    int send_buffer = 0;
+};
+
+/*
+ * IPv4 socket carrying whole datagrams, headers included (IP_HDRINCL). Used
+ * where headers are rewritten in place instead of rebuilt by the kernel.
+ */
+struct RawSocket
+{
+    static std::optional<RawSocket> open(const RawSocketOptions &options)
+    {
+        RawSocket output(
+            ::socket(AF_INET, SOCK_RAW | SOCK_CLOEXEC, options.protocol));
+        if (output.m_fd < 0) {
+            return std::nullopt;
+        }
+
+        int one = 1;
+        if (!output.set_option(IPPROTO_IP, IP_HDRINCL, one)) {
+            return std::nullopt;
+        }
+
+        if (options.broadcast &&
+            !output.set_option(SOL_SOCKET, SO_BROADCAST, one)) {
+            return std::nullopt;
+        }
+
+        if (options.send_buffer != 0 &&
+            !output.set_option(SOL_SOCKET, SO_SNDBUF, options.send_buffer)) {
+            return std::nullopt;
+        }
+
+        if (!options.interface.empty()) {
+            if (options.interface.size() >= IFNAMSIZ) {
+                return std::nullopt;
+            }
+            if (::setsockopt(
+                    output.m_fd,
+                    SOL_SOCKET,
+                    SO_BINDTODEVICE,
+                    options.interface.data(),
+                    options.interface.size()) != 0) {
+                return std::nullopt;
+            }
+        }
+
+        return output;
+    }
+
+    RawSocket(RawSocket &&other) : m_fd(std::exchange(other.m_fd, -1))
+    {
+    }
+
+    RawSocket &operator=(RawSocket &&other)
+    {
+        if (this != &other) {
+            close();
+            m_fd = std::exchange(other.m_fd, -1);
+        }
+        return *this;
+    }
+
+    ~RawSocket()
+    {
+        close();
+    }
+
+    int fd() const
+    {
+        return m_fd;
+    }
+
+    // Datagrams include the IPv4 header, endpoint ports are ignored
+    template <size_t capacity, size_t slot_size>
+    std::optional<size_t> recv_batch(UDP::RecvBatch<capacity, slot_size> &batch)
+    {
+        batch.m_size = 0;
+        int nb_received = ::recvmmsg(
+            m_fd, batch.prepare(), capacity, MSG_WAITFORONE, nullptr);
+        if (nb_received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            return std::nullopt;
+        }
+
+        batch.m_size = nb_received;
+        return batch.m_size;
+    }
+
+    // Same contract as UDP::Socket::send_batch
+    template <size_t capacity>
+    size_t send_batch(UDP::SendBatch<capacity> &batch)
+    {
+        return batch.send(m_fd);
+    }
+
+  private:
+    int m_fd = -1;
+
+    explicit RawSocket(int fd) : m_fd(fd)
+    {
+    }
+
+    template <typename T>
+    bool set_option(int level, int name, const T &value)
+    {
+        return ::setsockopt(m_fd, level, name, &value, sizeof(value)) == 0;
+    }
+
+    void close()
+    {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+};
+
+} // namespace xnet::IPv4
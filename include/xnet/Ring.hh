@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <optional>
+#include <span>
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xnet {
+
+constexpr size_t cache_line_size = 64;
+
+/*
+ * Bounded single producer single consumer ring of trivially copyable
+ * handles. Each side owns its index on its own cache line and keeps a copy
+ * of the other side's index, the shared line is only read when the copy
+ * says the ring looks full (producer) or empty (consumer).
+ */
+template <typename T>
+struct SpscRing
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    SpscRing(size_t capacity)
+        : m_mask(std::bit_ceil(std::max<size_t>(2, capacity)) - 1),
+          m_slots(new T[m_mask + 1])
+    {
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    // Approximate when called concurrently with either side
+    size_t size() const
+    {
+        return m_producer.tail.load(std::memory_order_acquire) -
+               m_consumer.head.load(std::memory_order_acquire);
+    }
+
+    bool push(const T &item)
+    {
+        return push_burst(std::span<const T>(&item, 1)) == 1;
+    }
+
+    // Producer side, returns how many leading items were enqueued
+    size_t push_burst(std::span<const T> items)
+    {
+        size_t tail = m_producer.tail.load(std::memory_order_relaxed);
+        size_t free = capacity() - (tail - m_producer.head_copy);
+        if (free < items.size()) {
+            m_producer.head_copy =
+                m_consumer.head.load(std::memory_order_acquire);
+            free = capacity() - (tail - m_producer.head_copy);
+        }
+
+        size_t count = std::min(free, items.size());
+        for (size_t idx = 0; idx < count; idx++) {
+            m_slots[(tail + idx) & m_mask] = items[idx];
+        }
+        m_producer.tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    std::optional<T> pop()
+    {
+        T item;
+        if (pop_burst(std::span<T>(&item, 1)) == 0) {
+            return std::nullopt;
+        }
+        return item;
+    }
+
+    // Consumer side, returns how many items were written to `output`
+    size_t pop_burst(std::span<T> output)
+    {
+        size_t head = m_consumer.head.load(std::memory_order_relaxed);
+        size_t ready = m_consumer.tail_copy - head;
+        if (ready < output.size()) {
+            m_consumer.tail_copy =
+                m_producer.tail.load(std::memory_order_acquire);
+            ready = m_consumer.tail_copy - head;
+        }
+
+        size_t count = std::min(ready, output.size());
+        for (size_t idx = 0; idx < count; idx++) {
+            output[idx] = m_slots[(head + idx) & m_mask];
+        }
+        m_consumer.head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+  private:
+    struct alignas(cache_line_size) Producer
+    {
+        std::atomic<size_t> tail{0};
+        size_t head_copy = 0;
+    };
+
+    struct alignas(cache_line_size) Consumer
+    {
+        std::atomic<size_t> head{0};
+        size_t tail_copy = 0;
+    };
+
+    size_t m_mask;
+    std::unique_ptr<T[]> m_slots;
+    Producer m_producer;
+    Consumer m_consumer;
+};
+
+/*
+ * Bounded multiple producer single consumer ring. Producers reserve a run
+ * of slots with one CAS on the tail and publish each slot through its
+ * sequence number, so a slow producer never blocks the others from
+ * reserving, only the consumer waits for its slots in order.
+ */
+template <typename T>
+struct MpscRing
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    MpscRing(size_t capacity)
+        : m_mask(std::bit_ceil(std::max<size_t>(2, capacity)) - 1),
+          m_slots(new Slot[m_mask + 1])
+    {
+    }
+
+    MpscRing(const MpscRing &) = delete;
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    size_t capacity() const
+    {
+        return m_mask + 1;
+    }
+
+    // Approximate, counts reserved slots not yet published
+    size_t size() const
+    {
+        return m_producers.tail.load(std::memory_order_acquire) -
+               m_consumer.head.load(std::memory_order_acquire);
+    }
+
+    bool push(const T &item)
+    {
+        return push_burst(std::span<const T>(&item, 1)) == 1;
+    }
+
+    // Any thread, returns how many leading items were enqueued
+    size_t push_burst(std::span<const T> items)
+    {
+        size_t tail = m_producers.tail.load(std::memory_order_relaxed);
+        size_t count = 0;
+        do {
+            size_t head = m_consumer.head.load(std::memory_order_acquire);
+            count = std::min(capacity() - (tail - head), items.size());
+            if (count == 0) {
+                return 0;
+            }
+        } while (!m_producers.tail.compare_exchange_weak(
+            tail, tail + count, std::memory_order_relaxed));
+
+        for (size_t idx = 0; idx < count; idx++) {
+            Slot &slot = m_slots[(tail + idx) & m_mask];
+            slot.item = items[idx];
+            slot.sequence.store(tail + idx + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    std::optional<T> pop()
+    {
+        T item;
+        if (pop_burst(std::span<T>(&item, 1)) == 0) {
+            return std::nullopt;
+        }
+        return item;
+    }
+
+    // Consumer side, stops at the first slot not yet published
+    size_t pop_burst(std::span<T> output)
+    {
+        size_t head = m_consumer.head.load(std::memory_order_relaxed);
+        size_t count = 0;
+        while (count < output.size()) {
+            const Slot &slot = m_slots[(head + count) & m_mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence != head + count + 1) {
+                break;
+            }
+            output[count] = slot.item;
+            count++;
+        }
+        m_consumer.head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+  private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence{0};
+        T item;
+    };
+
+    struct alignas(cache_line_size) Producers
+    {
+        std::atomic<size_t> tail{0};
+    };
+
+    struct alignas(cache_line_size) Consumer
+    {
+        std::atomic<size_t> head{0};
+    };
+
+    size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+    Producers m_producers;
+    Consumer m_consumer;
+};
+
+} // namespace xnet
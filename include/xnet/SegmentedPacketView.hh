@@ -0,0 +1,225 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <netinet/in.h>
+
+#include <xnet/Checksum.hh>
+#include <xnet/DHCP.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/SegmentedView.hh>
+#include <xnet/UDP.hh>
+
+/*
+ * Counterparts of the PacketView types over a SegmentedView. Headers are
+ * read in place when they sit in one segment and copied into the view
+ * otherwise, so the HeaderViews handed out live as long as the view.
+ * Payloads stay segmented.
+ */
+
+namespace xnet::IPv4 {
+
+struct SegmentedPacketView
+{
+    static constexpr size_t max_header_size = 60;
+
+    SegmentedPacketView(SegmentedView data) : m_data(data)
+    {
+    }
+
+    std::optional<HeaderView> header_view() const
+    {
+        auto version_ihl = m_data.load_be<uint8_t>(0);
+        if (!version_ihl) {
+            return std::nullopt;
+        }
+        size_t header_size = (*version_ihl & 0x0f) * sizeof(uint32_t);
+        if (header_size < minimal_header_size) {
+            return std::nullopt;
+        }
+
+        auto header = m_data.linear(0, std::span(m_header).first(header_size));
+        if (!header) {
+            return std::nullopt;
+        }
+        return HeaderView(*header);
+    }
+
+    bool is_valid() const
+    {
+        auto header = header_view();
+        return header && !header->is_not_valid() && payload_data();
+    }
+
+    std::optional<SegmentedView> payload_data() const
+    {
+        auto header = header_view();
+        if (!header) {
+            return std::nullopt;
+        }
+        // HeaderView bounds total_size() by the header it sees, not the data
+        auto header_size = header->header_size();
+        auto total_size = m_data.load_be<uint16_t>(2);
+        if (!header_size || !total_size || *total_size < *header_size) {
+            return std::nullopt;
+        }
+        return m_data.subview(*header_size, *total_size - *header_size);
+    }
+
+  private:
+    SegmentedView m_data;
+    mutable std::array<std::byte, max_header_size> m_header;
+};
+
+} // namespace xnet::IPv4
+
+namespace xnet::UDP {
+
+struct SegmentedPacketView
+{
+    SegmentedPacketView(SegmentedView data) : m_data(data)
+    {
+    }
+
+    std::optional<Header> parse_header() const
+    {
+        std::array<std::byte, header_size> copy;
+        auto header = m_data.linear(0, copy);
+        if (!header) {
+            return std::nullopt;
+        }
+        return PacketView(*header).parse_header();
+    }
+
+    std::optional<SegmentedView> payload() const
+    {
+        auto header = parse_header();
+        if (!header || header->length > m_data.size()) {
+            return std::nullopt;
+        }
+        return m_data.subview(header_size, header->length - header_size);
+    }
+
+    // Sums the segments as they are, a zero checksum means none was sent
+    bool verify_checksum(IPv4::Address source, IPv4::Address destination) const
+    {
+        auto header = parse_header();
+        if (!header || header->length > m_data.size()) {
+            return false;
+        }
+        if (header->checksumm == 0) {
+            return true;
+        }
+
+        uint64_t sum = Checksum::pseudo_header_sum(
+            source, destination, IPPROTO_UDP, header->length);
+        sum = Checksum::add(sum, *m_data.subview(0, header->length));
+        return Checksum::fold(sum) == 0xffff;
+    }
+
+  private:
+    SegmentedView m_data;
+};
+
+} // namespace xnet::UDP
+
+namespace xnet::DHCP {
+
+struct SegmentedPacketView
+{
+    static constexpr uint32_t magic_cookie = 0x63825363;
+
+    SegmentedPacketView(SegmentedView data) : m_data(data)
+    {
+    }
+
+    std::optional<HeaderView> header_view() const
+    {
+        auto header = m_data.linear(0, m_header);
+        if (!header) {
+            return std::nullopt;
+        }
+        return HeaderView(*header);
+    }
+
+    // Options after the magic cookie
+    std::optional<SegmentedView> options_data() const
+    {
+        if (m_data.load_be<uint32_t>(header_size) != magic_cookie) {
+            return std::nullopt;
+        }
+        return m_data.subview(header_size + 4);
+    }
+
+    // Value of the first occurrence of `code` before END
+    std::optional<SegmentedView> find_option(OptionCode code) const
+    {
+        auto options = options_data();
+        if (!options) {
+            return std::nullopt;
+        }
+
+        if (auto flat = options->contiguous(0, options->size())) {
+            auto value = PacketView::find_option_in(*flat, code);
+            if (!value) {
+                return std::nullopt;
+            }
+            size_t value_offset = value->data() - flat->data();
+            return options->subview(value_offset, value->size());
+        }
+
+        size_t read_offset = 0;
+        while (read_offset < options->size()) {
+            uint8_t op_code = *options->load_be<uint8_t>(read_offset);
+            if (OptionCode(op_code) == OptionCode::PAD) {
+                read_offset++;
+                continue;
+            }
+            if (OptionCode(op_code) == OptionCode::END) {
+                return std::nullopt;
+            }
+
+            auto op_size = options->load_be<uint8_t>(read_offset + 1);
+            if (!op_size) {
+                return std::nullopt;
+            }
+            size_t value_offset = read_offset + 2;
+            if (value_offset + *op_size > options->size()) {
+                return std::nullopt;
+            }
+
+            if (OptionCode(op_code) == code) {
+                return options->subview(value_offset, *op_size);
+            }
+            read_offset = value_offset + *op_size;
+        }
+
+        return std::nullopt;
+    }
+
+    std::optional<MessageType> message_type() const
+    {
+        auto option = find_option(OptionCode::MESSAGE_TYPE);
+        if (!option || option->size() != 1) {
+            return std::nullopt;
+        }
+
+        uint8_t type = *option->load_be<uint8_t>(0);
+        if (type < uint8_t(MessageType::DHCPDISCOVER) ||
+            type > uint8_t(MessageType::DHCPINFORM)) {
+            return std::nullopt;
+        }
+        return MessageType(type);
+    }
+
+  private:
+    SegmentedView m_data;
+    mutable std::array<std::byte, header_size> m_header;
+};
+
+} // namespace xnet::DHCP
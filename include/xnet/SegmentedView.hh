@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <concepts>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/ByteOrder.hh>
+
+namespace xnet {
+
+/*
+ * Read-only view of bytes spread over a chain of segments (reassembled
+ * datagrams, GRO buffers, jumbo payloads), addressed as one sequence. Only
+ * the list of segments is referenced, it must outlive the view and every
+ * subview taken from it.
+ *
+ * Fixed-offset reads have a fast path when the bytes sit in one segment,
+ * which for headers is normally the first one.
+ */
+struct SegmentedView
+{
+    using Segment = std::span<const std::byte>;
+
+    SegmentedView() = default;
+
+    SegmentedView(std::span<const Segment> segments)
+        : m_segments(segments), m_offset(0), m_size(0)
+    {
+        for (Segment s : segments) {
+            m_size += s.size();
+        }
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    // Chunks in order, the first and last cut to the view
+    struct ChunkIterator
+    {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Segment;
+        using difference_type = std::ptrdiff_t;
+
+        std::span<const Segment> segments;
+        size_t offset = 0;
+        size_t remaining = 0;
+
+        Segment operator*() const
+        {
+            Segment s = segments.front().subspan(offset);
+            return s.first(std::min(s.size(), remaining));
+        }
+
+        ChunkIterator &operator++()
+        {
+            remaining -= (**this).size();
+            segments = segments.subspan(1);
+            offset = 0;
+            skip_empty();
+            return *this;
+        }
+
+        ChunkIterator operator++(int)
+        {
+            ChunkIterator output = *this;
+            ++*this;
+            return output;
+        }
+
+        bool operator==(std::default_sentinel_t) const
+        {
+            return remaining == 0;
+        }
+
+        bool operator==(const ChunkIterator &other) const
+        {
+            return remaining == other.remaining;
+        }
+
+        void skip_empty()
+        {
+            while (remaining != 0 && segments.front().size() == offset) {
+                segments = segments.subspan(1);
+                offset = 0;
+            }
+        }
+    };
+
+    struct Chunks
+    {
+        ChunkIterator first;
+
+        ChunkIterator begin() const
+        {
+            return first;
+        }
+
+        std::default_sentinel_t end() const
+        {
+            return {};
+        }
+    };
+
+    Chunks chunks() const
+    {
+        ChunkIterator it{m_segments, m_offset, m_size};
+        it.skip_empty();
+        return Chunks{it};
+    }
+
+    std::optional<SegmentedView> subview(size_t offset, size_t size) const
+    {
+        if (offset > m_size || size > m_size - offset) {
+            return std::nullopt;
+        }
+
+        SegmentedView output;
+        output.m_size = size;
+        auto [segment, in_segment] = locate(offset);
+        output.m_segments = m_segments.subspan(segment);
+        output.m_offset = in_segment;
+        return output;
+    }
+
+    std::optional<SegmentedView> subview(size_t offset) const
+    {
+        if (offset > m_size) {
+            return std::nullopt;
+        }
+        return subview(offset, m_size - offset);
+    }
+
+    // [offset, offset + size) if it lies in a single segment
+    std::optional<Segment> contiguous(size_t offset, size_t size) const
+    {
+        if (offset > m_size || size > m_size - offset) {
+            return std::nullopt;
+        }
+
+        auto [segment, in_segment] = locate(offset);
+        if (segment == m_segments.size()) {
+            return Segment();
+        }
+        Segment s = m_segments[segment].subspan(in_segment);
+        if (s.size() < size) {
+            return std::nullopt;
+        }
+        return s.first(size);
+    }
+
+    bool copy_to(size_t offset, std::span<std::byte> output) const
+    {
+        auto range = subview(offset, output.size());
+        if (!range) {
+            return false;
+        }
+        auto out = output.begin();
+        for (Segment chunk : range->chunks()) {
+            out = std::ranges::copy(chunk, out).out;
+        }
+        return true;
+    }
+
+    /*
+     * [offset, offset + output.size()) in place when contiguous, otherwise
+     * copied into `output`
+     */
+    std::optional<Segment>
+        linear(size_t offset, std::span<std::byte> output) const
+    {
+        if (auto in_place = contiguous(offset, output.size())) {
+            return in_place;
+        }
+        if (!copy_to(offset, output)) {
+            return std::nullopt;
+        }
+        return Segment(output);
+    }
+
+    template <std::unsigned_integral I>
+    std::optional<I> load_be(size_t offset) const
+    {
+        std::array<std::byte, sizeof(I)> data;
+        auto bytes = linear(offset, data);
+        if (!bytes) {
+            return std::nullopt;
+        }
+        return xnet::load_be<I>(*bytes, 0);
+    }
+
+  private:
+    std::span<const Segment> m_segments;
+    // Start of the view in the first segment
+    size_t m_offset = 0;
+    size_t m_size = 0;
+
+    // Segment index and offset in it of byte `offset` of the view
+    std::pair<size_t, size_t> locate(size_t offset) const
+    {
+        size_t segment = 0;
+        size_t in_segment = m_offset + offset;
+        while (segment < m_segments.size() &&
+               in_segment >= m_segments[segment].size()) {
+            in_segment -= m_segments[segment].size();
+            segment++;
+        }
+        return {segment, in_segment};
+    }
+};
+
+} // namespace xnet
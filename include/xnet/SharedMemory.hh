@@ -0,0 +1,126 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace xnet {
+
+/*
+ * Named POSIX shared memory mapping. Contents must not hold pointers, other
+ * processes map the region at different addresses.
+ */
+struct SharedRegion
+{
+    // Attaches to `name` when it exists with the same size, creates it else
+    static std::optional<SharedRegion>
+        open(const std::string &name, size_t size, bool &created)
+    {
+        created = false;
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            created = true;
+            if (::ftruncate(fd, size) != 0) {
+                ::close(fd);
+                ::shm_unlink(name.c_str());
+                return std::nullopt;
+            }
+        } else if (errno == EEXIST) {
+            fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+            if (fd < 0) {
+                return std::nullopt;
+            }
+
+            struct stat st{};
+            if (::fstat(fd, &st) != 0 || size_t(st.st_size) != size) {
+                ::close(fd);
+                return std::nullopt;
+            }
+        } else {
+            return std::nullopt;
+        }
+
+        void *map =
+            ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            if (created) {
+                ::shm_unlink(name.c_str());
+            }
+            return std::nullopt;
+        }
+
+        return SharedRegion(name, std::span<std::byte>((std::byte *)map, size));
+    }
+
+    static bool unlink(const std::string &name)
+    {
+        return ::shm_unlink(name.c_str()) == 0;
+    }
+
+    SharedRegion(SharedRegion &&other)
+        : m_name(std::move(other.m_name)),
+          m_data(std::exchange(other.m_data, {}))
+    {
+    }
+
+    SharedRegion &operator=(SharedRegion &&other)
+    {
+        if (this != &other) {
+            unmap();
+            m_name = std::move(other.m_name);
+            m_data = std::exchange(other.m_data, {});
+        }
+        return *this;
+    }
+
+    ~SharedRegion()
+    {
+        unmap();
+    }
+
+    const std::string &name() const
+    {
+        return m_name;
+    }
+
+    std::span<std::byte> data() const
+    {
+        return m_data;
+    }
+
+    template <typename T>
+    T &object_at(size_t offset) const
+    {
+        return *(T *)(m_data.data() + offset);
+    }
+
+  private:
+    std::string m_name;
+    std::span<std::byte> m_data;
+
+    SharedRegion(std::string name, std::span<std::byte> data)
+        : m_name(std::move(name)), m_data(data)
+    {
+    }
+
+    void unmap()
+    {
+        if (!m_data.empty()) {
+            ::munmap(m_data.data(), m_data.size());
+            m_data = {};
+        }
+    }
+};
+
+} // namespace xnet
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <xnet/IPv4.hh>
+#include <xnet/Ring.hh>
+
+namespace xnet {
+
+/*
+ * Single producer single consumer packet ring between two processes. Slots
+ * live in a memfd mapping, so the consumer reads packets in place, and an
+ * eventfd wakes a sleeping consumer. The producer publishes a whole batch
+ * with flush() and signals the eventfd at most once per flush, only when
+ * the consumer announced it is going to sleep.
+ *
+ * One side creates the ring and passes memory_fd() and event_fd() to the
+ * other, e.g. with HotRestart::send_fds, which attaches to them.
+ */
+struct SharedPacketRing
+{
+    static constexpr uint64_t magic = 0x676e'6972'7465'6e78; // "xnetring"
+
+    static std::optional<SharedPacketRing>
+        create(uint32_t nb_slots, uint32_t slot_size)
+    {
+        nb_slots = std::bit_ceil(std::max<uint32_t>(2, nb_slots));
+        size_t size = mapping_size(nb_slots, slot_size);
+
+        int memory_fd = ::memfd_create("xnet-packet-ring", MFD_CLOEXEC);
+        if (memory_fd < 0) {
+            return std::nullopt;
+        }
+        int event_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (event_fd < 0) {
+            ::close(memory_fd);
+            return std::nullopt;
+        }
+
+        SharedPacketRing output(memory_fd, event_fd);
+        if (::ftruncate(memory_fd, size) != 0 || !output.map(size)) {
+            return std::nullopt;
+        }
+
+        Header &header = output.header();
+        header.nb_slots = nb_slots;
+        header.slot_size = slot_size;
+        header.magic = magic;
+        output.m_nb_slots = nb_slots;
+        output.m_slot_size = slot_size;
+        return output;
+    }
+
+    // Takes ownership of both descriptors, closed on failure
+    static std::optional<SharedPacketRing> attach(int memory_fd, int event_fd)
+    {
+        SharedPacketRing output(memory_fd, event_fd);
+
+        struct stat st{};
+        if (::fstat(memory_fd, &st) != 0 ||
+            size_t(st.st_size) < sizeof(Header) ||
+            !output.map(st.st_size)) {
+            return std::nullopt;
+        }
+
+        const Header &header = output.header();
+        uint32_t nb_slots = header.nb_slots;
+        if (header.magic != magic || !std::has_single_bit(nb_slots) ||
+            mapping_size(nb_slots, header.slot_size) != size_t(st.st_size)) {
+            return std::nullopt;
+        }
+
+        output.m_nb_slots = nb_slots;
+        output.m_slot_size = header.slot_size;
+        output.m_tail = header.tail.load(std::memory_order_acquire);
+        output.m_head = header.head.load(std::memory_order_acquire);
+        return output;
+    }
+
+    SharedPacketRing(SharedPacketRing &&other)
+        : m_memory_fd(std::exchange(other.m_memory_fd, -1)),
+          m_event_fd(std::exchange(other.m_event_fd, -1)),
+          m_data(std::exchange(other.m_data, {})),
+          m_nb_slots(other.m_nb_slots), m_slot_size(other.m_slot_size),
+          m_tail(other.m_tail), m_head(other.m_head)
+    {
+    }
+
+    SharedPacketRing &operator=(SharedPacketRing &&other)
+    {
+        if (this != &other) {
+            close();
+            m_memory_fd = std::exchange(other.m_memory_fd, -1);
+            m_event_fd = std::exchange(other.m_event_fd, -1);
+            m_data = std::exchange(other.m_data, {});
+            m_nb_slots = other.m_nb_slots;
+            m_slot_size = other.m_slot_size;
+            m_tail = other.m_tail;
+            m_head = other.m_head;
+        }
+        return *this;
+    }
+
+    ~SharedPacketRing()
+    {
+        close();
+    }
+
+    int memory_fd() const
+    {
+        return m_memory_fd;
+    }
+
+    int event_fd() const
+    {
+        return m_event_fd;
+    }
+
+    uint32_t capacity() const
+    {
+        return m_nb_slots;
+    }
+
+    uint32_t slot_size() const
+    {
+        return m_slot_size;
+    }
+
+    /*
+     * Producer: storage of the next slot, to be filled and committed, empty
+     * if the ring is full. Committed slots become visible on flush().
+     */
+    std::span<std::byte> acquire()
+    {
+        if (m_tail - m_head == m_nb_slots) {
+            m_head = header().head.load(std::memory_order_acquire);
+            if (m_tail - m_head == m_nb_slots) {
+                return {};
+            }
+        }
+        return std::span<std::byte>(slot_data(m_tail), m_slot_size);
+    }
+
+    // Only after acquire() returned a slot, `size` bytes of it
+    void commit(size_t size)
+    {
+        assert(m_tail - m_head < m_nb_slots && size <= m_slot_size);
+        slot_size_of(m_tail) = std::min<size_t>(size, m_slot_size);
+        m_tail++;
+    }
+
+    bool push(std::span<const std::byte> packet)
+    {
+        auto slot = acquire();
+        if (slot.empty() || slot.size() < packet.size()) {
+            return false;
+        }
+        std::ranges::copy(packet, slot.begin());
+        commit(packet.size());
+        return true;
+    }
+
+    void flush()
+    {
+        Header &h = header();
+        h.tail.store(m_tail, std::memory_order_seq_cst);
+        if (h.consumer_waiting.load(std::memory_order_seq_cst) != 0 &&
+            h.consumer_waiting.exchange(0, std::memory_order_relaxed) != 0) {
+            uint64_t one = 1;
+            [[maybe_unused]] auto written =
+                ::write(m_event_fd, &one, sizeof(one));
+        }
+    }
+
+    /*
+     * Consumer: packets ready to be read, in order from index 0. Nothing
+     * the producer writes is trusted, a tail beyond the ring counts as full.
+     */
+    size_t available()
+    {
+        m_tail = header().tail.load(std::memory_order_acquire);
+        return std::min<uint64_t>(m_tail - m_head, m_nb_slots);
+    }
+
+    // Empty for a slot whose length does not fit it
+    std::span<const std::byte> packet(size_t idx) const
+    {
+        uint32_t size = std::atomic_ref(slot_size_of(m_head + idx))
+                            .load(std::memory_order_relaxed);
+        if (size > m_slot_size) {
+            return {};
+        }
+        return std::span<const std::byte>(slot_data(m_head + idx), size);
+    }
+
+    IPv4::PacketView view(size_t idx) const
+    {
+        return IPv4::PacketView(packet(idx));
+    }
+
+    // Hands the first `count` packets back to the producer
+    void release(size_t count)
+    {
+        m_head += count;
+        header().head.store(m_head, std::memory_order_release);
+    }
+
+    // Calls `fn(IPv4::PacketView)` on up to `max` packets, then releases them
+    template <typename Fn>
+    size_t consume(size_t max, Fn &&fn)
+    {
+        size_t count = std::min(available(), max);
+        for (size_t idx = 0; idx < count; idx++) {
+            fn(view(idx));
+        }
+        release(count);
+        return count;
+    }
+
+    // Sleeps until packets are available, false on timeout
+    bool wait(std::chrono::milliseconds timeout)
+    {
+        if (available() != 0) {
+            return true;
+        }
+
+        Header &h = header();
+        h.consumer_waiting.store(1, std::memory_order_seq_cst);
+        if (h.tail.load(std::memory_order_seq_cst) != m_head) {
+            h.consumer_waiting.store(0, std::memory_order_relaxed);
+            return true;
+        }
+
+        pollfd pfd{m_event_fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, timeout.count());
+        if (ready > 0) {
+            uint64_t count = 0;
+            [[maybe_unused]] auto nb_read =
+                ::read(m_event_fd, &count, sizeof(count));
+        }
+        h.consumer_waiting.store(0, std::memory_order_relaxed);
+        return available() != 0;
+    }
+
+  private:
+    struct Header
+    {
+        uint64_t magic;
+        uint32_t nb_slots;
+        uint32_t slot_size;
+        alignas(cache_line_size) std::atomic<uint64_t> tail;
+        alignas(cache_line_size) std::atomic<uint64_t> head;
+        alignas(cache_line_size) std::atomic<uint32_t> consumer_waiting;
+    };
+
+    // Packet bytes start after the length, slots are whole cache lines
+    static constexpr size_t slot_data_offset = 16;
+
+    int m_memory_fd = -1;
+    int m_event_fd = -1;
+    std::span<std::byte> m_data;
+    uint32_t m_nb_slots = 0;
+    uint32_t m_slot_size = 0;
+    // Producer: next slot to fill. Consumer: last tail seen
+    uint64_t m_tail = 0;
+    // Consumer: next slot to read. Producer: last head seen
+    uint64_t m_head = 0;
+
+    SharedPacketRing(int memory_fd, int event_fd)
+        : m_memory_fd(memory_fd), m_event_fd(event_fd)
+    {
+    }
+
+    static size_t slot_stride(uint32_t slot_size)
+    {
+        size_t size = slot_data_offset + slot_size;
+        return (size + cache_line_size - 1) / cache_line_size * cache_line_size;
+    }
+
+    static size_t header_size()
+    {
+        return slot_stride(sizeof(Header));
+    }
+
+    static size_t mapping_size(uint32_t nb_slots, uint32_t slot_size)
+    {
+        return header_size() + size_t(nb_slots) * slot_stride(slot_size);
+    }
+
+    bool map(size_t size)
+    {
+        void *map = ::mmap(
+            nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_memory_fd, 0);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        m_data = std::span<std::byte>((std::byte *)map, size);
+        return true;
+    }
+
+    Header &header() const
+    {
+        return *(Header *)m_data.data();
+    }
+
+    std::byte *slot_begin(uint64_t position) const
+    {
+        size_t idx = position & (m_nb_slots - 1);
+        return m_data.data() + header_size() + idx * slot_stride(m_slot_size);
+    }
+
+    uint32_t &slot_size_of(uint64_t position) const
+    {
+        return *(uint32_t *)slot_begin(position);
+    }
+
+    std::byte *slot_data(uint64_t position) const
+    {
+        return slot_begin(position) + slot_data_offset;
+    }
+
+    void close()
+    {
+        if (!m_data.empty()) {
+            ::munmap(m_data.data(), m_data.size());
+            m_data = {};
+        }
+        if (m_memory_fd >= 0) {
+            ::close(m_memory_fd);
+            m_memory_fd = -1;
+        }
+        if (m_event_fd >= 0) {
+            ::close(m_event_fd);
+            m_event_fd = -1;
+        }
+    }
+};
+
+} // namespace xnet
@@ -0,0 +1,403 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/Hash.hh>
+
+namespace xnet {
+
+/*
+ * Count-Min sketch over pre-hashed keys: overestimates a key's count by at
+ * most total / width with probability 1 - e^-depth. Rows are indexed with
+ * double hashing from one 64-bit hash.
+ */
+struct CountMinSketch
+{
+    static constexpr size_t depth = 4;
+
+    CountMinSketch(size_t width)
+        : m_mask(std::bit_ceil(std::max<size_t>(16, width)) - 1),
+          m_counters(new uint64_t[depth * (m_mask + 1)]())
+    {
+    }
+
+    size_t width() const
+    {
+        return m_mask + 1;
+    }
+
+    uint64_t total() const
+    {
+        return m_total;
+    }
+
+    void add(uint64_t hash, uint64_t count = 1)
+    {
+        for (size_t row = 0; row < depth; row++) {
+            m_counters[cell(hash, row)] += count;
+        }
+        m_total += count;
+    }
+
+    uint64_t estimate(uint64_t hash) const
+    {
+        uint64_t output = UINT64_MAX;
+        for (size_t row = 0; row < depth; row++) {
+            output = std::min(output, m_counters[cell(hash, row)]);
+        }
+        return output;
+    }
+
+    // Both sketches must have the same width
+    void merge(const CountMinSketch &other)
+    {
+        assert(other.width() == width());
+        for (size_t idx = 0; idx < depth * width(); idx++) {
+            m_counters[idx] += other.m_counters[idx];
+        }
+        m_total += other.m_total;
+    }
+
+    void clear()
+    {
+        std::fill_n(m_counters.get(), depth * width(), 0);
+        m_total = 0;
+    }
+
+  private:
+    size_t m_mask;
+    std::unique_ptr<uint64_t[]> m_counters;
+    uint64_t m_total = 0;
+
+    size_t cell(uint64_t hash, size_t row) const
+    {
+        uint64_t mixed = mix64(hash);
+        uint32_t h1 = mixed;
+        uint32_t h2 = (mixed >> 32) | 1;
+        return row * width() + ((h1 + row * h2) & m_mask);
+    }
+};
+
+/*
+ * Space-Saving top-k (Metwally et al.): k monitored keys, a new key takes
+ * over the smallest counter and inherits it as its error bound. Entries are
+ * addressed by a min-heap on count and an open addressing index on hash,
+ * all sized at construction, updates never allocate.
+ */
+template <typename Key>
+struct SpaceSaving
+{
+    struct Entry
+    {
+        Key key{};
+        uint64_t hash = 0;
+        uint64_t count = 0;
+        // Upper bound of how much of `count` may belong to evicted keys
+        uint64_t error = 0;
+    };
+
+    SpaceSaving(size_t capacity)
+        : m_capacity(std::max<size_t>(1, capacity)),
+          m_index_mask(std::bit_ceil(m_capacity * 2) - 1)
+    {
+        m_entries.reserve(m_capacity);
+        m_heap_positions.reserve(m_capacity);
+        m_heap.reserve(m_capacity);
+        m_index.assign(m_index_mask + 1, no_entry);
+        m_scratch.reserve(m_capacity * 2);
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    size_t size() const
+    {
+        return m_entries.size();
+    }
+
+    bool full() const
+    {
+        return m_entries.size() == m_capacity;
+    }
+
+    // Smallest monitored count, what an unmonitored key may have had
+    uint64_t min_count() const
+    {
+        return full() ? m_entries[m_heap.front()].count : 0;
+    }
+
+    void add(const Key &key, uint64_t hash, uint64_t count = 1)
+    {
+        if (!increment(key, hash, count)) {
+            uint64_t floor = min_count();
+            insert(key, hash, floor + count, floor);
+        }
+    }
+
+    // Adds to a monitored key, false if `key` is not monitored
+    bool increment(const Key &key, uint64_t hash, uint64_t count = 1)
+    {
+        uint32_t id = find(key, hash);
+        if (id == no_entry) {
+            return false;
+        }
+        m_entries[id].count += count;
+        sift_down(m_heap_positions[id]);
+        return true;
+    }
+
+    // Monitors an unmonitored key, evicting the smallest counter if full
+    void insert(const Key &key, uint64_t hash, uint64_t count, uint64_t error)
+    {
+        if (!full()) {
+            uint32_t id = m_entries.size();
+            m_entries.push_back(Entry{key, hash, count, error});
+            m_heap_positions.push_back(m_heap.size());
+            m_heap.push_back(id);
+            sift_up(m_heap.size() - 1);
+            insert_index(id);
+            return;
+        }
+
+        uint32_t id = m_heap.front();
+        erase_index(id);
+        m_entries[id] = Entry{key, hash, count, error};
+        insert_index(id);
+        sift_down(0);
+    }
+
+    const Entry *get(const Key &key, uint64_t hash) const
+    {
+        uint32_t id = find(key, hash);
+        return id == no_entry ? nullptr : &m_entries[id];
+    }
+
+    // Monitored entries, largest count first
+    std::vector<Entry> top() const
+    {
+        std::vector<Entry> output(m_entries.begin(), m_entries.end());
+        std::ranges::sort(output, [](const Entry &l, const Entry &r) {
+            return l.count > r.count;
+        });
+        return output;
+    }
+
+    /*
+     * Mergeable summaries (Agarwal et al.): keys missing on one side are
+     * assumed to have that side's minimum, then the k largest are kept.
+     */
+    void merge(const SpaceSaving &other)
+    {
+        uint64_t own_min = min_count();
+        uint64_t other_min = other.min_count();
+
+        m_scratch.clear();
+        for (const Entry &e : m_entries) {
+            Entry merged = e;
+            const Entry *match = other.get(e.key, e.hash);
+            merged.count += match ? match->count : other_min;
+            merged.error += match ? match->error : other_min;
+            m_scratch.push_back(merged);
+        }
+        for (const Entry &e : other.m_entries) {
+            if (find(e.key, e.hash) == no_entry) {
+                Entry merged = e;
+                merged.count += own_min;
+                merged.error += own_min;
+                m_scratch.push_back(merged);
+            }
+        }
+
+        if (m_scratch.size() > m_capacity) {
+            std::ranges::nth_element(
+                m_scratch,
+                m_scratch.begin() + m_capacity,
+                [](const Entry &l, const Entry &r) {
+                    return l.count > r.count;
+                });
+            m_scratch.resize(m_capacity);
+        }
+
+        clear();
+        for (const Entry &e : m_scratch) {
+            uint32_t id = m_entries.size();
+            m_entries.push_back(e);
+            m_heap_positions.push_back(m_heap.size());
+            m_heap.push_back(id);
+            sift_up(m_heap.size() - 1);
+            insert_index(id);
+        }
+    }
+
+    void clear()
+    {
+        m_entries.clear();
+        m_heap_positions.clear();
+        m_heap.clear();
+        std::ranges::fill(m_index, no_entry);
+    }
+
+  private:
+    static constexpr uint32_t no_entry = UINT32_MAX;
+
+    size_t m_capacity;
+    size_t m_index_mask;
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_heap_positions;
+    std::vector<uint32_t> m_heap;
+    std::vector<uint32_t> m_index;
+    std::vector<Entry> m_scratch;
+
+    uint32_t find(const Key &key, uint64_t hash) const
+    {
+        size_t pos = hash & m_index_mask;
+        while (m_index[pos] != no_entry) {
+            uint32_t id = m_index[pos];
+            if (m_entries[id].hash == hash && m_entries[id].key == key) {
+                return id;
+            }
+            pos = (pos + 1) & m_index_mask;
+        }
+        return no_entry;
+    }
+
+    void insert_index(uint32_t id)
+    {
+        size_t pos = m_entries[id].hash & m_index_mask;
+        while (m_index[pos] != no_entry) {
+            pos = (pos + 1) & m_index_mask;
+        }
+        m_index[pos] = id;
+    }
+
+    // Backward shift deletion, as in the lease table index
+    void erase_index(uint32_t id)
+    {
+        size_t pos = m_entries[id].hash & m_index_mask;
+        while (m_index[pos] != id) {
+            pos = (pos + 1) & m_index_mask;
+        }
+
+        size_t hole = pos;
+        for (size_t next = (hole + 1) & m_index_mask; m_index[next] != no_entry;
+             next = (next + 1) & m_index_mask) {
+            size_t home = m_entries[m_index[next]].hash & m_index_mask;
+            bool movable = ((next - home) & m_index_mask) >=
+                           ((next - hole) & m_index_mask);
+            if (movable) {
+                m_index[hole] = m_index[next];
+                hole = next;
+            }
+        }
+        m_index[hole] = no_entry;
+    }
+
+    bool less(size_t l, size_t r) const
+    {
+        return m_entries[m_heap[l]].count < m_entries[m_heap[r]].count;
+    }
+
+    void swap_heap(size_t l, size_t r)
+    {
+        std::swap(m_heap[l], m_heap[r]);
+        m_heap_positions[m_heap[l]] = l;
+        m_heap_positions[m_heap[r]] = r;
+    }
+
+    void sift_up(size_t pos)
+    {
+        while (pos != 0 && less(pos, (pos - 1) / 2)) {
+            swap_heap(pos, (pos - 1) / 2);
+            pos = (pos - 1) / 2;
+        }
+    }
+
+    void sift_down(size_t pos)
+    {
+        while (true) {
+            size_t smallest = pos;
+            size_t left = pos * 2 + 1;
+            size_t right = left + 1;
+            if (left < m_heap.size() && less(left, smallest)) {
+                smallest = left;
+            }
+            if (right < m_heap.size() && less(right, smallest)) {
+                smallest = right;
+            }
+            if (smallest == pos) {
+                return;
+            }
+            swap_heap(pos, smallest);
+            pos = smallest;
+        }
+    }
+};
+
+// Count-Min point estimates for any key plus Space-Saving heavy hitters
+template <typename Key>
+struct HeavyHitters
+{
+    HeavyHitters(size_t width, size_t top_k) : m_counts(width), m_top(top_k)
+    {
+    }
+
+    /*
+     * An unmonitored key only evicts the smallest top-k counter once its
+     * Count-Min estimate is above it, so a stream of one-off keys does not
+     * churn the top-k. Admitted keys start at that estimate.
+     */
+    void add(const Key &key, uint64_t hash, uint64_t count = 1)
+    {
+        m_counts.add(hash, count);
+        if (m_top.increment(key, hash, count)) {
+            return;
+        }
+
+        uint64_t estimate = m_counts.estimate(hash);
+        if (!m_top.full() || estimate > m_top.min_count()) {
+            m_top.insert(key, hash, estimate, estimate - count);
+        }
+    }
+
+    uint64_t estimate(uint64_t hash) const
+    {
+        return m_counts.estimate(hash);
+    }
+
+    uint64_t total() const
+    {
+        return m_counts.total();
+    }
+
+    std::vector<typename SpaceSaving<Key>::Entry> top() const
+    {
+        return m_top.top();
+    }
+
+    void merge(const HeavyHitters &other)
+    {
+        m_counts.merge(other.m_counts);
+        m_top.merge(other.m_top);
+    }
+
+    void clear()
+    {
+        m_counts.clear();
+        m_top.clear();
+    }
+
+  private:
+    CountMinSketch m_counts;
+    SpaceSaving<Key> m_top;
+};
+
+} // namespace xnet
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <array>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace xnet {
+
+/*
+ * Size classed free lists for coroutine frames, one pool per thread. Frames
+ * are carved from slabs that are never returned, so a steady population of
+ * transactions allocates nothing. Frames must be freed on the thread that
+ * allocated them, which single threaded event loops guarantee.
+ */
+struct FramePool
+{
+    static constexpr size_t granularity = 64;
+    static constexpr size_t nb_classes = 32;
+    static constexpr size_t slab_size = 256 * 1024;
+
+    static FramePool &local()
+    {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+    void *allocate(size_t size)
+    {
+        size_t size_class = class_of(size);
+        if (size_class >= nb_classes) {
+            return ::operator new(size);
+        }
+
+        Block *&head = m_free[size_class];
+        if (head == nullptr) {
+            refill(size_class);
+        }
+        Block *block = head;
+        head = block->next;
+        m_live++;
+        return block;
+    }
+
+    void deallocate(void *frame, size_t size)
+    {
+        size_t size_class = class_of(size);
+        if (size_class >= nb_classes) {
+            ::operator delete(frame);
+            return;
+        }
+
+        auto *block = (Block *)frame;
+        block->next = m_free[size_class];
+        m_free[size_class] = block;
+        m_live--;
+    }
+
+    // Frames currently allocated from the slabs
+    size_t live() const
+    {
+        return m_live;
+    }
+
+    size_t reserved_bytes() const
+    {
+        return m_slabs.size() * slab_size;
+    }
+
+  private:
+    struct Block
+    {
+        Block *next;
+    };
+
+    std::array<Block *, nb_classes> m_free{};
+    std::vector<std::unique_ptr<std::byte[]>> m_slabs;
+    size_t m_live = 0;
+
+    static size_t class_of(size_t size)
+    {
+        return (size + granularity - 1) / granularity;
+    }
+
+    void refill(size_t size_class)
+    {
+        size_t block_size = size_class * granularity;
+        m_slabs.push_back(std::make_unique<std::byte[]>(slab_size));
+        std::byte *slab = m_slabs.back().get();
+        for (size_t offset = 0; offset + block_size <= slab_size;
+             offset += block_size) {
+            auto *block = (Block *)(slab + offset);
+            block->next = m_free[size_class];
+            m_free[size_class] = block;
+        }
+    }
+};
+
+template <typename T>
+struct Task;
+
+namespace TaskDetail {
+
+struct PromiseBase
+{
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+
+    static void *operator new(size_t size)
+    {
+        return FramePool::local().allocate(size);
+    }
+
+    static void operator delete(void *frame, size_t size)
+    {
+        FramePool::local().deallocate(frame, size);
+    }
+
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename Promise>
+        std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            PromiseBase &promise = handle.promise();
+            if (promise.detached) {
+                handle.destroy();
+                return std::noop_coroutine();
+            }
+            if (promise.continuation) {
+                return promise.continuation;
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    // Protocol code reports failures through its results, not exceptions
+    void unhandled_exception() noexcept
+    {
+        std::terminate();
+    }
+};
+
+template <typename T>
+struct Promise : PromiseBase
+{
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U &&v)
+    {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T take()
+    {
+        return std::move(*value);
+    }
+};
+
+template <>
+struct Promise<void> : PromiseBase
+{
+    Task<void> get_return_object();
+
+    void return_void()
+    {
+    }
+
+    void take()
+    {
+    }
+};
+
+} // namespace TaskDetail
+
+/*
+ * Lazily started coroutine, runs when awaited and resumes its awaiter on
+ * completion without growing the stack. Frames come from the thread's
+ * FramePool.
+ */
+template <typename T = void>
+struct Task
+{
+    using promise_type = TaskDetail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit Task(Handle handle) : m_handle(handle)
+    {
+    }
+
+    Task(Task &&other) : m_handle(std::exchange(other.m_handle, {}))
+    {
+    }
+
+    Task &operator=(Task &&other)
+    {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter)
+    {
+        m_handle.promise().continuation = awaiter;
+        return m_handle;
+    }
+
+    T await_resume()
+    {
+        return m_handle.promise().take();
+    }
+
+    // Starts the task, its frame frees itself when it completes
+    friend void spawn(Task &&task)
+    {
+        Handle handle = std::exchange(task.m_handle, {});
+        handle.promise().detached = true;
+        handle.resume();
+    }
+
+  private:
+    Handle m_handle;
+};
+
+namespace TaskDetail {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object()
+{
+    return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object()
+{
+    return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+} // namespace TaskDetail
+
+} // namespace xnet
@@ -0,0 +1,416 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <time.h>
+
+namespace xnet {
+
+/*
+ * Intrusive timer hook. Lives inside the entry that owns the timer (lease,
+ * transaction, flow...) and links entries by their index in the entry array,
+ * so no allocation happens on schedule and the links stay valid when the
+ * array is mapped at a different address.
+ */
+struct TimerNode
+{
+    static constexpr uint32_t no_index = std::numeric_limits<uint32_t>::max();
+    static constexpr uint16_t no_slot = 0xfff;
+
+    uint32_t next = no_index;
+    uint32_t prev = no_index;
+    uint64_t expires : 52 = 0;
+    uint64_t slot : 12 = no_slot;
+
+    constexpr bool is_linked() const
+    {
+        return slot != no_slot;
+    }
+};
+
+namespace TimingWheelLayout {
+static constexpr uint8_t level_bits = 6;
+static constexpr uint8_t slots_per_level = 1 << level_bits;
+static constexpr uint8_t levels = (52 + level_bits - 1) / level_bits;
+static constexpr uint64_t slot_mask = slots_per_level - 1;
+static constexpr size_t batch_size = 64;
+} // namespace TimingWheelLayout
+
+/*
+ * Whole wheel bookkeeping as plain data: slot list heads and one occupancy
+ * bitmap per level. Kept apart from TimingWheel so it can be placed wherever
+ * the entries live.
+ */
+struct TimingWheelState
+{
+    uint64_t now = 0;
+    uint64_t size = 0;
+    std::array<uint64_t, TimingWheelLayout::levels> occupied{};
+    std::array<
+        std::array<uint32_t, TimingWheelLayout::slots_per_level>,
+        TimingWheelLayout::levels>
+        heads = []() {
+            std::array<
+                std::array<uint32_t, TimingWheelLayout::slots_per_level>,
+                TimingWheelLayout::levels>
+                output{};
+            for (auto &level : output) {
+                level.fill(TimerNode::no_index);
+            }
+            return output;
+        }();
+};
+
+/*
+ * Hierarchical timing wheel (Varghese & Lauck, scheme 7).
+ *
+ * Level L slot S holds the entries whose expiry differs from `now` first in
+ * the L-th group of `level_bits` bits, so schedule/cancel are O(1) and each
+ * entry is cascaded at most `levels` times over its lifetime. Advancing jumps
+ * straight to the next occupied slot using the per-level bitmaps.
+ */
+template <typename Entry, TimerNode Entry::*node_member>
+struct TimingWheel
+{
+    TimingWheel(std::span<Entry> entries, TimingWheelState &state)
+        : m_entries(entries), m_state(state)
+    {
+        assert(entries.size() < TimerNode::no_index);
+    }
+
+    uint64_t now() const
+    {
+        return m_state.now;
+    }
+
+    uint64_t size() const
+    {
+        return m_state.size;
+    }
+
+    bool is_scheduled(uint32_t index) const
+    {
+        return node(index).is_linked();
+    }
+
+    std::optional<uint64_t> expires(uint32_t index) const
+    {
+        const TimerNode &n = node(index);
+        if (!n.is_linked()) {
+            return std::nullopt;
+        }
+        return n.expires;
+    }
+
+    // Expiry at or before `now` fires on the next tick
+    void schedule(uint32_t index, uint64_t expires)
+    {
+        TimerNode &n = node(index);
+        if (n.is_linked()) {
+            unlink(index);
+        } else {
+            m_state.size++;
+        }
+
+        n.expires = std::max(expires, m_state.now + 1);
+        link(index);
+    }
+
+    bool cancel(uint32_t index)
+    {
+        if (!node(index).is_linked()) {
+            return false;
+        }
+        unlink(index);
+        m_state.size--;
+        return true;
+    }
+
+    // Lower bound of the next expiry, exact when the entry sits in level 0
+    std::optional<uint64_t> next_event() const
+    {
+        auto event = next_event_and_level();
+        if (!event) {
+            return std::nullopt;
+        }
+        return event->first;
+    }
+
+    /*
+     * Moves `now` to `target`, unlinking expired entries and handing them to
+     * `on_expired(std::span<const uint32_t>)` in batches. Entries are already
+     * unlinked when the callback runs, so it may reschedule them, and every
+     * other entry is linked, so it may cancel or reschedule those too. It
+     * may also call next_event() or advance() again.
+     */
+    template <typename F>
+    size_t advance(uint64_t target, F &&on_expired)
+    {
+        Batch batch{};
+        size_t nb_expired = 0;
+
+        while (m_state.now < target) {
+            auto event_opt = next_event_and_level();
+            if (!event_opt || event_opt->first > target) {
+                m_state.now = target;
+                break;
+            }
+
+            auto [event, level] = *event_opt;
+            m_state.now = event;
+
+            /*
+             * Slot boundaries of different levels never coincide with an
+             * occupied slot of a lower level, so exactly one level fires
+             */
+            drain_slot(level, batch, nb_expired, on_expired);
+        }
+
+        flush(batch, on_expired);
+        return nb_expired;
+    }
+
+  private:
+    struct Batch
+    {
+        std::array<uint32_t, TimingWheelLayout::batch_size> indices;
+        size_t size;
+    };
+
+    std::span<Entry> m_entries;
+    TimingWheelState &m_state;
+
+    TimerNode &node(uint32_t index)
+    {
+        return m_entries[index].*node_member;
+    }
+
+    const TimerNode &node(uint32_t index) const
+    {
+        return m_entries[index].*node_member;
+    }
+
+    static constexpr uint16_t slot_id(uint8_t level, uint8_t slot)
+    {
+        return level * TimingWheelLayout::slots_per_level + slot;
+    }
+
+    std::optional<std::pair<uint64_t, uint8_t>> next_event_and_level() const
+    {
+        std::optional<std::pair<uint64_t, uint8_t>> output;
+        for (uint8_t level = 0; level < TimingWheelLayout::levels; level++) {
+            auto event = next_event_at(level);
+            if (event && (!output || *event < output->first)) {
+                output = std::make_pair(*event, level);
+            }
+        }
+        return output;
+    }
+
+    std::optional<uint64_t> next_event_at(uint8_t level) const
+    {
+        uint64_t bitmap = m_state.occupied[level];
+        if (bitmap == 0) {
+            return std::nullopt;
+        }
+
+        uint8_t shift = level * TimingWheelLayout::level_bits;
+        uint64_t base = m_state.now >> shift;
+        uint8_t current = base & TimingWheelLayout::slot_mask;
+
+        /*
+         * Occupied slots are ahead of the current one, which only holds
+         * entries while drain_slot() hands out a batch: those are due now
+         */
+        uint64_t ahead = bitmap & ~((uint64_t(1) << current) - 1);
+        assert(ahead == bitmap);
+        uint8_t slot = std::countr_zero(ahead);
+
+        uint64_t event = (base & ~TimingWheelLayout::slot_mask) | slot;
+        return event << shift;
+    }
+
+    void link(uint32_t index)
+    {
+        TimerNode &n = node(index);
+        uint64_t diff = n.expires ^ m_state.now;
+        assert(diff != 0);
+
+        uint8_t level =
+            (std::bit_width(diff) - 1) / TimingWheelLayout::level_bits;
+        uint8_t slot = (n.expires >> (level * TimingWheelLayout::level_bits)) &
+                       TimingWheelLayout::slot_mask;
+
+        uint32_t &head = m_state.heads[level][slot];
+        n.prev = TimerNode::no_index;
+        n.next = head;
+        if (head != TimerNode::no_index) {
+            node(head).prev = index;
+        }
+        head = index;
+        n.slot = slot_id(level, slot);
+        m_state.occupied[level] |= uint64_t(1) << slot;
+    }
+
+    void unlink(uint32_t index)
+    {
+        TimerNode &n = node(index);
+        uint8_t level = n.slot / TimingWheelLayout::slots_per_level;
+        uint8_t slot = n.slot % TimingWheelLayout::slots_per_level;
+
+        if (n.prev != TimerNode::no_index) {
+            node(n.prev).next = n.next;
+        } else {
+            m_state.heads[level][slot] = n.next;
+        }
+
+        if (n.next != TimerNode::no_index) {
+            node(n.next).prev = n.prev;
+        }
+
+        if (m_state.heads[level][slot] == TimerNode::no_index) {
+            m_state.occupied[level] &= ~(uint64_t(1) << slot);
+        }
+
+        n.next = TimerNode::no_index;
+        n.prev = TimerNode::no_index;
+        n.slot = TimerNode::no_slot;
+    }
+
+    uint32_t detach_slot(uint8_t level, uint8_t slot)
+    {
+        uint32_t head = m_state.heads[level][slot];
+        m_state.heads[level][slot] = TimerNode::no_index;
+        m_state.occupied[level] &= ~(uint64_t(1) << slot);
+        return head;
+    }
+
+    // Gives the rest of a detached chain back to its slot
+    void reattach_slot(uint8_t level, uint8_t slot, uint32_t head)
+    {
+        if (head == TimerNode::no_index) {
+            return;
+        }
+        m_state.heads[level][slot] = head;
+        m_state.occupied[level] |= uint64_t(1) << slot;
+    }
+
+    /*
+     * Expires the entries of the current slot of `level` and cascades the
+     * others down. Before a full batch is handed out the unvisited part of
+     * the chain goes back to its slot, where next_event() sees it as due
+     * now, so the callback may touch any entry or the wheel itself.
+     * Nothing scheduled meanwhile lands in that slot: it matches `now` at
+     * `level`, so a later expiry differs first at a lower level.
+     */
+    template <typename F>
+    void drain_slot(
+        uint8_t level, Batch &batch, size_t &nb_expired, F &on_expired)
+    {
+        uint8_t shift = level * TimingWheelLayout::level_bits;
+        uint8_t slot = (m_state.now >> shift) & TimingWheelLayout::slot_mask;
+
+        uint32_t index = detach_slot(level, slot);
+        while (index != TimerNode::no_index) {
+            TimerNode &n = node(index);
+            uint32_t next = n.next;
+            if (next != TimerNode::no_index) {
+                node(next).prev = TimerNode::no_index;
+            }
+
+            if (n.expires <= m_state.now) {
+                assert(level != 0 || n.expires == m_state.now);
+                n.next = TimerNode::no_index;
+                n.prev = TimerNode::no_index;
+                n.slot = TimerNode::no_slot;
+                m_state.size--;
+                batch.indices[batch.size++] = index;
+                nb_expired++;
+            } else {
+                link(index);
+            }
+            index = next;
+
+            if (batch.size == batch.indices.size()) {
+                uint64_t now = m_state.now;
+                reattach_slot(level, slot, index);
+                flush(batch, on_expired);
+                // A nested advance() went past this slot, draining it first
+                if (m_state.now != now) {
+                    return;
+                }
+                index = detach_slot(level, slot);
+            }
+        }
+    }
+
+    template <typename F>
+    static void flush(Batch &batch, F &on_expired)
+    {
+        if (batch.size == 0) {
+            return;
+        }
+        on_expired(std::span<const uint32_t>(batch.indices.data(), batch.size));
+        batch.size = 0;
+    }
+};
+
+/*
+ * Tick counter refreshed by one thread (usually the event loop, once per
+ * batch) and read by everyone else with a relaxed load instead of a clock
+ * syscall per packet. Backed by CLOCK_MONOTONIC_COARSE.
+ */
+struct CoarseClock
+{
+    CoarseClock(std::chrono::nanoseconds tick) : m_tick(tick)
+    {
+        assert(tick.count() > 0);
+        refresh();
+    }
+
+    std::chrono::nanoseconds tick() const
+    {
+        return m_tick;
+    }
+
+    uint64_t now() const
+    {
+        return m_now.load(std::memory_order_relaxed);
+    }
+
+    uint64_t refresh()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        auto elapsed = std::chrono::seconds(ts.tv_sec) +
+                       std::chrono::nanoseconds(ts.tv_nsec);
+        uint64_t ticks = elapsed / m_tick;
+        m_now.store(ticks, std::memory_order_relaxed);
+        return ticks;
+    }
+
+    template <typename Rep, typename Period>
+    uint64_t ticks_from_now(std::chrono::duration<Rep, Period> d) const
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d);
+        return now() + (ns + m_tick - std::chrono::nanoseconds(1)) / m_tick;
+    }
+
+  private:
+    std::chrono::nanoseconds m_tick;
+    std::atomic<uint64_t> m_now{0};
+};
+
+} // namespace xnet
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/DHCP.hh>
+#include <xnet/Hash.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/Sketch.hh>
+
+namespace xnet {
+
+struct TopTalkersConfig
+{
+    // Count-Min columns per key kind, error bound is total / width
+    size_t width = 4096;
+    size_t top_k = 64;
+};
+
+struct TopTalkersSnapshot
+{
+    template <typename Key>
+    using Entries = std::vector<typename SpaceSaving<Key>::Entry>;
+
+    Entries<IPv4::Address> sources;
+    Entries<DHCP::ClientHardwareAddr> clients;
+    Entries<IPv4::Address> relays;
+    uint64_t packets = 0;
+};
+
+/*
+ * Who sends the traffic: IPv4 sources, DHCP chaddr and relay giaddr, in
+ * fixed memory. One instance per thread, folded into a TopTalkersTotal.
+ */
+struct TopTalkers
+{
+    TopTalkers(const TopTalkersConfig &config = {})
+        : m_sources(config.width, config.top_k),
+          m_clients(config.width, config.top_k),
+          m_relays(config.width, config.top_k)
+    {
+    }
+
+    void observe(const IPv4::HeaderView &header)
+    {
+        if (auto source = header.source_address()) {
+            observe_source(*source);
+        }
+    }
+
+    // Datagram sockets only hand out the peer address
+    void observe_source(IPv4::Address source)
+    {
+        m_sources.add(source, hash(source));
+    }
+
+    // Relayed requests only count towards a relay
+    void observe(const DHCP::HeaderView &header)
+    {
+        if (header.not_safe_to_parse()) {
+            return;
+        }
+
+        DHCP::ClientHardwareAddr chaddr = header.chaddr_unsafe();
+        m_clients.add(chaddr, DHCP::hash(chaddr));
+
+        IPv4::Address giaddr = header.giaddr_unsafe();
+        if (giaddr != IPv4::Address()) {
+            m_relays.add(giaddr, hash(giaddr));
+        }
+    }
+
+    uint64_t source_estimate(IPv4::Address source) const
+    {
+        return m_sources.estimate(hash(source));
+    }
+
+    uint64_t client_estimate(const DHCP::ClientHardwareAddr &chaddr) const
+    {
+        return m_clients.estimate(DHCP::hash(chaddr));
+    }
+
+    uint64_t relay_estimate(IPv4::Address relay) const
+    {
+        return m_relays.estimate(hash(relay));
+    }
+
+    // Instances must share a config
+    void merge(const TopTalkers &other)
+    {
+        m_sources.merge(other.m_sources);
+        m_clients.merge(other.m_clients);
+        m_relays.merge(other.m_relays);
+    }
+
+    void clear()
+    {
+        m_sources.clear();
+        m_clients.clear();
+        m_relays.clear();
+    }
+
+    TopTalkersSnapshot snapshot() const
+    {
+        TopTalkersSnapshot output;
+        output.sources = m_sources.top();
+        output.clients = m_clients.top();
+        output.relays = m_relays.top();
+        output.packets = std::max(m_sources.total(), m_clients.total());
+        return output;
+    }
+
+  private:
+    HeavyHitters<IPv4::Address> m_sources;
+    HeavyHitters<DHCP::ClientHardwareAddr> m_clients;
+    HeavyHitters<IPv4::Address> m_relays;
+
+    static uint64_t hash(IPv4::Address a)
+    {
+        return mix64(betoh<uint32_t>(a.data_msbf()));
+    }
+};
+
+/*
+ * Aggregate of per-thread TopTalkers. Threads publish every so often, which
+ * moves their counts here, readers take snapshots. Only publish and
+ * snapshot lock, the per packet path stays thread local.
+ */
+struct TopTalkersTotal
+{
+    TopTalkersTotal(const TopTalkersConfig &config = {}) : m_total(config)
+    {
+    }
+
+    void publish(TopTalkers &local)
+    {
+        std::lock_guard lock(m_mutex);
+        m_total.merge(local);
+        local.clear();
+    }
+
+    TopTalkersSnapshot snapshot() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_total.snapshot();
+    }
+
+    // Starts a new observation window
+    void reset()
+    {
+        std::lock_guard lock(m_mutex);
+        m_total.clear();
+    }
+
+  private:
+    mutable std::mutex m_mutex;
+    TopTalkers m_total;
+};
+
+} // namespace xnet
@@ -0,0 +1,430 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <time.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/EgressScheduler.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/IPv4TOS.hh>
+#include <xnet/TimingWheel.hh>
+
+namespace xnet {
+
+struct ShaperNodeConfig
+{
+    static constexpr uint32_t no_parent = std::numeric_limits<uint32_t>::max();
+
+    // Must come before the node in ShaperConfig::nodes
+    uint32_t parent = no_parent;
+    uint64_t rate_bps = 1'000'000'000;
+    // Bucket depth, at least the largest packet
+    uint64_t burst_bytes = 64 * 1024;
+    // Packets queued on a leaf before tail drop
+    uint32_t capacity = 4096;
+};
+
+// Matches when both the prefix and, if set, the DSCP match
+struct ShaperRule
+{
+    IPv4::Address prefix{};
+    uint8_t prefix_length = 0;
+    std::optional<uint8_t> dscp;
+    uint32_t node = 0;
+};
+
+struct ShaperConfig
+{
+    std::vector<ShaperNodeConfig> nodes;
+    // First match wins, unmatched packets go to `default_node`
+    std::vector<ShaperRule> rules;
+    uint32_t default_node = 0;
+    // Release granularity
+    std::chrono::nanoseconds tick{10'000};
+};
+
+struct ShaperNodeStats
+{
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t dropped = 0;
+    // Times the leaf waited for tokens on its path
+    uint64_t throttled = 0;
+    size_t queued = 0;
+};
+
+/*
+ * Hierarchical token bucket shaper. Nodes form a tree, a packet queued on a
+ * leaf leaves once every bucket from the leaf to the root holds its size,
+ * so leaves are capped by their own rate and share their ancestors' rates.
+ *
+ * A leaf whose head packet lacks tokens sleeps on a TimingWheel until the
+ * slowest bucket on its path has refilled. When that bucket is an
+ * ancestor's, the leaf waits in the ancestor's FIFO instead and the
+ * ancestor sleeps, so siblings starved by a busy one get the refill in turn.
+ * Ready leaves take turns one packet at a time. release() is the only place
+ * time moves, call it at least every tick. Packets are caller owned
+ * EgressPackets, as for the EgressScheduler the shaper may feed.
+ */
+struct TrafficShaper
+{
+    static std::optional<TrafficShaper> create(const ShaperConfig &config)
+    {
+        size_t nb_nodes = config.nodes.size();
+        if (nb_nodes == 0 || nb_nodes >= TimerNode::no_index ||
+            config.tick.count() <= 0) {
+            return std::nullopt;
+        }
+
+        std::vector<bool> is_parent(nb_nodes);
+        for (uint32_t idx = 0; idx < nb_nodes; idx++) {
+            const ShaperNodeConfig &n = config.nodes[idx];
+            if (n.rate_bps == 0 || n.burst_bytes == 0 || n.capacity == 0) {
+                return std::nullopt;
+            }
+            if (n.parent != ShaperNodeConfig::no_parent) {
+                if (n.parent >= idx) {
+                    return std::nullopt;
+                }
+                is_parent[n.parent] = true;
+            }
+        }
+
+        auto is_leaf = [&](uint32_t node) {
+            return node < nb_nodes && !is_parent[node];
+        };
+        if (!is_leaf(config.default_node)) {
+            return std::nullopt;
+        }
+        for (const ShaperRule &rule : config.rules) {
+            if (!is_leaf(rule.node) || rule.prefix_length > 32 ||
+                (rule.dscp && *rule.dscp >= 64)) {
+                return std::nullopt;
+            }
+        }
+        return TrafficShaper(config, is_parent);
+    }
+
+    TrafficShaper(TrafficShaper &&other) = default;
+
+    const ShaperNodeStats &stats(uint32_t node) const
+    {
+        return m_nodes[node].stats;
+    }
+
+    size_t queued() const
+    {
+        return m_queued;
+    }
+
+    std::optional<uint32_t> classify(const IPv4::HeaderView &header) const
+    {
+        auto destination = header.destination_address();
+        auto tos = header.type_of_service();
+        if (!destination || !tos) {
+            return std::nullopt;
+        }
+
+        uint32_t address = betoh<uint32_t>(destination->data_msbf());
+        uint8_t dscp = IPv4::TypeOfService(*tos).dscp();
+        for (const Rule &rule : m_rules) {
+            if ((address & rule.mask) == rule.prefix &&
+                (!rule.dscp || *rule.dscp == dscp)) {
+                return rule.node;
+            }
+        }
+        return m_config.default_node;
+    }
+
+    // `packet.data` starts with the IPv4 header it is classified by
+    bool enqueue(const EgressPacket &packet)
+    {
+        auto leaf = classify(IPv4::HeaderView(packet.data));
+        if (!leaf) {
+            return false;
+        }
+        return enqueue(packet, *leaf);
+    }
+
+    bool enqueue(const EgressPacket &packet, uint32_t leaf)
+    {
+        Node &n = m_nodes[leaf];
+        if (n.ring.empty()) {
+            return false;
+        }
+        if (n.tail - n.head == n.config.capacity ||
+            packet.data.size() > m_max_packet[leaf]) {
+            n.stats.dropped++;
+            return false;
+        }
+
+        n.ring[n.tail++ & n.mask] = packet;
+        n.stats.queued++;
+        m_queued++;
+        if (!n.ready && !n.waiting && !m_wheel.is_scheduled(leaf)) {
+            make_ready(leaf);
+        }
+        return true;
+    }
+
+    // Moves conforming packets to `output`, returns how many
+    size_t release(std::span<EgressPacket> output)
+    {
+        uint64_t now = monotonic_ns();
+        m_wheel.advance(now / m_tick_ns, [&](std::span<const uint32_t> idx) {
+            for (uint32_t node : idx) {
+                wake(node);
+            }
+        });
+
+        size_t nb_out = 0;
+        while (nb_out != output.size() && m_nb_ready != 0) {
+            uint32_t leaf = m_ready[m_ready_head];
+            m_ready_head = (m_ready_head + 1) % m_ready.size();
+            m_nb_ready--;
+            Node &n = m_nodes[leaf];
+            n.ready = false;
+
+            if (n.head == n.tail) {
+                continue;
+            }
+            const EgressPacket &packet = n.ring[n.head & n.mask];
+            uint32_t blocking = leaf;
+            uint64_t wait_ns = take(leaf, packet.data.size(), now, blocking);
+            if (wait_ns != 0) {
+                n.stats.throttled++;
+                sleep(leaf, blocking, (now + wait_ns) / m_tick_ns + 1);
+                continue;
+            }
+
+            output[nb_out++] = packet;
+            n.head++;
+            n.stats.queued--;
+            m_queued--;
+            if (n.head != n.tail) {
+                make_ready(leaf);
+            }
+        }
+        return nb_out;
+    }
+
+    // Earliest tick a sleeping leaf wakes at, nothing if none sleeps
+    std::optional<std::chrono::nanoseconds> next_release() const
+    {
+        if (m_nb_ready != 0) {
+            return std::chrono::nanoseconds(0);
+        }
+        auto event = m_wheel.next_event();
+        if (!event) {
+            return std::nullopt;
+        }
+        uint64_t now = monotonic_ns();
+        uint64_t at = *event * m_tick_ns;
+        return std::chrono::nanoseconds(at > now ? at - now : 0);
+    }
+
+  private:
+    static constexpr uint64_t ns_per_second = 1'000'000'000;
+
+    struct Node
+    {
+        ShaperNodeConfig config;
+        // Bits times ns_per_second, refilled by elapsed ns times rate_bps
+        uint64_t tokens = 0;
+        uint64_t depth = 0;
+        uint64_t updated = 0;
+
+        std::vector<EgressPacket> ring;
+        size_t mask = 0;
+        uint64_t head = 0;
+        uint64_t tail = 0;
+        bool ready = false;
+        bool waiting = false;
+
+        // Leaves waiting for this node's bucket, linked through next_waiter
+        uint32_t first_waiter = TimerNode::no_index;
+        uint32_t last_waiter = TimerNode::no_index;
+        uint32_t next_waiter = TimerNode::no_index;
+        TimerNode timer;
+        ShaperNodeStats stats;
+    };
+
+    struct Rule
+    {
+        uint32_t prefix;
+        uint32_t mask;
+        std::optional<uint8_t> dscp;
+        uint32_t node;
+    };
+
+    ShaperConfig m_config;
+    uint64_t m_tick_ns;
+    std::vector<Node> m_nodes;
+    std::vector<Rule> m_rules;
+    // Smallest burst on the path of each leaf, larger packets never leave
+    std::vector<uint64_t> m_max_packet;
+    std::vector<uint32_t> m_ready;
+    size_t m_ready_head = 0;
+    size_t m_nb_ready = 0;
+    size_t m_queued = 0;
+    // Heap allocated like the nodes, so the wheel survives moves
+    std::unique_ptr<TimingWheelState> m_wheel_state;
+    TimingWheel<Node, &Node::timer> m_wheel;
+
+    TrafficShaper(const ShaperConfig &config, const std::vector<bool> &parent)
+        : m_config(config), m_tick_ns(config.tick.count()),
+          m_nodes(config.nodes.size()), m_max_packet(config.nodes.size()),
+          m_ready(config.nodes.size()),
+          m_wheel_state(std::make_unique<TimingWheelState>()),
+          m_wheel(m_nodes, *m_wheel_state)
+    {
+        uint64_t now = monotonic_ns();
+        for (size_t idx = 0; idx < m_nodes.size(); idx++) {
+            Node &n = m_nodes[idx];
+            n.config = config.nodes[idx];
+            n.depth = n.config.burst_bytes * 8 * ns_per_second;
+            n.tokens = n.depth;
+            n.updated = now;
+            if (!parent[idx]) {
+                n.ring.resize(std::bit_ceil<size_t>(n.config.capacity));
+                n.mask = n.ring.size() - 1;
+            }
+
+            m_max_packet[idx] = n.config.burst_bytes;
+            if (n.config.parent != ShaperNodeConfig::no_parent) {
+                m_max_packet[idx] = std::min(
+                    m_max_packet[idx], m_max_packet[n.config.parent]);
+            }
+        }
+
+        for (const ShaperRule &rule : config.rules) {
+            uint32_t mask = rule.prefix_length == 0
+                                ? 0
+                                : ~uint32_t(0) << (32 - rule.prefix_length);
+            uint32_t prefix = betoh<uint32_t>(rule.prefix.data_msbf());
+            m_rules.push_back(Rule{prefix & mask, mask, rule.dscp, rule.node});
+        }
+        m_wheel_state->now = now / m_tick_ns;
+    }
+
+    static uint64_t monotonic_ns()
+    {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * ns_per_second + ts.tv_nsec;
+    }
+
+    void make_ready(uint32_t leaf)
+    {
+        Node &n = m_nodes[leaf];
+        if (n.ready) {
+            return;
+        }
+        n.ready = true;
+        m_ready[(m_ready_head + m_nb_ready++) % m_ready.size()] = leaf;
+    }
+
+    void sleep(uint32_t leaf, uint32_t blocking, uint64_t tick)
+    {
+        if (blocking == leaf) {
+            m_wheel.schedule(leaf, tick);
+            return;
+        }
+
+        Node &b = m_nodes[blocking];
+        m_nodes[leaf].waiting = true;
+        if (b.last_waiter == TimerNode::no_index) {
+            b.first_waiter = leaf;
+        } else {
+            m_nodes[b.last_waiter].next_waiter = leaf;
+        }
+        b.last_waiter = leaf;
+        if (!m_wheel.is_scheduled(blocking)) {
+            m_wheel.schedule(blocking, tick);
+        }
+    }
+
+    // A leaf's own timer, or an inner node releasing its waiters in order
+    void wake(uint32_t node)
+    {
+        Node &n = m_nodes[node];
+        if (!n.ring.empty()) {
+            make_ready(node);
+            return;
+        }
+
+        uint32_t leaf = std::exchange(n.first_waiter, TimerNode::no_index);
+        n.last_waiter = TimerNode::no_index;
+        while (leaf != TimerNode::no_index) {
+            Node &l = m_nodes[leaf];
+            l.waiting = false;
+            make_ready(leaf);
+            leaf = std::exchange(l.next_waiter, TimerNode::no_index);
+        }
+    }
+
+    // Elapsed time is capped at a full refill so the product cannot wrap
+    void refill(Node &n, uint64_t now)
+    {
+        if (now <= n.updated) {
+            return;
+        }
+        uint64_t elapsed = now - n.updated;
+        uint64_t to_full = (n.depth - n.tokens) / n.config.rate_bps + 1;
+        n.tokens += std::min(elapsed, to_full) * n.config.rate_bps;
+        n.tokens = std::min(n.tokens, n.depth);
+        n.updated = now;
+    }
+
+    /*
+     * Takes `size` bytes from every bucket on the leaf's path and returns 0,
+     * or takes nothing and returns how long the emptiest bucket, stored in
+     * `blocking`, needs
+     */
+    uint64_t
+        take(uint32_t leaf, size_t size, uint64_t now, uint32_t &blocking)
+    {
+        uint64_t need = uint64_t(size) * 8 * ns_per_second;
+        uint64_t wait_ns = 0;
+        for (uint32_t idx = leaf; idx != ShaperNodeConfig::no_parent;
+             idx = m_nodes[idx].config.parent) {
+            Node &n = m_nodes[idx];
+            refill(n, now);
+            if (n.tokens < need) {
+                uint64_t missing = need - n.tokens;
+                uint64_t node_wait =
+                    (missing + n.config.rate_bps - 1) / n.config.rate_bps;
+                if (node_wait > wait_ns) {
+                    wait_ns = node_wait;
+                    blocking = idx;
+                }
+            }
+        }
+        if (wait_ns != 0) {
+            return wait_ns;
+        }
+
+        for (uint32_t idx = leaf; idx != ShaperNodeConfig::no_parent;
+             idx = m_nodes[idx].config.parent) {
+            Node &n = m_nodes[idx];
+            n.tokens -= need;
+            n.stats.packets++;
+            n.stats.bytes += size;
+        }
+        return 0;
+    }
+};
+
+} // namespace xnet
@@ -0,0 +1,441 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <poll.h>
+
+#include <xnet/Hash.hh>
+#include <xnet/Task.hh>
+#include <xnet/TimingWheel.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::UDP {
+
+struct AsyncConfig
+{
+    // Granularity of transaction timeouts
+    std::chrono::microseconds tick{1000};
+    uint32_t max_transactions = 1 << 17;
+};
+
+struct AsyncStats
+{
+    uint64_t received = 0;
+    uint64_t matched = 0;
+    uint64_t timeouts = 0;
+    // Transactions refused: key already outstanding or table full
+    uint64_t rejected = 0;
+    // Datagrams matching no transaction while nobody waited in recv_batch
+    uint64_t unclaimed = 0;
+    uint64_t sent = 0;
+    uint64_t send_errors = 0;
+};
+
+// Valid until the coroutine it was handed to suspends again
+struct AsyncDatagram
+{
+    std::span<const std::byte> payload;
+    Endpoint peer;
+};
+
+/*
+ * Awaitable request/response layer over one UDP socket, for protocols that
+ * correlate replies with a key carried in the payload (the DHCP xid).
+ *
+ *     co_await socket.send(request, server);
+ *     auto reply = co_await socket.transaction(xid, 2s);
+ *
+ * poll() drives everything from one thread: sends are gathered into one
+ * sendmmsg per round, datagrams arrive through recvmmsg and resume the
+ * transaction waiting on their key directly from the receive buffer, other
+ * datagrams go to the oldest recv_batch() waiter. Timeouts run on a
+ * TimingWheel, so outstanding transactions cost one table slot each and
+ * their coroutine frames come from the FramePool.
+ */
+struct AsyncSocket
+{
+    using Correlator = std::optional<uint32_t> (*)(std::span<const std::byte>);
+
+    static constexpr size_t batch_size = 64;
+    static constexpr size_t max_datagram_size = 1500;
+
+    AsyncSocket(
+        Socket socket, Correlator correlate, const AsyncConfig &config = {})
+        : m_socket(std::move(socket)), m_correlate(correlate),
+          m_clock(config.tick),
+          m_recv(std::make_unique<RecvBatch<batch_size>>()),
+          m_send_storage(std::make_unique<SendStorage>()),
+          m_transactions(config.max_transactions),
+          m_index(index_size(config.max_transactions), TimerNode::no_index),
+          m_wheel(m_transactions, m_wheel_state)
+    {
+        m_free.reserve(config.max_transactions);
+        for (uint32_t idx = config.max_transactions; idx-- > 0;) {
+            m_free.push_back(idx);
+        }
+        m_wheel_state.now = m_clock.now();
+    }
+
+    AsyncSocket(const AsyncSocket &) = delete;
+    AsyncSocket &operator=(const AsyncSocket &) = delete;
+
+    const Socket &socket() const
+    {
+        return m_socket;
+    }
+
+    const AsyncStats &stats() const
+    {
+        return m_stats;
+    }
+
+    size_t pending() const
+    {
+        return m_transactions.size() - m_free.size();
+    }
+
+    struct SendAwaiter
+    {
+        AsyncSocket &socket;
+        std::span<const std::byte> data;
+        Endpoint peer;
+        bool queued = false;
+
+        bool await_ready()
+        {
+            if (data.size() > max_datagram_size) {
+                return true;
+            }
+            queued = socket.queue(data, peer);
+            return queued;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            socket.m_blocked_senders.emplace_back(handle, this);
+        }
+
+        // False if the datagram does not fit a send slot
+        bool await_resume() const
+        {
+            return queued;
+        }
+    };
+
+    struct ReceiveAwaiter
+    {
+        AsyncSocket &socket;
+        std::span<const AsyncDatagram> batch;
+
+        bool await_ready() const
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            socket.m_receivers.emplace_back(handle, this);
+        }
+
+        std::span<const AsyncDatagram> await_resume() const
+        {
+            return batch;
+        }
+    };
+
+    struct TransactionAwaiter
+    {
+        AsyncSocket &socket;
+        uint32_t key;
+        uint64_t expires;
+        std::optional<AsyncDatagram> reply;
+
+        bool await_ready() const
+        {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            return socket.open_transaction(*this, handle);
+        }
+
+        // Empty on timeout or when the transaction could not be opened
+        std::optional<AsyncDatagram> await_resume() const
+        {
+            return reply;
+        }
+    };
+
+    // Copies `data`, waits only while the send batch is full
+    SendAwaiter send(std::span<const std::byte> data, const Endpoint &peer)
+    {
+        return SendAwaiter{*this, data, peer};
+    }
+
+    // Next datagrams no transaction claimed
+    ReceiveAwaiter recv_batch()
+    {
+        return ReceiveAwaiter{*this, {}};
+    }
+
+    /*
+     * Waits for the datagram whose key is `key`. Suspending registers the
+     * transaction, so awaiting right after queueing the request cannot miss
+     * the reply.
+     */
+    template <typename Rep, typename Period>
+    TransactionAwaiter
+        transaction(uint32_t key, std::chrono::duration<Rep, Period> timeout)
+    {
+        return TransactionAwaiter{
+            *this, key, m_clock.ticks_from_now(timeout), std::nullopt};
+    }
+
+    /*
+     * One round: flushes sends, waits up to `timeout` (or the next
+     * transaction timeout) for datagrams, dispatches one batch and fires
+     * expired transactions. Returns the number of datagrams received.
+     */
+    std::optional<size_t> poll(std::chrono::milliseconds timeout)
+    {
+        flush();
+        expire();
+
+        int64_t wait_ms = timeout.count();
+        if (auto next = m_wheel.next_event()) {
+            auto until = (*next - m_wheel.now()) * m_clock.tick();
+            auto until_ms =
+                std::chrono::ceil<std::chrono::milliseconds>(until).count();
+            wait_ms = std::min<int64_t>(wait_ms, until_ms);
+        }
+        if (wait_ms > 0) {
+            pollfd pfd{m_socket.fd(), POLLIN, 0};
+            if (::poll(&pfd, 1, wait_ms) < 0 && errno != EINTR) {
+                return std::nullopt;
+            }
+        }
+
+        auto received = m_socket.recv_batch(*m_recv, false);
+        if (!received) {
+            return std::nullopt;
+        }
+        dispatch();
+        expire();
+        flush();
+        return *received;
+    }
+
+  private:
+    struct Transaction
+    {
+        TimerNode timer;
+        uint32_t key = 0;
+        std::coroutine_handle<> handle;
+        TransactionAwaiter *awaiter = nullptr;
+    };
+
+    using SendStorage =
+        std::array<std::array<std::byte, max_datagram_size>, batch_size>;
+
+    Socket m_socket;
+    Correlator m_correlate;
+    CoarseClock m_clock;
+    AsyncStats m_stats;
+
+    std::unique_ptr<RecvBatch<batch_size>> m_recv;
+    std::array<AsyncDatagram, batch_size> m_unclaimed{};
+    std::deque<std::pair<std::coroutine_handle<>, ReceiveAwaiter *>>
+        m_receivers;
+
+    SendBatch<batch_size> m_send;
+    std::unique_ptr<SendStorage> m_send_storage;
+    std::deque<std::pair<std::coroutine_handle<>, SendAwaiter *>>
+        m_blocked_senders;
+
+    std::vector<Transaction> m_transactions;
+    std::vector<uint32_t> m_free;
+    // Open addressing over transaction indices, keyed by mix64(key)
+    std::vector<uint32_t> m_index;
+    TimingWheelState m_wheel_state;
+    TimingWheel<Transaction, &Transaction::timer> m_wheel;
+    std::vector<std::coroutine_handle<>> m_expired;
+
+    bool queue(std::span<const std::byte> data, const Endpoint &peer)
+    {
+        if (m_send.full()) {
+            return false;
+        }
+        auto &slot = (*m_send_storage)[m_send.size()];
+        std::memcpy(slot.data(), data.data(), data.size());
+        return m_send.push(std::span(slot).first(data.size()), peer);
+    }
+
+    // Blocked senders take the freed slots and may queue more
+    void flush()
+    {
+        while (m_send.size() != 0) {
+            size_t size = m_send.size();
+            size_t nb_sent = m_socket.send_batch(m_send);
+            m_stats.sent += nb_sent;
+            m_stats.send_errors += size - nb_sent;
+
+            std::vector<std::coroutine_handle<>> unblocked;
+            while (!m_blocked_senders.empty() && !m_send.full()) {
+                auto [handle, awaiter] = m_blocked_senders.front();
+                m_blocked_senders.pop_front();
+                awaiter->queued = queue(awaiter->data, awaiter->peer);
+                unblocked.push_back(handle);
+            }
+            for (auto handle : unblocked) {
+                handle.resume();
+            }
+        }
+    }
+
+    static size_t index_size(size_t capacity)
+    {
+        return std::bit_ceil(std::max<size_t>(16, capacity * 2));
+    }
+
+    size_t mask() const
+    {
+        return m_index.size() - 1;
+    }
+
+    uint32_t find(uint32_t key) const
+    {
+        for (size_t pos = mix64(key) & mask();; pos = (pos + 1) & mask()) {
+            uint32_t t_idx = m_index[pos];
+            if (t_idx == TimerNode::no_index ||
+                m_transactions[t_idx].key == key) {
+                return t_idx;
+            }
+        }
+    }
+
+    void insert(uint32_t key, uint32_t t_idx)
+    {
+        size_t pos = mix64(key) & mask();
+        while (m_index[pos] != TimerNode::no_index) {
+            pos = (pos + 1) & mask();
+        }
+        m_index[pos] = t_idx;
+    }
+
+    // Backward shift deletion, as in the lease table index
+    void erase(uint32_t key)
+    {
+        size_t pos = mix64(key) & mask();
+        while (m_transactions[m_index[pos]].key != key) {
+            pos = (pos + 1) & mask();
+        }
+
+        size_t hole = pos;
+        for (size_t next = (hole + 1) & mask();
+             m_index[next] != TimerNode::no_index;
+             next = (next + 1) & mask()) {
+            size_t home = mix64(m_transactions[m_index[next]].key) & mask();
+            bool movable = ((next - home) & mask()) >= ((next - hole) & mask());
+            if (movable) {
+                m_index[hole] = m_index[next];
+                hole = next;
+            }
+        }
+        m_index[hole] = TimerNode::no_index;
+    }
+
+    bool open_transaction(
+        TransactionAwaiter &awaiter, std::coroutine_handle<> handle)
+    {
+        if (m_free.empty() || find(awaiter.key) != TimerNode::no_index) {
+            m_stats.rejected++;
+            return false;
+        }
+
+        uint32_t idx = m_free.back();
+        m_free.pop_back();
+        Transaction &t = m_transactions[idx];
+        t.key = awaiter.key;
+        t.handle = handle;
+        t.awaiter = &awaiter;
+        insert(awaiter.key, idx);
+        m_wheel.schedule(idx, awaiter.expires);
+        return true;
+    }
+
+    std::coroutine_handle<> close_transaction(uint32_t idx)
+    {
+        Transaction &t = m_transactions[idx];
+        erase(t.key);
+        m_free.push_back(idx);
+        return std::exchange(t.handle, {});
+    }
+
+    void dispatch()
+    {
+        size_t nb_unclaimed = 0;
+        for (size_t idx = 0; idx < m_recv->size(); idx++) {
+            AsyncDatagram datagram{m_recv->payload(idx), m_recv->peer(idx)};
+            m_stats.received++;
+
+            auto key = m_correlate(datagram.payload);
+            uint32_t t_idx = key ? find(*key) : TimerNode::no_index;
+            if (t_idx == TimerNode::no_index) {
+                m_unclaimed[nb_unclaimed++] = datagram;
+                continue;
+            }
+
+            m_wheel.cancel(t_idx);
+            m_transactions[t_idx].awaiter->reply = datagram;
+            m_stats.matched++;
+            close_transaction(t_idx).resume();
+        }
+
+        if (nb_unclaimed == 0) {
+            return;
+        }
+        if (m_receivers.empty()) {
+            m_stats.unclaimed += nb_unclaimed;
+            return;
+        }
+        auto [handle, awaiter] = m_receivers.front();
+        m_receivers.pop_front();
+        awaiter->batch =
+            std::span<const AsyncDatagram>(m_unclaimed).first(nb_unclaimed);
+        handle.resume();
+    }
+
+    // Resumes after the wheel is done, the waiters may open new transactions
+    void expire()
+    {
+        m_wheel.advance(m_clock.refresh(), [&](std::span<const uint32_t> idx) {
+            for (uint32_t t_idx : idx) {
+                m_expired.push_back(close_transaction(t_idx));
+            }
+            m_stats.timeouts += idx.size();
+        });
+
+        auto expired = std::exchange(m_expired, {});
+        for (auto handle : expired) {
+            handle.resume();
+        }
+    }
+};
+
+} // namespace xnet::UDP
@@ -1,7 +1,7 @@
+#pragma once
+
 #include <algorithm>
 #include <array>
-#include <format>
-#include <iostream>
 #include <iterator>
 #include <limits>
 #include <optional>
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <span>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <netinet/in.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/Checksum.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/UDP.hh>
+#include <xnet/UDPChecksum.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::UDP {
+
+/*
+ * Flows are the product of the address and port ranges, each range starts
+ * at the endpoint and steps by one
+ */
+struct GeneratorConfig
+{
+    Endpoint source{IPv4::Address(10, 0, 0, 1), 1024};
+    Endpoint destination{IPv4::Address(10, 0, 0, 2), 9};
+    uint32_t nb_sources = 1;
+    uint32_t nb_source_ports = 1;
+    uint32_t nb_destinations = 1;
+    uint32_t nb_destination_ports = 1;
+
+    // 60 byte Ethernet frames, the minimum
+    uint16_t payload_size = 18;
+    // Big-endian packet counter in the first 8 payload bytes
+    bool sequence = true;
+    uint8_t time_to_live = 64;
+    uint8_t type_of_service = 0;
+};
+
+/*
+ * IPv4/UDP datagram of the first flow with the sums of everything that
+ * never changes: the IPv4 header without addresses, and the pseudo header,
+ * UDP header and payload without addresses, ports and sequence. Built
+ * through IPv4::serialize and create_valid_header, so constant configs
+ * yield constant templates.
+ */
+struct GeneratorTemplate
+{
+    static constexpr size_t max_size = 1500;
+    static constexpr size_t udp_offset = IPv4::minimal_header_size;
+    static constexpr size_t payload_offset = udp_offset + header_size;
+
+    std::array<std::byte, max_size> data{};
+    size_t size = 0;
+    uint16_t ip_sum = 0;
+    uint16_t udp_sum = 0;
+
+    static constexpr GeneratorTemplate make(const GeneratorConfig &config)
+    {
+        GeneratorTemplate output;
+        size_t payload_size = std::min<size_t>(
+            config.payload_size, max_size - payload_offset);
+        auto payload =
+            std::span(output.data).subspan(payload_offset, payload_size);
+
+        HeaderCreateInfo udp_info;
+        udp_info.pseudo_source = config.source.address;
+        udp_info.pseudo_destination = config.destination.address;
+        udp_info.pseudo_protocol = IPPROTO_UDP;
+        udp_info.source_port = config.source.port;
+        udp_info.destination_port = config.destination.port;
+        udp_info.data = payload;
+        Header udp = create_valid_header(udp_info).value();
+
+        IPv4::Header ip{};
+        ip.header_size = IPv4::minimal_header_size;
+        ip.TOS_or_DS = config.type_of_service;
+        ip.total_size = udp_offset + udp.length;
+        ip.flags = IPv4::Flags(0b010);
+        ip.time_to_live = config.time_to_live;
+        ip.protocol = IPPROTO_UDP;
+        ip.source_address = config.source.address;
+        ip.destination_address = config.destination.address;
+        ip.checksum = IPv4::compute_checksum(ip);
+        auto ip_data = IPv4::serialize(ip);
+        std::ranges::copy(ip_data, output.data.begin());
+
+        auto udp_data = std::span(output.data).subspan(udp_offset);
+        store_be<uint16_t>(udp_data, 0, udp.source_port);
+        store_be<uint16_t>(udp_data, 2, udp.destination_port);
+        store_be<uint16_t>(udp_data, 4, udp.length);
+        store_be<uint16_t>(udp_data, 6, udp.checksumm);
+        output.size = ip.total_size;
+
+        // Varying fields are zero here, so they drop out of the sums
+        ip.source_address = IPv4::Address();
+        ip.destination_address = IPv4::Address();
+        ip.checksum = 0;
+        output.ip_sum = Checksum::fold(Checksum::add(0, IPv4::serialize(ip)));
+
+        uint64_t sum = IPPROTO_UDP + uint64_t(udp.length) * 2;
+        sum = Checksum::add(sum, payload);
+        output.udp_sum = Checksum::fold(sum);
+        return output;
+    }
+};
+
+/*
+ * Writes flows round robin into slots that already hold the template, so a
+ * packet costs the stores of its varying fields and both checksums, summed
+ * from the template's precomputed part.
+ *
+ *     PacketGenerator generator(config);
+ *     generator.prepare(slots, slot_size);
+ *     for (;;) {
+ *         generator.fill(slots, slot_size, batch);
+ *         socket.send_batch(batch);
+ *     }
+ *
+ * Slots suit sendmmsg on an IPv4::RawSocket as well as io_uring fixed
+ * buffers, the generator never touches bytes outside the varying fields.
+ */
+struct PacketGenerator
+{
+    PacketGenerator(const GeneratorConfig &config)
+        : PacketGenerator(config, GeneratorTemplate::make(config))
+    {
+    }
+
+    PacketGenerator(
+        const GeneratorConfig &config, const GeneratorTemplate &t)
+        : m_config(config), m_template(t),
+          m_source(to_u32(config.source.address)),
+          m_destination(to_u32(config.destination.address))
+    {
+        assert(config.nb_sources != 0 && config.nb_source_ports != 0);
+        assert(config.nb_destinations != 0);
+        assert(config.nb_destination_ports != 0);
+        size_t sequence_end =
+            GeneratorTemplate::payload_offset + sizeof(uint64_t);
+        m_sequence_enabled = config.sequence && m_template.size >= sequence_end;
+    }
+
+    const GeneratorTemplate &packet_template() const
+    {
+        return m_template;
+    }
+
+    size_t packet_size() const
+    {
+        return m_template.size;
+    }
+
+    uint64_t sequence() const
+    {
+        return m_sequence;
+    }
+
+    // Copies the template into every `slot_size` slot of `slots`, once
+    void prepare(std::span<std::byte> slots, size_t slot_size) const
+    {
+        assert(slot_size >= m_template.size);
+        for (size_t offset = 0; offset + slot_size <= slots.size();
+             offset += slot_size) {
+            std::memcpy(
+                slots.data() + offset, m_template.data.data(), m_template.size);
+        }
+    }
+
+    // Turns a prepared slot into the next packet, returns its destination
+    Endpoint next(std::span<std::byte> slot)
+    {
+        uint32_t source = m_source + m_source_idx;
+        uint32_t destination = m_destination + m_destination_idx;
+        uint16_t source_port = m_config.source.port + m_source_port_idx;
+        uint16_t destination_port =
+            m_config.destination.port + m_destination_port_idx;
+
+        uint64_t addresses = source >> 16;
+        addresses += source & 0xffff;
+        addresses += destination >> 16;
+        addresses += destination & 0xffff;
+
+        store_be<uint32_t>(slot, 12, source);
+        store_be<uint32_t>(slot, 16, destination);
+        uint16_t ip_checksum =
+            Checksum::finish(uint64_t(m_template.ip_sum) + addresses);
+        store_be<uint16_t>(slot, 10, ip_checksum);
+
+        auto udp = slot.subspan(GeneratorTemplate::udp_offset);
+        store_be<uint16_t>(udp, 0, source_port);
+        store_be<uint16_t>(udp, 2, destination_port);
+
+        uint64_t sum = m_template.udp_sum + addresses;
+        sum += source_port;
+        sum += destination_port;
+        if (m_sequence_enabled) {
+            store_be<uint64_t>(udp, header_size, m_sequence);
+            sum += m_sequence >> 48;
+            sum += (m_sequence >> 32) & 0xffff;
+            sum += (m_sequence >> 16) & 0xffff;
+            sum += m_sequence & 0xffff;
+        }
+        uint16_t checksum = Checksum::udp_nonzero(Checksum::finish(sum));
+        store_be<uint16_t>(udp, 6, checksum);
+
+        m_sequence++;
+        advance();
+
+        std::array<std::byte, 4> address{};
+        store_be<uint32_t>(address, 0, destination);
+        return Endpoint{IPv4::Address(address), destination_port};
+    }
+
+    /*
+     * Fills the prepared slots of `slots` and queues them on `batch` until
+     * either runs out, returns the number queued
+     */
+    template <size_t capacity>
+    size_t fill(
+        std::span<std::byte> slots,
+        size_t slot_size,
+        SendBatch<capacity> &batch)
+    {
+        size_t nb_queued = 0;
+        for (size_t offset = batch.size() * slot_size;
+             !batch.full() && offset + slot_size <= slots.size();
+             offset += slot_size) {
+            auto slot = slots.subspan(offset, m_template.size);
+            batch.push(slot, next(slot));
+            nb_queued++;
+        }
+        return nb_queued;
+    }
+
+  private:
+    GeneratorConfig m_config;
+    GeneratorTemplate m_template;
+    uint32_t m_source;
+    uint32_t m_destination;
+    bool m_sequence_enabled = false;
+    uint64_t m_sequence = 0;
+
+    uint32_t m_source_idx = 0;
+    uint32_t m_source_port_idx = 0;
+    uint32_t m_destination_idx = 0;
+    uint32_t m_destination_port_idx = 0;
+
+    static uint32_t to_u32(IPv4::Address address)
+    {
+        return betoh<uint32_t>(address.data_msbf());
+    }
+
+    // Odometer over the four ranges, source address turning fastest
+    void advance()
+    {
+        if (++m_source_idx != m_config.nb_sources) {
+            return;
+        }
+        m_source_idx = 0;
+        if (++m_source_port_idx != m_config.nb_source_ports) {
+            return;
+        }
+        m_source_port_idx = 0;
+        if (++m_destination_idx != m_config.nb_destinations) {
+            return;
+        }
+        m_destination_idx = 0;
+        if (++m_destination_port_idx != m_config.nb_destination_ports) {
+            return;
+        }
+        m_destination_port_idx = 0;
+    }
+};
+
+} // namespace xnet::UDP
@@ -0,0 +1,490 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/Hash.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/MutablePacketView.hh>
+#include <xnet/TimingWheel.hh>
+
+namespace xnet::UDP {
+
+struct NatConfig
+{
+    // Source of every translated outbound packet
+    IPv4::Address external_address{};
+    uint16_t port_min = 1024;
+    uint16_t port_max = 65535;
+
+    uint32_t max_flows = 1 << 20;
+    std::chrono::milliseconds timeout{30000};
+    std::chrono::milliseconds tick{100};
+};
+
+struct NatStats
+{
+    uint64_t outbound = 0;
+    uint64_t inbound = 0;
+    uint64_t created = 0;
+    uint64_t expired = 0;
+    // Not UDP, a non-first fragment or failing validation
+    uint64_t malformed = 0;
+    // Inbound packets matching no flow
+    uint64_t unmatched = 0;
+    uint64_t table_full = 0;
+    uint64_t no_port = 0;
+};
+
+/*
+ * Endpoint dependent UDP NAT. A flow is the internal endpoint talking to one
+ * remote endpoint and owns one external port, which is only unique per
+ * remote endpoint, so a single external address carries millions of flows.
+ *
+ * Flows live in a fixed array sized by max_flows, found through two open
+ * addressing indices (internal 5-tuple, external port + remote endpoint).
+ * Packets refresh a deadline, the timing wheel only looks at it when the
+ * previous one fires, so the hot path never touches the wheel. Headers are
+ * rewritten in place with incremental checksums.
+ *
+ * Time only moves in expire(), which the owner calls every tick or so.
+ */
+struct Nat
+{
+    static constexpr size_t batch_size = 64;
+    static constexpr size_t max_port_probes = 64;
+
+    Nat(const NatConfig &config)
+        : m_config(config), m_clock(config.tick),
+          m_timeout(m_clock.ticks_from_now(config.timeout) - m_clock.now()),
+          m_flows(config.max_flows),
+          m_outbound_index(index_size(config.max_flows), TimerNode::no_index),
+          m_inbound_index(index_size(config.max_flows), TimerNode::no_index),
+          m_wheel(m_flows, m_wheel_state)
+    {
+        assert(config.port_min <= config.port_max);
+        m_free.reserve(config.max_flows);
+        for (uint32_t idx = config.max_flows; idx-- > 0;) {
+            m_free.push_back(idx);
+        }
+        m_wheel_state.now = m_clock.now();
+    }
+
+    Nat(const Nat &) = delete;
+    Nat &operator=(const Nat &) = delete;
+
+    const NatStats &stats() const
+    {
+        return m_stats;
+    }
+
+    size_t size() const
+    {
+        return m_flows.size() - m_free.size();
+    }
+
+    // Internal to remote, creates the flow on first sight
+    bool outbound(std::span<std::byte> packet)
+    {
+        auto parsed = parse(packet);
+        if (!parsed) {
+            return false;
+        }
+        return translate_outbound(*parsed);
+    }
+
+    // Remote to external address, dropped unless a flow matches
+    bool inbound(std::span<std::byte> packet)
+    {
+        auto parsed = parse(packet);
+        if (!parsed) {
+            return false;
+        }
+        return translate_inbound(*parsed);
+    }
+
+    /*
+     * Hashes every packet and prefetches its index slot before the first
+     * lookup, returns the number translated
+     */
+    size_t outbound_batch(
+        std::span<const std::span<std::byte>> packets, std::span<bool> output)
+    {
+        return batch(packets, output, true);
+    }
+
+    size_t inbound_batch(
+        std::span<const std::span<std::byte>> packets, std::span<bool> output)
+    {
+        return batch(packets, output, false);
+    }
+
+    // Removes flows idle for the timeout, returns how many
+    size_t expire()
+    {
+        size_t nb_expired = 0;
+        m_wheel.advance(m_clock.refresh(), [&](std::span<const uint32_t> idx) {
+            for (uint32_t f_idx : idx) {
+                Flow &f = m_flows[f_idx];
+                if (f.deadline > m_wheel.now()) {
+                    m_wheel.schedule(f_idx, f.deadline);
+                    continue;
+                }
+                remove(f_idx);
+                nb_expired++;
+            }
+        });
+        m_stats.expired += nb_expired;
+        return nb_expired;
+    }
+
+  private:
+    struct Flow
+    {
+        uint32_t internal_address = 0;
+        uint32_t remote_address = 0;
+        uint16_t internal_port = 0;
+        uint16_t remote_port = 0;
+        uint16_t external_port = 0;
+        uint64_t deadline = 0;
+        TimerNode timer;
+    };
+
+    struct Parsed
+    {
+        IPv4::MutablePacketView ip;
+        MutablePacketView udp;
+        uint32_t source;
+        uint32_t destination;
+        uint64_t hash;
+    };
+
+    NatConfig m_config;
+    CoarseClock m_clock;
+    uint64_t m_timeout;
+    NatStats m_stats;
+
+    std::vector<Flow> m_flows;
+    std::vector<uint32_t> m_free;
+    std::vector<uint32_t> m_outbound_index;
+    std::vector<uint32_t> m_inbound_index;
+    TimingWheelState m_wheel_state;
+    TimingWheel<Flow, &Flow::timer> m_wheel;
+
+    static size_t index_size(size_t capacity)
+    {
+        return std::bit_ceil(std::max<size_t>(16, capacity * 2));
+    }
+
+    static uint64_t outbound_hash(
+        uint32_t internal_address,
+        uint16_t internal_port,
+        uint32_t remote_address,
+        uint16_t remote_port)
+    {
+        uint64_t addresses = uint64_t(internal_address) << 32 | remote_address;
+        uint64_t ports = uint64_t(internal_port) << 16 | remote_port;
+        return mix64(addresses ^ mix64(ports));
+    }
+
+    // The whole key fits one word
+    static uint64_t inbound_hash(
+        uint16_t external_port, uint32_t remote_address, uint16_t remote_port)
+    {
+        return mix64(
+            uint64_t(external_port) << 48 | uint64_t(remote_address) << 16 |
+            remote_port);
+    }
+
+    static uint64_t outbound_hash(const Flow &f)
+    {
+        return outbound_hash(
+            f.internal_address,
+            f.internal_port,
+            f.remote_address,
+            f.remote_port);
+    }
+
+    static uint64_t inbound_hash(const Flow &f)
+    {
+        return inbound_hash(f.external_port, f.remote_address, f.remote_port);
+    }
+
+    size_t mask() const
+    {
+        return m_outbound_index.size() - 1;
+    }
+
+    std::optional<Parsed> parse(std::span<std::byte> packet)
+    {
+        auto ip = IPv4::MutablePacketView::create(packet);
+        auto udp = ip ? ip->udp() : std::nullopt;
+        if (!udp) {
+            m_stats.malformed++;
+            return std::nullopt;
+        }
+
+        Parsed output{*ip, *udp, 0, 0, 0};
+        output.source = betoh<uint32_t>(ip->source_address().data_msbf());
+        output.destination =
+            betoh<uint32_t>(ip->destination_address().data_msbf());
+        return output;
+    }
+
+    void hash_outbound(Parsed &p) const
+    {
+        p.hash = outbound_hash(
+            p.source,
+            p.udp.source_port(),
+            p.destination,
+            p.udp.destination_port());
+    }
+
+    void hash_inbound(Parsed &p) const
+    {
+        p.hash = inbound_hash(
+            p.udp.destination_port(), p.source, p.udp.source_port());
+    }
+
+    size_t batch(
+        std::span<const std::span<std::byte>> packets,
+        std::span<bool> output,
+        bool is_outbound)
+    {
+        assert(output.size() >= packets.size());
+        std::array<std::optional<Parsed>, batch_size> parsed;
+        size_t nb_translated = 0;
+
+        for (size_t first = 0; first < packets.size(); first += batch_size) {
+            size_t count = std::min(batch_size, packets.size() - first);
+            auto &index = is_outbound ? m_outbound_index : m_inbound_index;
+            for (size_t idx = 0; idx < count; idx++) {
+                parsed[idx] = parse(packets[first + idx]);
+                if (!parsed[idx]) {
+                    continue;
+                }
+                if (is_outbound) {
+                    hash_outbound(*parsed[idx]);
+                } else {
+                    hash_inbound(*parsed[idx]);
+                }
+                __builtin_prefetch(&index[parsed[idx]->hash & mask()]);
+            }
+
+            for (size_t idx = 0; idx < count; idx++) {
+                bool translated = false;
+                if (parsed[idx]) {
+                    translated = is_outbound
+                                     ? translate_outbound(*parsed[idx], false)
+                                     : translate_inbound(*parsed[idx], false);
+                }
+                output[first + idx] = translated;
+                nb_translated += translated;
+            }
+        }
+        return nb_translated;
+    }
+
+    bool translate_outbound(Parsed &p, bool needs_hash = true)
+    {
+        if (needs_hash) {
+            hash_outbound(p);
+        }
+        uint16_t source_port = p.udp.source_port();
+        uint16_t destination_port = p.udp.destination_port();
+
+        uint32_t f_idx = find(m_outbound_index, p.hash, [&](const Flow &f) {
+            return f.internal_address == p.source &&
+                   f.internal_port == source_port &&
+                   f.remote_address == p.destination &&
+                   f.remote_port == destination_port;
+        });
+        if (f_idx == TimerNode::no_index) {
+            auto created =
+                create(p.source, source_port, p.destination, destination_port);
+            if (!created) {
+                return false;
+            }
+            f_idx = *created;
+        }
+
+        Flow &f = m_flows[f_idx];
+        f.deadline = m_clock.now() + m_timeout;
+        p.ip.set_source_address(m_config.external_address);
+        p.udp.set_source_port(f.external_port);
+        m_stats.outbound++;
+        return true;
+    }
+
+    bool translate_inbound(Parsed &p, bool needs_hash = true)
+    {
+        if (p.destination != to_u32(m_config.external_address)) {
+            m_stats.unmatched++;
+            return false;
+        }
+        if (needs_hash) {
+            hash_inbound(p);
+        }
+        uint16_t source_port = p.udp.source_port();
+        uint16_t destination_port = p.udp.destination_port();
+
+        uint32_t f_idx = find(m_inbound_index, p.hash, [&](const Flow &f) {
+            return f.external_port == destination_port &&
+                   f.remote_address == p.source &&
+                   f.remote_port == source_port;
+        });
+        if (f_idx == TimerNode::no_index) {
+            m_stats.unmatched++;
+            return false;
+        }
+
+        Flow &f = m_flows[f_idx];
+        f.deadline = m_clock.now() + m_timeout;
+        p.ip.set_destination_address(
+            IPv4::Address(htobe<uint32_t>(f.internal_address)));
+        p.udp.set_destination_port(f.internal_port);
+        m_stats.inbound++;
+        return true;
+    }
+
+    static uint32_t to_u32(IPv4::Address address)
+    {
+        return betoh<uint32_t>(address.data_msbf());
+    }
+
+    std::optional<uint32_t> create(
+        uint32_t internal_address,
+        uint16_t internal_port,
+        uint32_t remote_address,
+        uint16_t remote_port)
+    {
+        if (m_free.empty()) {
+            m_stats.table_full++;
+            return std::nullopt;
+        }
+        auto port = allocate_port(
+            internal_address, internal_port, remote_address, remote_port);
+        if (!port) {
+            m_stats.no_port++;
+            return std::nullopt;
+        }
+
+        uint32_t f_idx = m_free.back();
+        m_free.pop_back();
+        Flow &f = m_flows[f_idx];
+        f.internal_address = internal_address;
+        f.internal_port = internal_port;
+        f.remote_address = remote_address;
+        f.remote_port = remote_port;
+        f.external_port = *port;
+        f.deadline = m_clock.now() + m_timeout;
+
+        insert(m_outbound_index, outbound_hash(f), f_idx);
+        insert(m_inbound_index, inbound_hash(f), f_idx);
+        m_wheel.schedule(f_idx, f.deadline);
+        m_stats.created++;
+        return f_idx;
+    }
+
+    /*
+     * First port free towards the remote endpoint, probing from a hash of
+     * the flow so flows of one client spread over the range
+     */
+    std::optional<uint16_t> allocate_port(
+        uint32_t internal_address,
+        uint16_t internal_port,
+        uint32_t remote_address,
+        uint16_t remote_port) const
+    {
+        uint32_t range = uint32_t(m_config.port_max) - m_config.port_min + 1;
+        uint64_t start = outbound_hash(
+            internal_address, internal_port, remote_address, remote_port);
+
+        for (size_t probe = 0; probe < max_port_probes; probe++) {
+            uint16_t port = m_config.port_min + (start + probe) % range;
+            uint64_t hash = inbound_hash(port, remote_address, remote_port);
+            uint32_t taken = find(m_inbound_index, hash, [&](const Flow &f) {
+                return f.external_port == port &&
+                       f.remote_address == remote_address &&
+                       f.remote_port == remote_port;
+            });
+            if (taken == TimerNode::no_index) {
+                return port;
+            }
+        }
+        return std::nullopt;
+    }
+
+    template <typename Match>
+    uint32_t find(
+        const std::vector<uint32_t> &index, uint64_t hash, Match match) const
+    {
+        for (size_t pos = hash & mask();; pos = (pos + 1) & mask()) {
+            uint32_t f_idx = index[pos];
+            if (f_idx == TimerNode::no_index || match(m_flows[f_idx])) {
+                return f_idx;
+            }
+        }
+    }
+
+    void insert(std::vector<uint32_t> &index, uint64_t hash, uint32_t f_idx)
+    {
+        size_t pos = hash & mask();
+        while (index[pos] != TimerNode::no_index) {
+            pos = (pos + 1) & mask();
+        }
+        index[pos] = f_idx;
+    }
+
+    // Backward shift deletion, as in the lease table index
+    template <typename HashOf>
+    void erase(
+        std::vector<uint32_t> &index,
+        uint64_t hash,
+        uint32_t f_idx,
+        HashOf hash_of)
+    {
+        size_t pos = hash & mask();
+        while (index[pos] != f_idx) {
+            pos = (pos + 1) & mask();
+        }
+
+        size_t hole = pos;
+        for (size_t next = (hole + 1) & mask();
+             index[next] != TimerNode::no_index;
+             next = (next + 1) & mask()) {
+            size_t home = hash_of(m_flows[index[next]]) & mask();
+            bool movable = ((next - home) & mask()) >= ((next - hole) & mask());
+            if (movable) {
+                index[hole] = index[next];
+                hole = next;
+            }
+        }
+        index[hole] = TimerNode::no_index;
+    }
+
+    void remove(uint32_t f_idx)
+    {
+        const Flow &f = m_flows[f_idx];
+        erase(m_outbound_index, outbound_hash(f), f_idx, [](const Flow &o) {
+            return outbound_hash(o);
+        });
+        erase(m_inbound_index, inbound_hash(f), f_idx, [](const Flow &o) {
+            return inbound_hash(o);
+        });
+        m_wheel.cancel(f_idx);
+        m_free.push_back(f_idx);
+    }
+};
+
+} // namespace xnet::UDP
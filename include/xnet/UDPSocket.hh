@@ -0,0 +1,379 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/IPv4.hh>
+
+namespace xnet::IPv4 {
+struct RawSocket;
+} // namespace xnet::IPv4
+
+namespace xnet::UDP {
+
+struct Endpoint
+{
+    IPv4::Address address;
+    uint16_t port{};
+};
+
+constexpr bool operator==(const Endpoint &l, const Endpoint &r)
+{
+    return l.address == r.address && l.port == r.port;
+}
+
+inline sockaddr_in to_sockaddr(const Endpoint &e)
+{
+    sockaddr_in output{};
+    output.sin_family = AF_INET;
+    auto port = htobe<uint16_t>(e.port);
+    std::memcpy(&output.sin_port, port.data(), port.size());
+    auto addr = e.address.data_msbf();
+    std::memcpy(&output.sin_addr, addr.data(), addr.size());
+    return output;
+}
+
+inline Endpoint from_sockaddr(const sockaddr_in &s)
+{
+    std::array<std::byte, 2> port{};
+    std::memcpy(port.data(), &s.sin_port, port.size());
+    std::array<std::byte, 4> addr{};
+    std::memcpy(addr.data(), &s.sin_addr, addr.size());
+    return Endpoint{IPv4::Address(addr), betoh<uint16_t>(port)};
+}
+
+struct SocketOptions
+{
+    Endpoint bind_to{};
+    bool reuse_port = false;
+    bool broadcast = false;
+    int receive_buffer = 0;
+    int send_buffer = 0;
+    // Zero blocks forever, lets worker loops notice stop requests otherwise
+    std::chrono::microseconds receive_timeout{0};
+};
+
+/*
+ * Datagram storage for one recvmmsg call. Payloads land in fixed slots, so
+ * the views handed out stay valid until the next receive into the batch.
+ */
+template <size_t capacity, size_t slot_size = 2048>
+struct RecvBatch
+{
+    RecvBatch()
+    {
+        for (size_t idx = 0; idx < capacity; idx++) {
+            m_iovecs[idx].iov_base = m_buffers[idx].data();
+            m_iovecs[idx].iov_len = slot_size;
+        }
+    }
+
+    RecvBatch(const RecvBatch &) = delete;
+    RecvBatch &operator=(const RecvBatch &) = delete;
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    std::span<const std::byte> payload(size_t idx) const
+    {
+        assert(idx < m_size);
+        return std::span<const std::byte>(
+            m_buffers[idx].data(), m_headers[idx].msg_len);
+    }
+
+    Endpoint peer(size_t idx) const
+    {
+        assert(idx < m_size);
+        return from_sockaddr(m_peers[idx]);
+    }
+
+  private:
+    friend struct Socket;
+    friend struct IPv4::RawSocket;
+
+    std::array<std::array<std::byte, slot_size>, capacity> m_buffers;
+    std::array<iovec, capacity> m_iovecs{};
+    std::array<sockaddr_in, capacity> m_peers{};
+    std::array<mmsghdr, capacity> m_headers{};
+    size_t m_size = 0;
+
+    mmsghdr *prepare()
+    {
+        for (size_t idx = 0; idx < capacity; idx++) {
+            msghdr &h = m_headers[idx].msg_hdr;
+            h = msghdr{};
+            h.msg_name = &m_peers[idx];
+            h.msg_namelen = sizeof(sockaddr_in);
+            h.msg_iov = &m_iovecs[idx];
+            h.msg_iovlen = 1;
+        }
+        return m_headers.data();
+    }
+};
+
+// Gathers references to caller owned datagrams for one sendmmsg call
+template <size_t capacity>
+struct SendBatch
+{
+    bool push(std::span<const std::byte> data, const Endpoint &peer)
+    {
+        if (m_size == capacity) {
+            return false;
+        }
+
+        m_iovecs[m_size].iov_base = const_cast<std::byte *>(data.data());
+        m_iovecs[m_size].iov_len = data.size();
+        m_peers[m_size] = to_sockaddr(peer);
+
+        msghdr &h = m_headers[m_size].msg_hdr;
+        h = msghdr{};
+        h.msg_name = &m_peers[m_size];
+        h.msg_namelen = sizeof(sockaddr_in);
+        h.msg_iov = &m_iovecs[m_size];
+        h.msg_iovlen = 1;
+
+        m_size++;
+        return true;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool full() const
+    {
+        return m_size == capacity;
+    }
+
+    void clear()
+    {
+        m_size = 0;
+    }
+
+  private:
+    friend struct Socket;
+    friend struct IPv4::RawSocket;
+
+    std::array<iovec, capacity> m_iovecs{};
+    std::array<sockaddr_in, capacity> m_peers{};
+    std::array<mmsghdr, capacity> m_headers{};
+    size_t m_size = 0;
+
+    size_t send(int fd)
+    {
+        size_t nb_sent = 0;
+        size_t next = 0;
+        while (next != m_size) {
+            int sent =
+                ::sendmmsg(fd, m_headers.data() + next, m_size - next, 0);
+            if (sent < 0) {
+                if (errno != EINTR) {
+                    // The error belongs to the first datagram left
+                    next++;
+                }
+                continue;
+            }
+            nb_sent += sent;
+            next += sent;
+        }
+
+        clear();
+        return nb_sent;
+    }
+};
+
+struct Socket
+{
+    static std::optional<Socket> open(const SocketOptions &options)
+    {
+        Socket output(::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0));
+        if (output.m_fd < 0) {
+            return std::nullopt;
+        }
+
+        int one = 1;
+        if (options.reuse_port &&
+            !output.set_option(SOL_SOCKET, SO_REUSEPORT, one)) {
+            return std::nullopt;
+        }
+
+        if (options.broadcast &&
+            !output.set_option(SOL_SOCKET, SO_BROADCAST, one)) {
+            return std::nullopt;
+        }
+
+        if (options.receive_buffer != 0 &&
+            !output.set_option(SOL_SOCKET, SO_RCVBUF, options.receive_buffer)) {
+            return std::nullopt;
+        }
+
+        if (options.send_buffer != 0 &&
+            !output.set_option(SOL_SOCKET, SO_SNDBUF, options.send_buffer)) {
+            return std::nullopt;
+        }
+
+        if (options.receive_timeout.count() != 0) {
+            timeval tv{};
+            tv.tv_sec = options.receive_timeout.count() / 1000000;
+            tv.tv_usec = options.receive_timeout.count() % 1000000;
+            if (!output.set_option(SOL_SOCKET, SO_RCVTIMEO, tv)) {
+                return std::nullopt;
+            }
+        }
+
+        sockaddr_in addr = to_sockaddr(options.bind_to);
+        if (::bind(output.m_fd, (const sockaddr *)&addr, sizeof(addr)) != 0) {
+            return std::nullopt;
+        }
+
+        return output;
+    }
+
+    Socket(Socket &&other) : m_fd(std::exchange(other.m_fd, -1))
+    {
+    }
+
+    Socket &operator=(Socket &&other)
+    {
+        if (this != &other) {
+            close();
+            m_fd = std::exchange(other.m_fd, -1);
+        }
+        return *this;
+    }
+
+    ~Socket()
+    {
+        close();
+    }
+
+    // Takes ownership of an already open datagram socket
+    static Socket adopt(int fd)
+    {
+        return Socket(fd);
+    }
+
+    int fd() const
+    {
+        return m_fd;
+    }
+
+    int release()
+    {
+        return std::exchange(m_fd, -1);
+    }
+
+    std::optional<Endpoint> local_endpoint() const
+    {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        if (::getsockname(m_fd, (sockaddr *)&addr, &len) != 0) {
+            return std::nullopt;
+        }
+        return from_sockaddr(addr);
+    }
+
+    /*
+     * Classic BPF program choosing the reuseport group member for each
+     * datagram, it sees the UDP payload at offset 0 and returns the index of
+     * the socket in bind order
+     */
+    bool attach_reuseport_cbpf(std::span<const sock_filter> program)
+    {
+        sock_fprog prog{};
+        prog.len = program.size();
+        prog.filter = const_cast<sock_filter *>(program.data());
+        return set_option(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, prog);
+    }
+
+    /*
+     * Blocks for the first datagram, then takes whatever is already queued.
+     * Without `wait`, returns 0 right away if nothing is queued
+     */
+    template <size_t capacity, size_t slot_size>
+    std::optional<size_t>
+        recv_batch(RecvBatch<capacity, slot_size> &batch, bool wait = true)
+    {
+        batch.m_size = 0;
+        int flags = wait ? MSG_WAITFORONE : MSG_DONTWAIT;
+        int nb_received =
+            ::recvmmsg(m_fd, batch.prepare(), capacity, flags, nullptr);
+        if (nb_received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            return std::nullopt;
+        }
+
+        batch.m_size = nb_received;
+        return batch.m_size;
+    }
+
+    /*
+     * Sends and clears the whole batch, a datagram the kernel refuses is
+     * skipped without holding back the others. Returns how many were sent.
+     */
+    template <size_t capacity>
+    size_t send_batch(SendBatch<capacity> &batch)
+    {
+        return batch.send(m_fd);
+    }
+
+    std::optional<size_t>
+        send_to(std::span<const std::byte> data, const Endpoint &peer)
+    {
+        sockaddr_in addr = to_sockaddr(peer);
+        ssize_t sent = ::sendto(
+            m_fd,
+            data.data(),
+            data.size(),
+            0,
+            (const sockaddr *)&addr,
+            sizeof(addr));
+        if (sent < 0) {
+            return std::nullopt;
+        }
+        return sent;
+    }
+
+  private:
+    int m_fd = -1;
+
+    explicit Socket(int fd) : m_fd(fd)
+    {
+    }
+
+    template <typename T>
+    bool set_option(int level, int name, const T &value)
+    {
+        return ::setsockopt(m_fd, level, name, &value, sizeof(value)) == 0;
+    }
+
+    void close()
+    {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+};
+
+} // namespace xnet::UDP
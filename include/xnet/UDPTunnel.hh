@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <netinet/in.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/Checksum.hh>
+#include <xnet/Hash.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/PacketBuffer.hh>
+#include <xnet/UDP.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::UDP {
+
+struct TunnelConfig
+{
+    IPv4::Address local{};
+    IPv4::Address remote{};
+    // IANA port of VXLAN-GPE, which carries IPv4 without an Ethernet header
+    uint16_t port = 4790;
+    uint32_t vni = 0;
+    uint8_t time_to_live = 64;
+    uint8_t type_of_service = 0;
+
+    // Zero outer UDP checksum, the inner packet keeps its own
+    bool zero_checksum = false;
+    // Source port hashed from the inner flow, spreads tunnels over ECMP paths
+    bool flow_entropy = true;
+    // Decapsulation checks a non zero outer UDP checksum
+    bool verify_checksum = true;
+};
+
+// Valid as long as the outer packet it was taken from
+struct Decapsulated
+{
+    IPv4::PacketView inner;
+    uint32_t vni;
+    Endpoint peer;
+};
+
+/*
+ * One IPv4 over UDP tunnel with a VXLAN-GPE header (flags I and P, next
+ * protocol IPv4, 24-bit VNI). The outer headers are serialized once into a
+ * template with the sums of their constant fields, encapsulating copies
+ * them into the buffer headroom and finishes both checksums from lengths
+ * and source port only.
+ *
+ * The outer UDP checksum still covers the inner packet. When that is an
+ * IPv4/UDP packet with valid checksums its sum follows from its pseudo
+ * header alone (Linux's local checksum offload), otherwise it is summed.
+ * Decapsulation hands out the inner packet as a view into the outer one.
+ */
+struct Tunnel
+{
+    static constexpr size_t tunnel_header_size = 8;
+    static constexpr size_t overhead =
+        IPv4::minimal_header_size + header_size + tunnel_header_size;
+    static constexpr uint8_t flag_vni = 0x08;
+    static constexpr uint8_t flag_next_protocol = 0x04;
+    static constexpr uint8_t next_protocol_ipv4 = 1;
+    static constexpr uint16_t entropy_port_min = 49152;
+
+    Tunnel(const TunnelConfig &config) : m_config(config)
+    {
+        IPv4::Header ip{};
+        ip.header_size = IPv4::minimal_header_size;
+        ip.TOS_or_DS = config.type_of_service;
+        ip.flags = IPv4::Flags(0b010);
+        ip.time_to_live = config.time_to_live;
+        ip.protocol = IPPROTO_UDP;
+        ip.source_address = config.local;
+        ip.destination_address = config.remote;
+        auto ip_data = IPv4::serialize(ip);
+        std::ranges::copy(ip_data, m_template.begin());
+        m_ip_sum = Checksum::fold(Checksum::add(0, ip_data));
+
+        auto udp = std::span(m_template).subspan(IPv4::minimal_header_size);
+        store_be<uint16_t>(udp, 2, config.port);
+        auto tunnel = udp.subspan(header_size);
+        tunnel[0] = std::byte(flag_vni | flag_next_protocol);
+        tunnel[3] = std::byte(next_protocol_ipv4);
+        store_be<uint32_t>(tunnel, 4, (config.vni & 0xffffff) << 8);
+
+        // Lengths and source port are zero in the template
+        uint64_t sum = Checksum::pseudo_header_sum(
+            config.local, config.remote, IPPROTO_UDP, 0);
+        sum = Checksum::add(sum, udp.first(header_size + tunnel_header_size));
+        m_udp_sum = Checksum::fold(sum);
+    }
+
+    const TunnelConfig &config() const
+    {
+        return m_config;
+    }
+
+    // Prepends the outer headers to the inner IPv4 packet `packet` holds
+    bool encapsulate(PacketBuffer &packet) const
+    {
+        size_t inner_size = packet.size();
+        if (inner_size > std::numeric_limits<uint16_t>::max() - overhead) {
+            return false;
+        }
+        Inner inner = inspect(packet.data());
+
+        auto outer = packet.prepend(overhead);
+        if (!outer) {
+            return false;
+        }
+        std::memcpy(outer->data(), m_template.data(), overhead);
+
+        uint16_t total_size = overhead + inner_size;
+        store_be<uint16_t>(*outer, 2, total_size);
+        uint64_t ip_sum = uint64_t(m_ip_sum) + total_size;
+        store_be<uint16_t>(*outer, 10, Checksum::finish(ip_sum));
+
+        auto udp = outer->subspan(IPv4::minimal_header_size);
+        uint16_t source_port = m_config.port;
+        if (m_config.flow_entropy) {
+            source_port = entropy_port_min + inner.hash % (65536 - 49152);
+        }
+        uint16_t udp_length = total_size - IPv4::minimal_header_size;
+        store_be<uint16_t>(udp, 0, source_port);
+        store_be<uint16_t>(udp, 4, udp_length);
+        if (m_config.zero_checksum) {
+            return true;
+        }
+
+        uint64_t sum = m_udp_sum;
+        sum += uint32_t(udp_length) * 2;
+        sum += source_port;
+        if (inner.sum) {
+            sum += *inner.sum;
+        } else {
+            sum = Checksum::add(sum, packet.data().subspan(overhead));
+        }
+        store_be<uint16_t>(
+            udp, 6, Checksum::udp_nonzero(Checksum::finish(sum)));
+        return true;
+    }
+
+    // Returns the number encapsulated, `output` tells which
+    size_t encapsulate_batch(
+        std::span<PacketBuffer> packets, std::span<bool> output) const
+    {
+        size_t nb_done = 0;
+        for (size_t idx = 0; idx < packets.size(); idx++) {
+            output[idx] = encapsulate(packets[idx]);
+            nb_done += output[idx];
+        }
+        return nb_done;
+    }
+
+    /*
+     * Inner packet of an outer IPv4 datagram from the remote endpoint to
+     * the tunnel port with this tunnel's VNI
+     */
+    std::optional<Decapsulated>
+        decapsulate(std::span<const std::byte> packet) const
+    {
+        IPv4::PacketView outer(packet);
+        if (outer.is_not_valid()) {
+            return std::nullopt;
+        }
+        IPv4::HeaderView ip = outer.header_view();
+        uint16_t flags_fragment = load_be<uint16_t>(packet, 6);
+        if (ip.protocol() != IPPROTO_UDP || (flags_fragment & 0x3fff) != 0 ||
+            ip.source_address() != m_config.remote ||
+            ip.destination_address() != m_config.local) {
+            return std::nullopt;
+        }
+
+        auto datagram = *outer.payload_data();
+        auto udp = PacketView(datagram).parse_header();
+        if (!udp || udp->destination_port != m_config.port ||
+            udp->length != datagram.size() ||
+            datagram.size() < header_size + tunnel_header_size) {
+            return std::nullopt;
+        }
+        if (m_config.verify_checksum && udp->checksumm != 0) {
+            uint64_t sum = Checksum::pseudo_header_sum(
+                m_config.remote, m_config.local, IPPROTO_UDP, udp->length);
+            if (Checksum::fold(Checksum::add(sum, datagram)) != 0xffff) {
+                return std::nullopt;
+            }
+        }
+
+        auto tunnel = datagram.subspan(header_size);
+        uint8_t flags = std::to_integer<uint8_t>(tunnel[0]);
+        uint8_t next_protocol = std::to_integer<uint8_t>(tunnel[3]);
+        uint32_t vni = load_be<uint32_t>(tunnel, 4) >> 8;
+        if ((flags & (flag_vni | flag_next_protocol)) !=
+                (flag_vni | flag_next_protocol) ||
+            next_protocol != next_protocol_ipv4 || vni != m_config.vni) {
+            return std::nullopt;
+        }
+
+        IPv4::PacketView inner(tunnel.subspan(tunnel_header_size));
+        if (inner.is_not_valid()) {
+            return std::nullopt;
+        }
+        return Decapsulated{
+            inner, vni, Endpoint{m_config.remote, udp->source_port}};
+    }
+
+    // Leaves only the inner packet in `packet`
+    bool decapsulate(PacketBuffer &packet) const
+    {
+        auto decapsulated = decapsulate(packet.data());
+        if (!decapsulated) {
+            return false;
+        }
+        // The outer header may carry options, unlike the ones we build
+        auto outer_header = IPv4::HeaderView(packet.data()).header_size();
+        size_t inner_offset = *outer_header + header_size + tunnel_header_size;
+        auto inner = decapsulated->inner.header_view().total_size();
+        packet.trim_back(packet.size() - inner_offset - *inner);
+        packet.trim_front(inner_offset);
+        return true;
+    }
+
+    size_t decapsulate_batch(
+        std::span<const std::span<const std::byte>> packets,
+        std::span<std::optional<Decapsulated>> output) const
+    {
+        size_t nb_done = 0;
+        for (size_t idx = 0; idx < packets.size(); idx++) {
+            output[idx] = decapsulate(packets[idx]);
+            nb_done += output[idx].has_value();
+        }
+        return nb_done;
+    }
+
+  private:
+    struct Inner
+    {
+        uint64_t hash = 0;
+        // Folded sum of the whole inner packet, when cheap to know
+        std::optional<uint16_t> sum;
+    };
+
+    TunnelConfig m_config;
+    std::array<std::byte, overhead> m_template{};
+    uint16_t m_ip_sum;
+    uint16_t m_udp_sum;
+
+    /*
+     * A valid IPv4 header sums to 0xffff and a checksummed UDP datagram to
+     * the complement of its pseudo header, so together they sum to that
+     */
+    Inner inspect(std::span<const std::byte> data) const
+    {
+        Inner output;
+        if (data.size() < IPv4::minimal_header_size + header_size) {
+            return output;
+        }
+
+        IPv4::HeaderView ip(data);
+        auto header_size_opt = ip.header_size();
+        auto total_size = ip.total_size();
+        if (!header_size_opt || !total_size) {
+            return output;
+        }
+        size_t ip_header_size = *header_size_opt;
+        auto source = ip.source_address().value().data_msbf();
+        auto destination = ip.destination_address().value().data_msbf();
+        uint64_t key = uint64_t(betoh<uint32_t>(source)) << 32 |
+                       betoh<uint32_t>(destination);
+        output.hash = mix64(key ^ std::to_integer<uint8_t>(data[9]));
+
+        bool is_udp = std::to_integer<uint8_t>(data[9]) == IPPROTO_UDP;
+        uint16_t fragment = load_be<uint16_t>(data, 6) & 0x3fff;
+        if (!is_udp || fragment != 0 ||
+            data.size() < ip_header_size + header_size) {
+            return output;
+        }
+        auto udp = data.subspan(ip_header_size);
+        uint32_t ports = load_be<uint32_t>(udp, 0);
+        output.hash = mix64(output.hash ^ ports);
+
+        uint16_t udp_length = load_be<uint16_t>(udp, 4);
+        uint16_t udp_checksum = load_be<uint16_t>(udp, 6);
+        if (*total_size != data.size() || udp_checksum == 0 ||
+            udp_length != data.size() - ip_header_size ||
+            !ip.verify_checksum()) {
+            return output;
+        }
+
+        uint16_t pseudo = Checksum::pseudo_header_sum(
+            IPv4::Address(source),
+            IPv4::Address(destination),
+            IPPROTO_UDP,
+            udp_length);
+        output.sum = uint16_t(~pseudo);
+        return output;
+    }
+};
+
+} // namespace xnet::UDP
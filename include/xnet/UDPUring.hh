@@ -0,0 +1,793 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <xnet/ByteOrder.hh>
+#include <xnet/UDP.hh>
+#include <xnet/UDPSocket.hh>
+
+namespace xnet::UDP {
+
+struct UringConfig
+{
+    uint32_t queue_depth = 256;
+    // Provided receive buffers, the count is rounded up to a power of two
+    uint32_t nb_buffers = 1024;
+    uint32_t buffer_size = 2048;
+    // A kernel thread polls the submission queue, submitting costs no syscall
+    bool sqpoll = false;
+    std::chrono::milliseconds sqpoll_idle{50};
+    // Sends from registered buffers with IORING_OP_SEND_ZC
+    bool zero_copy_send = false;
+    uint32_t nb_send_slots = 256;
+    uint32_t send_slot_size = 2048;
+};
+
+struct UringStats
+{
+    uint64_t received = 0;
+    uint64_t truncated = 0;
+    // The multishot receive ran out of provided buffers and was rearmed
+    uint64_t no_buffers = 0;
+    uint64_t rearms = 0;
+    uint64_t sent = 0;
+    uint64_t send_errors = 0;
+};
+
+/*
+ * Received datagram in place in its provided buffer: a synthetic UDP
+ * header (ports of the peer and the socket, zero checksum) directly
+ * followed by the payload. Valid until its buffer is recycled.
+ */
+struct UringDatagram
+{
+    std::span<const std::byte> datagram;
+    Endpoint peer;
+    uint16_t buffer_id = 0;
+
+    PacketView view() const
+    {
+        return PacketView(datagram);
+    }
+
+    std::span<const std::byte> payload() const
+    {
+        return datagram.subspan(header_size);
+    }
+};
+
+/*
+ * io_uring datagram I/O on one UDP socket. The socket is a registered file,
+ * one multishot recvmsg stays armed over a ring of provided buffers, so
+ * receiving costs no syscall while completions are pending. Each datagram
+ * holds its buffer until recycle(). Where the kernel does not select from
+ * buffer rings, recycled buffers go back with IORING_OP_PROVIDE_BUFFERS
+ * along the next submission instead. Sends are copied into a slot (fixed
+ * buffers when zero copy), queued, and submitted with the next receive or
+ * submit().
+ *
+ * Single threaded. The ring needs Linux 6.0 (buffer rings, multishot
+ * recvmsg, zero copy send).
+ */
+struct UringSocket
+{
+    static std::optional<UringSocket>
+        open(Socket socket, const UringConfig &config)
+    {
+        auto state = std::make_unique<State>(std::move(socket), config);
+        if (!state->setup()) {
+            return std::nullopt;
+        }
+        return UringSocket(std::move(state));
+    }
+
+    const Socket &socket() const
+    {
+        return m_state->socket;
+    }
+
+    const UringStats &stats() const
+    {
+        return m_state->stats;
+    }
+
+    /*
+     * Submits queued work, waits up to `timeout` (0 polls) for completions
+     * and fills `output` with received datagrams. Completions that do not
+     * fit stay queued for the next call.
+     */
+    std::optional<size_t> receive(
+        std::span<UringDatagram> output, std::chrono::microseconds timeout)
+    {
+        return m_state->receive(output, timeout);
+    }
+
+    void recycle(uint16_t buffer_id)
+    {
+        m_state->recycle(buffer_id);
+    }
+
+    void recycle(const UringDatagram &datagram)
+    {
+        m_state->recycle(datagram.buffer_id);
+    }
+
+    // Copies `data`, false when every send slot is in flight
+    bool send(std::span<const std::byte> data, const Endpoint &peer)
+    {
+        return m_state->send(data, peer);
+    }
+
+    bool submit()
+    {
+        return m_state->enter(0, std::chrono::microseconds(0));
+    }
+
+  private:
+    static constexpr uint64_t recv_tag = 0;
+    static constexpr uint64_t send_tag = 1;
+    static constexpr uint64_t provide_tag = ~uint64_t(0);
+    // Room for the synthetic UDP header before the payload
+    static constexpr uint32_t control_size = header_size;
+
+    struct SendSlot
+    {
+        sockaddr_in address;
+        iovec iov;
+        msghdr msg;
+        bool awaiting_notification;
+    };
+
+    struct ReceiveCompletion
+    {
+        int32_t res;
+        uint32_t flags;
+    };
+
+    /*
+     * Heap pinned: the kernel keeps pointers to the receive msghdr and the
+     * send slots while requests are in flight.
+     */
+    struct State
+    {
+        State(Socket s, const UringConfig &c) : socket(std::move(s)), config(c)
+        {
+        }
+
+        State(const State &) = delete;
+        State &operator=(const State &) = delete;
+
+        ~State()
+        {
+            if (ring_fd >= 0) {
+                ::close(ring_fd);
+            }
+            unmap(ring_memory, ring_size);
+            unmap(sqe_memory, sqe_size);
+            unmap(buffer_ring, buffer_ring_size);
+            unmap(buffers, buffers_size);
+            unmap(send_buffers, send_buffers_size);
+        }
+
+        Socket socket;
+        UringConfig config;
+        UringStats stats;
+        uint16_t local_port = 0;
+
+        int ring_fd = -1;
+        void *ring_memory = nullptr;
+        size_t ring_size = 0;
+        io_uring_sqe *sqes = nullptr;
+        void *sqe_memory = nullptr;
+        size_t sqe_size = 0;
+
+        uint32_t *sq_head = nullptr;
+        uint32_t *sq_tail = nullptr;
+        uint32_t *sq_flags = nullptr;
+        uint32_t sq_mask = 0;
+        uint32_t sq_entries = 0;
+        uint32_t sq_local_tail = 0;
+        uint32_t sq_submitted = 0;
+
+        uint32_t *cq_head = nullptr;
+        uint32_t *cq_tail = nullptr;
+        uint32_t cq_mask = 0;
+        io_uring_cqe *cqes = nullptr;
+
+        io_uring_buf_ring *buffer_ring = nullptr;
+        size_t buffer_ring_size = 0;
+        uint32_t buffer_mask = 0;
+        uint16_t buffer_tail = 0;
+        std::byte *buffers = nullptr;
+        size_t buffers_size = 0;
+        bool use_buffer_ring = false;
+        std::vector<uint16_t> returned_buffers;
+
+        std::byte *send_buffers = nullptr;
+        size_t send_buffers_size = 0;
+        bool fixed_send_buffers = false;
+        std::vector<SendSlot> send_slots;
+        std::vector<uint32_t> free_send_slots;
+
+        msghdr recv_msg{};
+        bool recv_armed = false;
+        // Receives reaped while the caller had no room, delivered first
+        std::vector<ReceiveCompletion> pending_receives;
+        size_t pending_head = 0;
+
+        bool setup()
+        {
+            auto local = socket.local_endpoint();
+            if (!local) {
+                return false;
+            }
+            local_port = local->port;
+
+            if (!setup_ring() || !setup_buffers() || !setup_send_slots()) {
+                return false;
+            }
+
+            int fd = socket.fd();
+            if (register_op(IORING_REGISTER_FILES, &fd, 1) != 0) {
+                return false;
+            }
+
+            recv_msg.msg_namelen = sizeof(sockaddr_in);
+            recv_msg.msg_controllen = control_size;
+            pending_receives.reserve(config.nb_buffers);
+            return true;
+        }
+
+        bool setup_ring()
+        {
+            // A full completion queue ends the multishot receive, leave room
+            // for a burst per provided buffer
+            io_uring_params params{};
+            params.flags = IORING_SETUP_CQSIZE;
+            params.cq_entries = std::max(
+                config.queue_depth * 2,
+                std::bit_ceil(config.nb_buffers + config.nb_send_slots));
+            if (config.sqpoll) {
+                params.flags |= IORING_SETUP_SQPOLL;
+                params.sq_thread_idle = config.sqpoll_idle.count();
+            } else {
+                params.flags |= IORING_SETUP_COOP_TASKRUN;
+            }
+
+            ring_fd = ::syscall(
+                __NR_io_uring_setup, config.queue_depth, &params);
+            if (ring_fd < 0) {
+                return false;
+            }
+            if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 ||
+                (params.features & IORING_FEAT_EXT_ARG) == 0) {
+                return false;
+            }
+
+            size_t sq_size =
+                params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+            size_t cq_size =
+                params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            ring_size = std::max(sq_size, cq_size);
+            ring_memory =
+                map(ring_fd, ring_size, IORING_OFF_SQ_RING, MAP_POPULATE);
+            sqe_size = params.sq_entries * sizeof(io_uring_sqe);
+            sqe_memory = map(ring_fd, sqe_size, IORING_OFF_SQES, MAP_POPULATE);
+            if (ring_memory == nullptr || sqe_memory == nullptr) {
+                return false;
+            }
+
+            auto *base = (std::byte *)ring_memory;
+            sq_head = (uint32_t *)(base + params.sq_off.head);
+            sq_tail = (uint32_t *)(base + params.sq_off.tail);
+            sq_flags = (uint32_t *)(base + params.sq_off.flags);
+            sq_mask = *(uint32_t *)(base + params.sq_off.ring_mask);
+            sq_entries = params.sq_entries;
+            auto *sq_array = (uint32_t *)(base + params.sq_off.array);
+            for (uint32_t idx = 0; idx < sq_entries; idx++) {
+                sq_array[idx] = idx;
+            }
+            sq_local_tail = *sq_tail;
+            sq_submitted = sq_local_tail;
+
+            cq_head = (uint32_t *)(base + params.cq_off.head);
+            cq_tail = (uint32_t *)(base + params.cq_off.tail);
+            cq_mask = *(uint32_t *)(base + params.cq_off.ring_mask);
+            cqes = (io_uring_cqe *)(base + params.cq_off.cqes);
+            sqes = (io_uring_sqe *)sqe_memory;
+            return true;
+        }
+
+        bool setup_buffers()
+        {
+            uint32_t nb_buffers = std::bit_ceil(
+                std::clamp<uint32_t>(config.nb_buffers, 1, 32768));
+            buffer_mask = nb_buffers - 1;
+
+            buffer_ring_size = nb_buffers * sizeof(io_uring_buf);
+            buffer_ring = (io_uring_buf_ring *)map(-1, buffer_ring_size, 0, 0);
+            buffers_size = size_t(nb_buffers) * config.buffer_size;
+            buffers = (std::byte *)map(-1, buffers_size, 0, 0);
+            if (buffer_ring == nullptr || buffers == nullptr) {
+                return false;
+            }
+
+            io_uring_buf_reg reg{};
+            reg.ring_addr = (uint64_t)buffer_ring;
+            reg.ring_entries = nb_buffers;
+            reg.bgid = 0;
+            use_buffer_ring =
+                register_op(IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+
+            for (uint32_t bid = 0; bid < nb_buffers; bid++) {
+                recycle(bid);
+            }
+            publish_buffers();
+
+            if (use_buffer_ring && !probe_buffer_ring()) {
+                register_op(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+                use_buffer_ring = false;
+                buffer_tail = 0;
+                for (uint32_t bid = 0; bid < nb_buffers; bid++) {
+                    recycle(bid);
+                }
+                publish_buffers();
+            }
+            return true;
+        }
+
+        /*
+         * Some kernels accept the buffer ring registration but never select
+         * from it, a one byte read from a pipe tells
+         */
+        bool probe_buffer_ring()
+        {
+            int pipe_fds[2];
+            if (::pipe2(pipe_fds, O_CLOEXEC) != 0) {
+                return false;
+            }
+            char byte = 0;
+            io_uring_sqe *sqe = nullptr;
+            bool written = ::write(pipe_fds[1], &byte, 1) == 1;
+            if (written) {
+                sqe = next_sqe();
+            }
+            if (sqe != nullptr) {
+                sqe->opcode = IORING_OP_READ;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->fd = pipe_fds[0];
+                sqe->off = uint64_t(-1);
+                sqe->buf_group = 0;
+                sqe->user_data = provide_tag;
+                enter(1, std::chrono::seconds(1));
+            }
+            ::close(pipe_fds[0]);
+            ::close(pipe_fds[1]);
+
+            bool selected = false;
+            uint32_t head = *cq_head;
+            uint32_t tail = std::atomic_ref<uint32_t>(*cq_tail).load(
+                std::memory_order_acquire);
+            for (; head != tail; head++) {
+                const io_uring_cqe &cqe = cqes[head & cq_mask];
+                if ((cqe.flags & IORING_CQE_F_BUFFER) != 0) {
+                    selected = cqe.res > 0;
+                    recycle(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                }
+            }
+            std::atomic_ref<uint32_t>(*cq_head).store(
+                head, std::memory_order_release);
+            return selected;
+        }
+
+        bool setup_send_slots()
+        {
+            uint32_t nb_slots = std::max<uint32_t>(1, config.nb_send_slots);
+            send_buffers_size = size_t(nb_slots) * config.send_slot_size;
+            send_buffers = (std::byte *)map(-1, send_buffers_size, 0, 0);
+            if (send_buffers == nullptr) {
+                return false;
+            }
+
+            // Pinning can fail under a low RLIMIT_MEMLOCK, sends then
+            // stay zero copy without fixed buffers
+            if (config.zero_copy_send) {
+                iovec iov{send_buffers, send_buffers_size};
+                fixed_send_buffers =
+                    register_op(IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+            }
+
+            send_slots.resize(nb_slots);
+            for (uint32_t idx = nb_slots; idx-- > 0;) {
+                free_send_slots.push_back(idx);
+            }
+            return true;
+        }
+
+        void recycle(uint16_t bid)
+        {
+            if (!use_buffer_ring) {
+                returned_buffers.push_back(bid);
+                return;
+            }
+            io_uring_buf &buf = buffer_ring->bufs[buffer_tail & buffer_mask];
+            buf.addr = (uint64_t)buffer(bid);
+            buf.len = config.buffer_size;
+            buf.bid = bid;
+            buffer_tail++;
+        }
+
+        // Without a buffer ring, runs of adjacent ids go back in one SQE
+        void publish_buffers()
+        {
+            if (use_buffer_ring) {
+                std::atomic_ref<uint16_t>(buffer_ring->tail)
+                    .store(buffer_tail, std::memory_order_release);
+                return;
+            }
+
+            std::ranges::sort(returned_buffers);
+            size_t idx = 0;
+            while (idx < returned_buffers.size()) {
+                uint16_t first = returned_buffers[idx];
+                size_t end = idx + 1;
+                while (end < returned_buffers.size() &&
+                       returned_buffers[end] == first + (end - idx)) {
+                    end++;
+                }
+
+                io_uring_sqe *sqe = next_sqe();
+                if (sqe == nullptr) {
+                    break;
+                }
+                sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+                sqe->fd = end - idx;
+                sqe->addr = (uint64_t)buffer(first);
+                sqe->len = config.buffer_size;
+                sqe->off = first;
+                sqe->buf_group = 0;
+                sqe->user_data = provide_tag;
+                idx = end;
+            }
+            returned_buffers.erase(
+                returned_buffers.begin(), returned_buffers.begin() + idx);
+        }
+
+        std::byte *buffer(uint16_t bid) const
+        {
+            return buffers + size_t(bid) * config.buffer_size;
+        }
+
+        io_uring_sqe *next_sqe()
+        {
+            uint32_t head =
+                std::atomic_ref<uint32_t>(*sq_head).load(
+                    std::memory_order_acquire);
+            if (sq_local_tail - head == sq_entries) {
+                enter(0, std::chrono::microseconds(0));
+                head = std::atomic_ref<uint32_t>(*sq_head).load(
+                    std::memory_order_acquire);
+                if (sq_local_tail - head == sq_entries) {
+                    return nullptr;
+                }
+            }
+
+            io_uring_sqe *sqe = &sqes[sq_local_tail & sq_mask];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sq_local_tail++;
+            return sqe;
+        }
+
+        bool arm_receive()
+        {
+            io_uring_sqe *sqe = next_sqe();
+            if (sqe == nullptr) {
+                return false;
+            }
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+            sqe->fd = 0;
+            sqe->addr = (uint64_t)&recv_msg;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->buf_group = 0;
+            sqe->user_data = recv_tag;
+            recv_armed = true;
+            return true;
+        }
+
+        bool send(std::span<const std::byte> data, const Endpoint &peer)
+        {
+            if (data.size() > config.send_slot_size) {
+                return false;
+            }
+            // Completions of a cooperative ring only arrive on entering it
+            if (free_send_slots.empty()) {
+                enter(1, std::chrono::milliseconds(1));
+                reap({});
+                if (free_send_slots.empty()) {
+                    return false;
+                }
+            }
+
+            io_uring_sqe *sqe = next_sqe();
+            if (sqe == nullptr) {
+                return false;
+            }
+            uint32_t slot_idx = free_send_slots.back();
+            free_send_slots.pop_back();
+
+            SendSlot &slot = send_slots[slot_idx];
+            std::byte *buffer =
+                send_buffers + size_t(slot_idx) * config.send_slot_size;
+            std::memcpy(buffer, data.data(), data.size());
+            slot.address = to_sockaddr(peer);
+            slot.awaiting_notification = false;
+
+            sqe->fd = 0;
+            sqe->flags = IOSQE_FIXED_FILE;
+            sqe->user_data = send_tag + slot_idx;
+            if (config.zero_copy_send) {
+                sqe->opcode = IORING_OP_SEND_ZC;
+                sqe->addr = (uint64_t)buffer;
+                sqe->len = data.size();
+                sqe->addr2 = (uint64_t)&slot.address;
+                sqe->addr_len = sizeof(sockaddr_in);
+                if (fixed_send_buffers) {
+                    sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+                    sqe->buf_index = 0;
+                }
+            } else {
+                slot.iov = iovec{buffer, data.size()};
+                slot.msg = msghdr{};
+                slot.msg.msg_name = &slot.address;
+                slot.msg.msg_namelen = sizeof(sockaddr_in);
+                slot.msg.msg_iov = &slot.iov;
+                slot.msg.msg_iovlen = 1;
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->addr = (uint64_t)&slot.msg;
+                sqe->len = 1;
+            }
+            return true;
+        }
+
+        // Submits what is queued and waits for one completion if `wait`
+        bool enter(uint32_t wait, std::chrono::microseconds timeout)
+        {
+            uint32_t to_submit = sq_local_tail - sq_submitted;
+            std::atomic_ref<uint32_t>(*sq_tail)
+                .store(sq_local_tail, std::memory_order_release);
+            sq_submitted = sq_local_tail;
+
+            unsigned flags = 0;
+            if (config.sqpoll) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                uint32_t sq_state = std::atomic_ref<uint32_t>(*sq_flags).load(
+                    std::memory_order_relaxed);
+                if ((sq_state & IORING_SQ_NEED_WAKEUP) != 0) {
+                    flags |= IORING_ENTER_SQ_WAKEUP;
+                }
+                to_submit = 0;
+            }
+            if (wait != 0) {
+                flags |= IORING_ENTER_GETEVENTS;
+            }
+            if (to_submit == 0 && flags == 0) {
+                return true;
+            }
+
+            __kernel_timespec ts{};
+            ts.tv_sec = timeout.count() / 1'000'000;
+            ts.tv_nsec = timeout.count() % 1'000'000 * 1'000;
+            io_uring_getevents_arg arg{};
+            arg.ts = (uint64_t)&ts;
+
+            int result = ::syscall(
+                __NR_io_uring_enter,
+                ring_fd,
+                to_submit,
+                wait,
+                flags | IORING_ENTER_EXT_ARG,
+                &arg,
+                sizeof(arg));
+            return result >= 0 || errno == ETIME || errno == EINTR ||
+                   errno == EAGAIN || errno == EBUSY;
+        }
+
+        std::optional<size_t> receive(
+            std::span<UringDatagram> output,
+            std::chrono::microseconds timeout)
+        {
+            publish_buffers();
+            if (!recv_armed && !arm_receive()) {
+                return std::nullopt;
+            }
+
+            if (cq_ready() == 0 && pending_head == pending_receives.size()) {
+                uint32_t wait = timeout.count() != 0 ? 1 : 0;
+                if (!enter(wait, timeout)) {
+                    return std::nullopt;
+                }
+            } else if (sq_local_tail != sq_submitted) {
+                enter(0, std::chrono::microseconds(0));
+            }
+            return reap(output);
+        }
+
+        uint32_t cq_ready() const
+        {
+            uint32_t tail = std::atomic_ref<uint32_t>(*cq_tail).load(
+                std::memory_order_acquire);
+            return tail - *cq_head;
+        }
+
+        /*
+         * Consumes every completion, receives fill `output` and queue up
+         * once it is full so the send completions behind them are reached
+         */
+        size_t reap(std::span<UringDatagram> output)
+        {
+            size_t count = 0;
+            while (pending_head != pending_receives.size() &&
+                   count != output.size()) {
+                if (complete_receive(
+                        pending_receives[pending_head++], output[count])) {
+                    count++;
+                }
+            }
+            if (pending_head == pending_receives.size()) {
+                pending_receives.clear();
+                pending_head = 0;
+            }
+
+            uint32_t head = *cq_head;
+            uint32_t tail = std::atomic_ref<uint32_t>(*cq_tail).load(
+                std::memory_order_acquire);
+            for (; head != tail; head++) {
+                const io_uring_cqe &cqe = cqes[head & cq_mask];
+                if (cqe.user_data == recv_tag) {
+                    if ((cqe.flags & IORING_CQE_F_MORE) == 0) {
+                        recv_armed = false;
+                        stats.rearms++;
+                    }
+                    ReceiveCompletion completion{cqe.res, cqe.flags};
+                    if (count == output.size()) {
+                        pending_receives.push_back(completion);
+                    } else if (complete_receive(completion, output[count])) {
+                        count++;
+                    }
+                } else if (cqe.user_data != provide_tag) {
+                    complete_send(cqe);
+                }
+            }
+
+            std::atomic_ref<uint32_t>(*cq_head).store(
+                head, std::memory_order_release);
+            return count;
+        }
+
+        bool complete_receive(
+            const ReceiveCompletion &cqe, UringDatagram &output)
+        {
+            if (cqe.res < 0) {
+                stats.no_buffers += cqe.res == -ENOBUFS;
+                return false;
+            }
+            if ((cqe.flags & IORING_CQE_F_BUFFER) == 0) {
+                return false;
+            }
+
+            uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            std::byte *data = buffer(bid);
+            io_uring_recvmsg_out out;
+            std::memcpy(&out, data, sizeof(out));
+
+            if ((out.flags & MSG_TRUNC) != 0 ||
+                out.namelen < sizeof(sockaddr_in)) {
+                stats.truncated++;
+                recycle(bid);
+                return false;
+            }
+
+            sockaddr_in peer;
+            std::memcpy(&peer, data + sizeof(out), sizeof(peer));
+            std::byte *payload = data + sizeof(out) + recv_msg.msg_namelen +
+                                 recv_msg.msg_controllen;
+
+            output.peer = from_sockaddr(peer);
+            output.buffer_id = bid;
+
+            // The control area, unused, becomes the UDP header
+            std::byte *header = payload - header_size;
+            auto source = htobe<uint16_t>(output.peer.port);
+            auto destination = htobe<uint16_t>(local_port);
+            auto length = htobe<uint16_t>(out.payloadlen + header_size);
+            std::memcpy(header, source.data(), 2);
+            std::memcpy(header + 2, destination.data(), 2);
+            std::memcpy(header + 4, length.data(), 2);
+            std::memset(header + 6, 0, 2);
+
+            output.datagram = std::span<const std::byte>(
+                header, out.payloadlen + header_size);
+            stats.received++;
+            return true;
+        }
+
+        void complete_send(const io_uring_cqe &cqe)
+        {
+            uint32_t slot_idx = cqe.user_data - send_tag;
+            SendSlot &slot = send_slots[slot_idx];
+
+            // Zero copy sends complete twice, the buffer is free on the
+            // notification
+            if ((cqe.flags & IORING_CQE_F_NOTIF) == 0) {
+                if (cqe.res < 0) {
+                    stats.send_errors++;
+                } else {
+                    stats.sent++;
+                }
+                if ((cqe.flags & IORING_CQE_F_MORE) != 0) {
+                    slot.awaiting_notification = true;
+                    return;
+                }
+            }
+            free_send_slots.push_back(slot_idx);
+        }
+
+        int register_op(unsigned opcode, void *arg, unsigned nb_args)
+        {
+            return ::syscall(
+                __NR_io_uring_register, ring_fd, opcode, arg, nb_args);
+        }
+
+        static void *map(int fd, size_t size, uint64_t offset, int flags)
+        {
+            int map_flags = fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED;
+            void *output = ::mmap(
+                nullptr,
+                size,
+                PROT_READ | PROT_WRITE,
+                map_flags | flags,
+                fd,
+                offset);
+            return output == MAP_FAILED ? nullptr : output;
+        }
+
+        static void unmap(void *memory, size_t size)
+        {
+            if (memory != nullptr) {
+                ::munmap(memory, size);
+            }
+        }
+    };
+
+    std::unique_ptr<State> m_state;
+
+    explicit UringSocket(std::unique_ptr<State> state)
+        : m_state(std::move(state))
+    {
+    }
+};
+
+} // namespace xnet::UDP
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/Ring.hh>
+
+namespace xnet {
+
+struct ExecutorStats
+{
+    std::atomic<uint64_t> batches{0};
+    // Steal attempts that brought shards over, and how many shards
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> stolen_shards{0};
+    std::atomic<uint64_t> sleeps{0};
+};
+
+/*
+ * Work stealing executor for batches of packets. Work is submitted per
+ * shard (e.g. chaddr shard) and a shard is the unit that moves between
+ * workers: its batches wait in its own bounded queue, the shard sits in at
+ * most one worker deque at a time, so batches of a shard run one at a time
+ * and in submission order, on any worker. Per shard state such as a
+ * ShardEngine needs no locking.
+ *
+ * A shard becoming runnable goes to its home worker (shard % nb_workers),
+ * idle workers steal half of another worker's runnable shards. A worker
+ * runs at most `quantum` batches of a shard before moving to the next one.
+ *
+ * The handler owns the batch after the call, queues only carry pointers.
+ */
+template <typename Batch>
+struct WorkStealingExecutor
+{
+    using Handler = std::function<void(size_t worker, uint32_t shard, Batch *)>;
+
+    WorkStealingExecutor(
+        size_t nb_workers,
+        uint32_t nb_shards,
+        size_t shard_queue_size,
+        Handler handler,
+        size_t quantum = 8)
+        : m_handler(std::move(handler)), m_quantum(std::max<size_t>(1, quantum))
+    {
+        for (uint32_t shard = 0; shard < nb_shards; shard++) {
+            m_shards.push_back(std::make_unique<Shard>(shard_queue_size));
+        }
+        for (size_t idx = 0; idx < std::max<size_t>(1, nb_workers); idx++) {
+            m_workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t idx = 0; idx < m_workers.size(); idx++) {
+            m_workers[idx]->thread = std::jthread(
+                [this, idx](std::stop_token st) { run(st, idx); });
+        }
+    }
+
+    WorkStealingExecutor(const WorkStealingExecutor &) = delete;
+    WorkStealingExecutor &operator=(const WorkStealingExecutor &) = delete;
+
+    ~WorkStealingExecutor()
+    {
+        stop();
+    }
+
+    size_t nb_workers() const
+    {
+        return m_workers.size();
+    }
+
+    const ExecutorStats &stats(size_t worker) const
+    {
+        return m_workers[worker]->stats;
+    }
+
+    // Any thread, false if the shard queue is full
+    bool submit(uint32_t shard, Batch *batch)
+    {
+        Shard &s = *m_shards[shard];
+        if (!s.queue.push(batch)) {
+            return false;
+        }
+        // Pairs with run_shard(): the push or the cleared flag is seen
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!s.scheduled.exchange(true, std::memory_order_seq_cst)) {
+            schedule(shard % m_workers.size(), shard);
+        }
+        return true;
+    }
+
+    // Joins the workers, batches still queued are not run
+    void stop()
+    {
+        for (auto &worker : m_workers) {
+            worker->thread.request_stop();
+        }
+        m_epoch.fetch_add(1, std::memory_order_release);
+        m_epoch.notify_all();
+        for (auto &worker : m_workers) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+    }
+
+  private:
+    struct Shard
+    {
+        Shard(size_t queue_size) : queue(queue_size)
+        {
+        }
+
+        MpscRing<Batch *> queue;
+        // Set while the shard is in a deque or running
+        std::atomic<bool> scheduled{false};
+    };
+
+    struct alignas(cache_line_size) Worker
+    {
+        std::mutex mutex;
+        std::deque<uint32_t> runnable;
+        ExecutorStats stats;
+        std::jthread thread;
+    };
+
+    Handler m_handler;
+    size_t m_quantum;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<uint32_t> m_epoch{0};
+    std::atomic<uint32_t> m_sleepers{0};
+
+    void schedule(size_t worker, uint32_t shard)
+    {
+        {
+            std::lock_guard lock(m_workers[worker]->mutex);
+            m_workers[worker]->runnable.push_back(shard);
+        }
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_seq_cst) != 0) {
+            m_epoch.notify_one();
+        }
+    }
+
+    std::optional<uint32_t> pop_local(size_t worker)
+    {
+        Worker &w = *m_workers[worker];
+        std::lock_guard lock(w.mutex);
+        if (w.runnable.empty()) {
+            return std::nullopt;
+        }
+        uint32_t shard = w.runnable.front();
+        w.runnable.pop_front();
+        return shard;
+    }
+
+    // Takes the newer half of a victim's runnable shards
+    bool steal(size_t thief)
+    {
+        Worker &t = *m_workers[thief];
+        for (size_t offset = 1; offset < m_workers.size(); offset++) {
+            Worker &victim = *m_workers[(thief + offset) % m_workers.size()];
+
+            std::vector<uint32_t> taken;
+            {
+                std::lock_guard lock(victim.mutex);
+                size_t count = (victim.runnable.size() + 1) / 2;
+                auto first = victim.runnable.end() - count;
+                taken.assign(first, victim.runnable.end());
+                victim.runnable.erase(first, victim.runnable.end());
+            }
+            if (taken.empty()) {
+                continue;
+            }
+
+            {
+                std::lock_guard lock(t.mutex);
+                t.runnable.insert(t.runnable.end(), taken.begin(), taken.end());
+            }
+            t.stats.steals.fetch_add(1, std::memory_order_relaxed);
+            t.stats.stolen_shards.fetch_add(
+                taken.size(), std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void run_shard(size_t worker, uint32_t shard)
+    {
+        Shard &s = *m_shards[shard];
+        std::array<Batch *, 8> burst;
+        size_t budget = m_quantum;
+        while (budget != 0) {
+            size_t n = s.queue.pop_burst(
+                std::span(burst).first(std::min(budget, burst.size())));
+            if (n == 0) {
+                break;
+            }
+            for (size_t idx = 0; idx < n; idx++) {
+                m_handler(worker, shard, burst[idx]);
+            }
+            m_workers[worker]->stats.batches.fetch_add(
+                n, std::memory_order_relaxed);
+            budget -= n;
+        }
+
+        // Leftovers keep the shard here, after the other runnable shards
+        if (budget == 0) {
+            schedule(worker, shard);
+            return;
+        }
+        s.scheduled.store(false, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (s.queue.size() != 0 &&
+            !s.scheduled.exchange(true, std::memory_order_seq_cst)) {
+            schedule(worker, shard);
+        }
+    }
+
+    void run(std::stop_token st, size_t worker)
+    {
+        while (!st.stop_requested()) {
+            uint32_t epoch = m_epoch.load(std::memory_order_seq_cst);
+            if (auto shard = pop_local(worker)) {
+                run_shard(worker, *shard);
+                continue;
+            }
+            if (steal(worker)) {
+                continue;
+            }
+
+            m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+            if (m_epoch.load(std::memory_order_seq_cst) == epoch &&
+                !st.stop_requested()) {
+                m_workers[worker]->stats.sleeps.fetch_add(
+                    1, std::memory_order_relaxed);
+                m_epoch.wait(epoch, std::memory_order_seq_cst);
+            }
+            m_sleepers.fetch_sub(1, std::memory_order_seq_cst);
+        }
+    }
+};
+
+} // namespace xnet
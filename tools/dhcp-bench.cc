@@ -0,0 +1,165 @@
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+
+#include <cstdint>
+
+#include <xnet/DHCPLoadGenerator.hh>
+#include <xnet/DHCPServer.hh>
+#include <xnet/Histogram.hh>
+
+using namespace xnet;
+
+/*
+ * Loopback load test of the DHCP server: a Server on 127.0.0.1, answering
+ * to the datagram source, driven by the load generator in the same process.
+ * Reports transactions per second and latency percentiles.
+ */
+
+struct Options
+{
+    size_t workers = 1;
+    uint32_t pool = 1 << 20;
+    uint64_t clients = 100'000;
+    double rate = 50'000;
+    size_t threads = 1;
+    size_t outstanding = 1 << 16;
+    std::chrono::milliseconds duration{5000};
+};
+
+template <typename T>
+static bool parse_number(std::string_view text, T &output)
+{
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), output);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--workers N] [--pool N] [--clients N] "
+        "[--rate PER_SECOND]\n"
+        "    [--threads N] [--outstanding N] [--duration MS]\n",
+        name);
+}
+
+static void print_latency(const char *name, const LatencyHistogram &h)
+{
+    std::printf(
+        "%-6s count %10lu p50 %8lu p99 %8lu p99.9 %8lu max %8lu (us)\n",
+        name,
+        h.count(),
+        h.percentile(0.5) / 1000,
+        h.percentile(0.99) / 1000,
+        h.percentile(0.999) / 1000,
+        h.max() / 1000);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int idx = 1; idx < argc; idx++) {
+        std::string_view key = argv[idx];
+        if (idx + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++idx];
+
+        bool parsed = true;
+        uint64_t ms = 0;
+        if (key == "--workers") {
+            parsed = parse_number(value, options.workers);
+        } else if (key == "--pool") {
+            parsed = parse_number(value, options.pool);
+        } else if (key == "--clients") {
+            parsed = parse_number(value, options.clients);
+        } else if (key == "--rate") {
+            parsed = parse_number(value, options.rate);
+        } else if (key == "--threads") {
+            parsed = parse_number(value, options.threads);
+        } else if (key == "--outstanding") {
+            parsed = parse_number(value, options.outstanding);
+        } else if (key == "--duration") {
+            parsed = parse_number(value, ms);
+            options.duration = std::chrono::milliseconds(ms);
+        } else {
+            parsed = false;
+        }
+
+        if (!parsed) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    DHCP::ServerConfig server_config;
+    server_config.server_address = IPv4::Address(127, 0, 0, 1);
+    server_config.pool_start = IPv4::Address(10, 0, 0, 0);
+    server_config.pool_size = options.pool;
+    server_config.bind_to = UDP::Endpoint{IPv4::Address(127, 0, 0, 1), 0};
+    server_config.reply_to_source = true;
+    server_config.nb_workers = options.workers;
+
+    DHCP::Server server(server_config);
+    if (!server.start()) {
+        std::perror("server");
+        return 1;
+    }
+
+    DHCP::LoadConfig load_config;
+    load_config.server = server.endpoint();
+    load_config.nb_clients = options.clients;
+    load_config.rate = options.rate;
+    load_config.duration = options.duration;
+    load_config.max_outstanding = options.outstanding;
+    load_config.nb_threads = options.threads;
+
+    auto report_opt = DHCP::run_load(load_config);
+    if (!report_opt) {
+        std::perror("load");
+        return 1;
+    }
+    const DHCP::LoadReport &report = report_opt.value();
+
+    uint64_t received = 0;
+    uint64_t acks = 0;
+    uint64_t dropped = 0;
+    for (size_t worker = 0; worker < server.nb_workers(); worker++) {
+        const DHCP::ShardStats &stats = server.stats(worker);
+        received += stats.received.load(std::memory_order_relaxed);
+        acks += stats.acks.load(std::memory_order_relaxed);
+        dropped += stats.pool_exhausted.load(std::memory_order_relaxed) +
+                   stats.rate_limited.load(std::memory_order_relaxed) +
+                   stats.malformed.load(std::memory_order_relaxed);
+    }
+
+    LatencyHistogram all;
+    all.merge(report.offer_latency);
+    all.merge(report.bind_latency);
+    all.merge(report.renew_latency);
+
+    std::printf(
+        "%zu workers, %lu clients at %.0f/s: bound %lu renewed %lu naks %lu "
+        "timeouts %lu\n",
+        server.nb_workers(),
+        options.clients,
+        options.rate,
+        report.bound,
+        report.renewed,
+        report.naks,
+        report.timeouts);
+    std::printf(
+        "server received %lu acks %lu dropped %lu\n", received, acks, dropped);
+    std::printf(
+        "%.0f transactions/s, p99 %lu us\n",
+        report.transactions_per_second(),
+        all.percentile(0.99) / 1000);
+    print_latency("offer", report.offer_latency);
+    print_latency("bind", report.bind_latency);
+    print_latency("renew", report.renew_latency);
+    return 0;
+}
@@ -0,0 +1,317 @@
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <csignal>
+#include <cstdint>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <xnet/DHCPLoadGenerator.hh>
+#include <xnet/DHCPServer.hh>
+#include <xnet/Histogram.hh>
+#include <xnet/SharedMemory.hh>
+
+using namespace xnet;
+
+/*
+ * Hot restart on loopback with two processes at a time: a server runs in a
+ * child process while the load generator runs here, and every interval a
+ * successor process takes its sockets and lease tables over. Lost requests
+ * show up as load generator timeouts.
+ *
+ * The server processes are this same binary started with --serve.
+ */
+
+extern char **environ;
+
+struct Options
+{
+    size_t workers = 2;
+    uint32_t pool = 1 << 16;
+    uint16_t port = 16767;
+    std::string store;
+    uint64_t clients = 20'000;
+    double rate = 20'000;
+    size_t restarts = 3;
+    std::chrono::milliseconds duration{5000};
+    bool serve = false;
+};
+
+static std::atomic<bool> stop_requested{false};
+
+template <typename T>
+static bool parse_number(std::string_view text, T &output)
+{
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), output);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--workers N] [--pool N] [--port N] [--store PATH]\n"
+        "    [--clients N] [--rate PER_SECOND] [--restarts N] "
+        "[--duration MS]\n",
+        name);
+}
+
+static std::string shared_state_name(const Options &options)
+{
+    return "/xnet-hot-restart-" + std::to_string(options.port);
+}
+
+static std::string handover_path(const Options &options)
+{
+    return "/tmp/xnet-hot-restart-" + std::to_string(options.port) + ".sock";
+}
+
+static DHCP::ServerConfig server_config(const Options &options)
+{
+    DHCP::ServerConfig config;
+    config.server_address = IPv4::Address(127, 0, 0, 1);
+    config.pool_start = IPv4::Address(10, 0, 0, 0);
+    config.pool_size = options.pool;
+    config.bind_to =
+        UDP::Endpoint{IPv4::Address(127, 0, 0, 1), options.port};
+    config.reply_to_source = true;
+    config.nb_workers = options.workers;
+    config.lease_store_path = options.store;
+    config.shared_state_name = shared_state_name(options);
+    config.handover_path = handover_path(options);
+    return config;
+}
+
+// Serves until handed over (exit 0), stopped by a signal or failed
+static int serve(const Options &options)
+{
+    std::signal(SIGTERM, [](int) { stop_requested = true; });
+    std::signal(SIGINT, [](int) { stop_requested = true; });
+
+    DHCP::Server server(server_config(options));
+    if (!server.start()) {
+        std::perror("server");
+        return 1;
+    }
+
+    while (!stop_requested && !server.handed_over() && !server.failed()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return server.failed() ? 1 : 0;
+}
+
+static std::optional<pid_t> spawn_server(const Options &options)
+{
+    std::vector<std::string> args = {
+        "xnet-dhcp-hot-restart",
+        "--serve",
+        "--workers",
+        std::to_string(options.workers),
+        "--pool",
+        std::to_string(options.pool),
+        "--port",
+        std::to_string(options.port),
+    };
+    if (!options.store.empty()) {
+        args.push_back("--store");
+        args.push_back(options.store);
+    }
+
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = 0;
+    if (::posix_spawn(
+            &pid, "/proc/self/exe", nullptr, nullptr, argv.data(), environ) !=
+        0) {
+        return std::nullopt;
+    }
+    return pid;
+}
+
+// Exit status of `pid` once it is done, empty while it runs
+static std::optional<int> exited(pid_t pid)
+{
+    int status = 0;
+    if (::waitpid(pid, &status, WNOHANG) != pid) {
+        return std::nullopt;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128;
+}
+
+/*
+ * Starts a successor of `current` and waits for one of the two to exit:
+ * the predecessor after handing over, or the successor after failing.
+ * Returns the process serving afterwards.
+ */
+static pid_t restart(const Options &options, pid_t current, size_t round)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto successor = spawn_server(options);
+    if (!successor) {
+        std::printf("restart %zu: spawn failed\n", round);
+        return current;
+    }
+
+    while (true) {
+        if (auto status = exited(current)) {
+            double ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+            std::printf(
+                "restart %zu: pid %d -> pid %d in %.1f ms%s\n",
+                round,
+                current,
+                *successor,
+                ms,
+                *status == 0 ? "" : " (predecessor failed)");
+            return *successor;
+        }
+        if (auto status = exited(*successor)) {
+            std::printf(
+                "restart %zu: successor pid %d exited with %d, pid %d kept "
+                "serving\n",
+                round,
+                *successor,
+                *status,
+                current);
+            return current;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+static void print_latency(const char *name, const LatencyHistogram &h)
+{
+    std::printf(
+        "%-6s count %10lu p50 %8lu p99 %8lu p99.9 %8lu max %8lu (us)\n",
+        name,
+        h.count(),
+        h.percentile(0.5) / 1000,
+        h.percentile(0.99) / 1000,
+        h.percentile(0.999) / 1000,
+        h.max() / 1000);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int idx = 1; idx < argc; idx++) {
+        std::string_view key = argv[idx];
+        if (key == "--serve") {
+            options.serve = true;
+            continue;
+        }
+        if (idx + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++idx];
+
+        bool parsed = true;
+        uint64_t ms = 0;
+        if (key == "--workers") {
+            parsed = parse_number(value, options.workers);
+        } else if (key == "--pool") {
+            parsed = parse_number(value, options.pool);
+        } else if (key == "--port") {
+            parsed = parse_number(value, options.port);
+        } else if (key == "--store") {
+            options.store = value;
+        } else if (key == "--clients") {
+            parsed = parse_number(value, options.clients);
+        } else if (key == "--rate") {
+            parsed = parse_number(value, options.rate);
+        } else if (key == "--restarts") {
+            parsed = parse_number(value, options.restarts);
+        } else if (key == "--duration") {
+            parsed = parse_number(value, ms);
+            options.duration = std::chrono::milliseconds(ms);
+        } else {
+            parsed = false;
+        }
+
+        if (!parsed) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (options.serve) {
+        return serve(options);
+    }
+
+    // Leftovers of an earlier run would be taken for a running server
+    SharedRegion::unlink(shared_state_name(options));
+    ::unlink(handover_path(options).c_str());
+
+    auto first = spawn_server(options);
+    if (!first) {
+        std::perror("spawn");
+        return 1;
+    }
+    pid_t current = *first;
+
+    // The handover socket appears once the server is up
+    for (int attempt = 0; ::access(handover_path(options).c_str(), F_OK) != 0;
+         attempt++) {
+        if (attempt == 2000 || exited(current)) {
+            std::fprintf(stderr, "server did not start\n");
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    DHCP::LoadConfig load_config;
+    load_config.server =
+        UDP::Endpoint{IPv4::Address(127, 0, 0, 1), options.port};
+    load_config.nb_clients = options.clients;
+    load_config.rate = options.rate;
+    load_config.duration = options.duration;
+
+    std::optional<DHCP::LoadReport> report;
+    std::thread load([&] { report = DHCP::run_load(load_config); });
+
+    auto interval = options.duration / (options.restarts + 1);
+    for (size_t round = 1; round <= options.restarts; round++) {
+        std::this_thread::sleep_for(interval);
+        current = restart(options, current, round);
+    }
+    load.join();
+
+    ::kill(current, SIGTERM);
+    ::waitpid(current, nullptr, 0);
+    SharedRegion::unlink(shared_state_name(options));
+    ::unlink(handover_path(options).c_str());
+
+    if (!report) {
+        std::perror("load");
+        return 1;
+    }
+    std::printf(
+        "%lu clients at %.0f/s: bound %lu renewed %lu naks %lu timeouts "
+        "%lu\n",
+        options.clients,
+        options.rate,
+        report->bound,
+        report->renewed,
+        report->naks,
+        report->timeouts);
+    print_latency("offer", report->offer_latency);
+    print_latency("bind", report->bind_latency);
+    print_latency("renew", report->renew_latency);
+    return report->timeouts == 0 ? 0 : 1;
+}
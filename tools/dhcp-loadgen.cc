@@ -0,0 +1,144 @@
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <cstdint>
+
+#include <arpa/inet.h>
+
+#include <xnet/DHCPLoadGenerator.hh>
+
+using namespace xnet;
+
+static std::optional<UDP::Endpoint> parse_endpoint(std::string_view text)
+{
+    auto colon = text.rfind(':');
+    std::string host(text.substr(0, colon));
+
+    std::array<std::byte, 4> address{};
+    if (::inet_pton(AF_INET, host.c_str(), address.data()) != 1) {
+        return std::nullopt;
+    }
+
+    uint16_t port = 0;
+    if (colon != std::string_view::npos) {
+        auto port_text = text.substr(colon + 1);
+        auto [end, ec] = std::from_chars(
+            port_text.data(), port_text.data() + port_text.size(), port);
+        if (ec != std::errc() || end != port_text.data() + port_text.size()) {
+            return std::nullopt;
+        }
+    }
+    return UDP::Endpoint{IPv4::Address(address), port};
+}
+
+template <typename T>
+static bool parse_number(std::string_view text, T &output)
+{
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), output);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--server ADDR:PORT] [--bind ADDR:PORT] "
+        "[--interface IFNAME]\n"
+        "    [--clients N] [--first-client N] [--rate PER_SECOND] "
+        "[--duration SECONDS]\n"
+        "    [--timeout MS] [--outstanding N] [--threads N]\n",
+        name);
+}
+
+static void print_latency(const char *name, const LatencyHistogram &h)
+{
+    std::printf(
+        "%-6s count %10lu min %8lu p50 %8lu p99 %8lu p99.9 %8lu "
+        "max %8lu (us)\n",
+        name,
+        h.count(),
+        h.min() / 1000,
+        h.percentile(0.5) / 1000,
+        h.percentile(0.99) / 1000,
+        h.percentile(0.999) / 1000,
+        h.max() / 1000);
+}
+
+int main(int argc, char **argv)
+{
+    DHCP::LoadConfig config;
+
+    for (int idx = 1; idx < argc; idx++) {
+        std::string_view key = argv[idx];
+        if (idx + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++idx];
+
+        bool parsed = true;
+        if (key == "--server" || key == "--bind") {
+            auto endpoint = parse_endpoint(value);
+            parsed = endpoint.has_value();
+            if (parsed) {
+                (key == "--server" ? config.server : config.bind_to) =
+                    endpoint.value();
+            }
+        } else if (key == "--interface") {
+            config.interface = value;
+        } else if (key == "--clients") {
+            parsed = parse_number(value, config.nb_clients);
+        } else if (key == "--first-client") {
+            parsed = parse_number(value, config.first_client);
+        } else if (key == "--rate") {
+            parsed = parse_number(value, config.rate);
+        } else if (key == "--duration") {
+            uint64_t seconds = 0;
+            parsed = parse_number(value, seconds);
+            config.duration = std::chrono::seconds(seconds);
+        } else if (key == "--timeout") {
+            uint64_t ms = 0;
+            parsed = parse_number(value, ms);
+            config.timeout = std::chrono::milliseconds(ms);
+        } else if (key == "--outstanding") {
+            parsed = parse_number(value, config.max_outstanding);
+        } else if (key == "--threads") {
+            parsed = parse_number(value, config.nb_threads);
+        } else {
+            parsed = false;
+        }
+
+        if (!parsed) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    auto report_opt = DHCP::run_load(config);
+    if (!report_opt) {
+        std::perror("dhcp-loadgen");
+        return 1;
+    }
+
+    const DHCP::LoadReport &report = report_opt.value();
+    std::printf(
+        "sent %lu received %lu stray %lu bound %lu renewed %lu naks %lu "
+        "timeouts %lu\n",
+        report.sent,
+        report.received,
+        report.stray,
+        report.bound,
+        report.renewed,
+        report.naks,
+        report.timeouts);
+    std::printf("%.0f transactions/s\n", report.transactions_per_second());
+    print_latency("offer", report.offer_latency);
+    print_latency("bind", report.bind_latency);
+    print_latency("renew", report.renew_latency);
+    return 0;
+}
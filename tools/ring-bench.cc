@@ -0,0 +1,286 @@
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <xnet/DHCP.hh>
+#include <xnet/Ring.hh>
+
+using namespace xnet;
+
+/*
+ * Cross core handoff cost of the packet rings: throughput of bursts from
+ * producers to one consumer, and one way latency from a ping-pong between
+ * two threads. Handles point at DHCP sized buffers the consumer reads
+ * through a view, so payload lines move between cores as in a pipeline.
+ */
+
+struct Handle
+{
+    std::byte *data;
+    uint32_t size;
+};
+
+struct Options
+{
+    bool mpsc = false;
+    size_t nb_producers = 1;
+    size_t burst = 32;
+    size_t capacity = 1024;
+    uint64_t count = 10'000'000;
+    uint64_t round_trips = 1'000'000;
+    std::vector<int> cpus;
+};
+
+constexpr size_t packet_size = 300;
+
+// Keeps the consumer's reads from being optimized out
+static volatile uint64_t sink;
+
+template <typename T>
+static bool parse_number(std::string_view text, T &output)
+{
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), output);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static bool parse_cpus(std::string_view text, std::vector<int> &output)
+{
+    while (!text.empty()) {
+        auto comma = text.find(',');
+        int cpu = 0;
+        if (!parse_number(text.substr(0, comma), cpu)) {
+            return false;
+        }
+        output.push_back(cpu);
+        text = comma == std::string_view::npos ? "" : text.substr(comma + 1);
+    }
+    return true;
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--ring spsc|mpsc] [--producers N] [--burst N] "
+        "[--capacity N]\n"
+        "    [--count N] [--round-trips N] [--cpus C0,C1,...]\n",
+        name);
+}
+
+// Spins first, then yields so oversubscribed cores still make progress
+struct Backoff
+{
+    void pause()
+    {
+        if (++m_spins % 1024 == 0) {
+            std::this_thread::yield();
+        }
+    }
+
+  private:
+    uint64_t m_spins = 0;
+};
+
+// Thread `idx` goes to the idx-th listed cpu, unpinned past the list
+static void pin(const Options &options, size_t idx)
+{
+    if (idx >= options.cpus.size()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(options.cpus[idx], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+template <typename Ring>
+static double run_throughput(const Options &options, size_t nb_producers)
+{
+    Ring ring(options.capacity);
+    uint64_t per_producer = options.count / nb_producers;
+    uint64_t total = per_producer * nb_producers;
+
+    // Enough buffers that none is reused while still queued
+    size_t nb_buffers = ring.capacity() + options.burst * (nb_producers + 1);
+    std::vector<std::vector<std::byte>> pools(nb_producers);
+    for (auto &pool : pools) {
+        pool.resize(nb_buffers * packet_size);
+    }
+
+    std::atomic<bool> go{false};
+    std::vector<std::jthread> producers;
+    for (size_t p = 0; p < nb_producers; p++) {
+        producers.emplace_back([&, p] {
+            pin(options, p + 1);
+            Backoff backoff;
+            while (!go.load(std::memory_order_acquire)) {
+                backoff.pause();
+            }
+
+            std::vector<Handle> burst(options.burst);
+            uint64_t sent = 0;
+            size_t next_buffer = 0;
+            while (sent < per_producer) {
+                size_t n =
+                    std::min<uint64_t>(burst.size(), per_producer - sent);
+                for (size_t idx = 0; idx < n; idx++) {
+                    std::byte *data = &pools[p][next_buffer * packet_size];
+                    next_buffer = (next_buffer + 1) % nb_buffers;
+                    data[4] = std::byte(sent + idx);
+                    burst[idx] = Handle{data, packet_size};
+                }
+
+                auto pending = std::span<const Handle>(burst).first(n);
+                while (!pending.empty()) {
+                    size_t pushed = ring.push_burst(pending);
+                    pending = pending.subspan(pushed);
+                    if (pushed == 0) {
+                        backoff.pause();
+                    }
+                }
+                sent += n;
+            }
+        });
+    }
+
+    pin(options, 0);
+    std::vector<Handle> burst(options.burst);
+    Backoff backoff;
+    uint64_t received = 0;
+    uint64_t checksum = 0;
+    go.store(true, std::memory_order_release);
+    auto start = std::chrono::steady_clock::now();
+    while (received < total) {
+        size_t n = ring.pop_burst(burst);
+        if (n == 0) {
+            backoff.pause();
+        }
+        for (size_t idx = 0; idx < n; idx++) {
+            auto payload =
+                std::span<const std::byte>(burst[idx].data, burst[idx].size);
+            DHCP::HeaderView header(payload);
+            checksum += header.xid().value_or(0);
+        }
+        received += n;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    for (auto &thread : producers) {
+        thread.join();
+    }
+
+    sink = checksum;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / total;
+}
+
+static double run_ping_pong(const Options &options)
+{
+    SpscRing<Handle> ping(options.capacity);
+    SpscRing<Handle> pong(options.capacity);
+    std::vector<std::byte> buffer(packet_size);
+
+    std::jthread echo([&] {
+        pin(options, 1);
+        Backoff backoff;
+        for (uint64_t idx = 0; idx < options.round_trips; idx++) {
+            std::optional<Handle> handle;
+            while (!(handle = ping.pop())) {
+                backoff.pause();
+            }
+            handle->data[4] = std::byte(idx);
+            while (!pong.push(*handle)) {
+                backoff.pause();
+            }
+        }
+    });
+
+    pin(options, 0);
+    Backoff backoff;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t idx = 0; idx < options.round_trips; idx++) {
+        while (!ping.push(Handle{buffer.data(), packet_size})) {
+            backoff.pause();
+        }
+        while (!pong.pop()) {
+            backoff.pause();
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    echo.join();
+
+    double round_trip = std::chrono::duration<double, std::nano>(elapsed)
+                            .count() /
+                        options.round_trips;
+    return round_trip / 2;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int idx = 1; idx < argc; idx++) {
+        std::string_view key = argv[idx];
+        if (idx + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++idx];
+
+        bool parsed = true;
+        if (key == "--ring") {
+            parsed = value == "spsc" || value == "mpsc";
+            options.mpsc = value == "mpsc";
+        } else if (key == "--producers") {
+            parsed = parse_number(value, options.nb_producers);
+        } else if (key == "--burst") {
+            parsed = parse_number(value, options.burst);
+        } else if (key == "--capacity") {
+            parsed = parse_number(value, options.capacity);
+        } else if (key == "--count") {
+            parsed = parse_number(value, options.count);
+        } else if (key == "--round-trips") {
+            parsed = parse_number(value, options.round_trips);
+        } else if (key == "--cpus") {
+            parsed = parse_cpus(value, options.cpus);
+        } else {
+            parsed = false;
+        }
+
+        parsed = parsed && options.burst != 0 && options.nb_producers != 0;
+        if (!parsed) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!options.mpsc) {
+        options.nb_producers = 1;
+    }
+
+    double per_item = options.mpsc
+                          ? run_throughput<MpscRing<Handle>>(
+                                options, options.nb_producers)
+                          : run_throughput<SpscRing<Handle>>(options, 1);
+    std::printf(
+        "%s producers %zu burst %zu: %.2f ns/packet, %.1f Mpackets/s\n",
+        options.mpsc ? "mpsc" : "spsc",
+        options.nb_producers,
+        options.burst,
+        per_item,
+        1e3 / per_item);
+    std::printf("one way handoff latency %.1f ns\n", run_ping_pong(options));
+    return 0;
+}
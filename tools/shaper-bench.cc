@@ -0,0 +1,209 @@
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/EgressScheduler.hh>
+#include <xnet/IPv4.hh>
+#include <xnet/TrafficShaper.hh>
+#include <xnet/UDPGenerator.hh>
+#include <xnet/UDPSocket.hh>
+
+using namespace xnet;
+
+/*
+ * Accuracy and cost of the TrafficShaper at 10 Gbit/s class rates. Two
+ * flows are offered faster than their limits: bulk (to 10.1.0.0/16, capped
+ * at --bulk) and everything else, both under a --link root. Shaped packets
+ * are dropped or, with --send, sent to the discard port on loopback.
+ * Reports the rate each leaf got against what it should have got.
+ */
+
+struct Options
+{
+    uint64_t link_bps = 10'000'000'000;
+    uint64_t bulk_bps = 2'000'000'000;
+    uint16_t payload = 1400;
+    bool send = false;
+    std::chrono::milliseconds duration{2000};
+};
+
+constexpr size_t batch_size = 64;
+
+template <typename T>
+static bool parse_number(std::string_view text, T &output)
+{
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), output);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static bool parse_flag(std::string_view text, bool &output)
+{
+    output = text == "1";
+    return text == "0" || text == "1";
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--link BPS] [--bulk BPS] [--payload N] [--send 0|1] "
+        "[--duration MS]\n",
+        name);
+}
+
+// One prepared packet per flow, queued again as soon as it left
+struct Flow
+{
+    std::vector<std::byte> slot;
+    std::span<const std::byte> packet;
+};
+
+static Flow make_flow(IPv4::Address destination, uint16_t payload)
+{
+    UDP::GeneratorConfig config;
+    config.destination = UDP::Endpoint{destination, 9};
+    config.payload_size = payload;
+    UDP::PacketGenerator generator(config);
+
+    Flow output;
+    output.slot.resize(generator.packet_size());
+    generator.prepare(output.slot, output.slot.size());
+    generator.next(output.slot);
+    output.packet = output.slot;
+    return output;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int idx = 1; idx < argc; idx++) {
+        std::string_view key = argv[idx];
+        if (idx + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++idx];
+
+        bool parsed = true;
+        uint64_t ms = 0;
+        if (key == "--link") {
+            parsed = parse_number(value, options.link_bps);
+        } else if (key == "--bulk") {
+            parsed = parse_number(value, options.bulk_bps);
+        } else if (key == "--payload") {
+            parsed = parse_number(value, options.payload);
+        } else if (key == "--send") {
+            parsed = parse_flag(value, options.send);
+        } else if (key == "--duration") {
+            parsed = parse_number(value, ms);
+            options.duration = std::chrono::milliseconds(ms);
+        } else {
+            parsed = false;
+        }
+
+        parsed = parsed && options.link_bps != 0 && options.bulk_bps != 0 &&
+                 options.payload <= 1472;
+        if (!parsed) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    ShaperConfig config;
+    config.nodes = {
+        {ShaperNodeConfig::no_parent, options.link_bps, 256 * 1024, 1},
+        {0, options.bulk_bps, 64 * 1024, 4096},
+        {0, options.link_bps, 256 * 1024, 4096},
+    };
+    config.rules = {ShaperRule{IPv4::Address(10, 1, 0, 0), 16, {}, 1}};
+    config.default_node = 2;
+    auto shaper = TrafficShaper::create(config);
+    if (!shaper) {
+        std::fprintf(stderr, "invalid shaper config\n");
+        return 2;
+    }
+
+    std::optional<UDP::Socket> socket;
+    if (options.send) {
+        UDP::SocketOptions socket_options;
+        socket_options.bind_to = UDP::Endpoint{IPv4::Address(127, 0, 0, 1), 0};
+        socket_options.send_buffer = 8 << 20;
+        socket = UDP::Socket::open(socket_options);
+        if (!socket) {
+            std::perror("socket");
+            return 1;
+        }
+    }
+
+    std::array<Flow, 2> flows{
+        make_flow(IPv4::Address(10, 1, 0, 2), options.payload),
+        make_flow(IPv4::Address(10, 2, 0, 2), options.payload),
+    };
+    const UDP::Endpoint discard{IPv4::Address(127, 0, 0, 1), 9};
+    constexpr size_t headers = IPv4::minimal_header_size + UDP::header_size;
+
+    std::array<EgressPacket, batch_size> released;
+    UDP::SendBatch<batch_size> batch;
+    std::array<uint64_t, 2> bytes{};
+    uint64_t packets = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + options.duration;
+    while (std::chrono::steady_clock::now() < end) {
+        for (uint64_t flow = 0; flow < flows.size(); flow++) {
+            EgressPacket packet{flows[flow].packet, {}, flow};
+            while (shaper->enqueue(packet)) {
+            }
+        }
+
+        size_t n = shaper->release(released);
+        for (size_t idx = 0; idx < n; idx++) {
+            bytes[released[idx].user_data] += released[idx].data.size();
+            if (socket) {
+                batch.push(released[idx].data.subspan(headers), discard);
+            }
+        }
+        if (socket && batch.size() != 0) {
+            socket->send_batch(batch);
+        }
+        packets += n;
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    uint64_t expected_bulk = std::min(options.bulk_bps, options.link_bps);
+    std::array<uint64_t, 2> expected{
+        expected_bulk, options.link_bps - expected_bulk};
+    std::array<const char *, 2> names{"bulk", "other"};
+    for (size_t flow = 0; flow < flows.size(); flow++) {
+        double rate = bytes[flow] * 8 / seconds;
+        double error =
+            expected[flow] == 0 ? 0 : (rate / expected[flow] - 1) * 100;
+        std::printf(
+            "%-6s %8.3f Gbit/s, expected %8.3f, error %+.2f %%\n",
+            names[flow],
+            rate / 1e9,
+            expected[flow] / 1e9,
+            error);
+    }
+    std::printf(
+        "%lu packets of %zu bytes in %.3f s: %.2f Mpackets/s, throttled "
+        "bulk %lu other %lu\n",
+        packets,
+        flows[0].packet.size(),
+        seconds,
+        packets / seconds / 1e6,
+        shaper->stats(1).throttled,
+        shaper->stats(2).throttled);
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <xnet/DHCPLoadGenerator.hh>
+#include <xnet/HotRestart.hh>
+#include <xnet/SharedPacketRing.hh>
+
+using namespace xnet;
+
+/*
+ * Loopback throughput of SharedPacketRing: a forked consumer attaches to
+ * the ring through descriptors passed over a socketpair, validates every
+ * packet through IPv4::PacketView and counts how often it found no work.
+ */
+
+struct Options
+{
+    uint32_t nb_slots = 4096;
+    size_t batch = 32;
+    uint64_t count = 10'000'000;
+};
+
+struct ConsumerReport
+{
+    uint64_t packets = 0;
+    uint64_t invalid = 0;
+    uint64_t empty = 0;
+};
+
+template <typename T>
+static bool parse_number(std::string_view text, T &output)
+{
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), output);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--slots N] [--batch N] [--count N]\n",
+        name);
+}
+
+static int run_consumer(int control, uint64_t count)
+{
+    std::byte tag{};
+    auto fds = HotRestart::receive_fds(control, tag);
+    if (!fds || fds->size() != 2) {
+        return 1;
+    }
+    auto ring = SharedPacketRing::attach((*fds)[0], (*fds)[1]);
+    if (!ring) {
+        return 1;
+    }
+
+    ConsumerReport report;
+    while (report.packets < count) {
+        if (ring->available() == 0) {
+            report.empty++;
+            ring->wait(std::chrono::milliseconds(100));
+        }
+        report.packets += ring->consume(64, [&](IPv4::PacketView view) {
+            report.invalid += view.is_not_valid();
+        });
+    }
+
+    return ::write(control, &report, sizeof(report)) == sizeof(report) ? 0
+                                                                        : 1;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int idx = 1; idx < argc; idx++) {
+        std::string_view key = argv[idx];
+        if (idx + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++idx];
+
+        bool parsed = true;
+        if (key == "--slots") {
+            parsed = parse_number(value, options.nb_slots);
+        } else if (key == "--batch") {
+            parsed = parse_number(value, options.batch);
+        } else if (key == "--count") {
+            parsed = parse_number(value, options.count);
+        } else {
+            parsed = false;
+        }
+
+        if (!parsed || options.batch == 0) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    int pair[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0) {
+        std::perror("socketpair");
+        return 1;
+    }
+
+    pid_t child = ::fork();
+    if (child == 0) {
+        ::close(pair[0]);
+        ::_exit(run_consumer(pair[1], options.count));
+    }
+    ::close(pair[1]);
+
+    auto ring = SharedPacketRing::create(
+        options.nb_slots, DHCP::PacketTemplate::max_size);
+    if (!ring) {
+        std::perror("shm-ring-bench");
+        return 1;
+    }
+    std::array<int, 2> fds{ring->memory_fd(), ring->event_fd()};
+    if (!HotRestart::send_fds(pair[0], fds, std::byte('F'))) {
+        std::perror("send_fds");
+        return 1;
+    }
+
+    auto packet = DHCP::PacketTemplate::make(
+        DHCP::MessageType::DHCPDISCOVER,
+        false,
+        UDP::Endpoint{IPv4::Address(10, 0, 0, 1), DHCP::client_port},
+        UDP::Endpoint{IPv4::Address(10, 0, 0, 2), DHCP::server_port});
+    auto bytes = std::span<const std::byte>(packet.data).first(packet.size);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sent = 0;
+    uint64_t full = 0;
+    while (sent < options.count) {
+        size_t batch = std::min<uint64_t>(options.batch, options.count - sent);
+        size_t pushed = 0;
+        while (pushed < batch && ring->push(bytes)) {
+            pushed++;
+        }
+        ring->flush();
+        sent += pushed;
+        if (pushed < batch) {
+            full++;
+            std::this_thread::yield();
+        }
+    }
+
+    ConsumerReport report;
+    bool complete =
+        ::read(pair[0], &report, sizeof(report)) == sizeof(report);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ::waitpid(child, nullptr, 0);
+    if (!complete) {
+        std::fprintf(stderr, "consumer failed\n");
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::printf(
+        "%lu packets of %zu bytes in %.3f s: %.2f Mpackets/s, %.1f ns/packet\n",
+        report.packets,
+        bytes.size(),
+        seconds,
+        report.packets / seconds / 1e6,
+        seconds * 1e9 / report.packets);
+    std::printf(
+        "invalid %lu, ring found empty %lu and full %lu times\n",
+        report.invalid,
+        report.empty,
+        full);
+    return report.invalid == 0 ? 0 : 1;
+}
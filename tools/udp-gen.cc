@@ -0,0 +1,155 @@
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/IPv4.hh>
+#include <xnet/RawSocket.hh>
+#include <xnet/UDPGenerator.hh>
+#include <xnet/UDPSocket.hh>
+
+using namespace xnet;
+
+/*
+ * IPv4/UDP flood from a PacketGenerator. Without --send only the
+ * generation rate is measured, the batches are built and dropped. With it
+ * they go out through a raw socket (needs CAP_NET_RAW), by default to the
+ * discard port on loopback.
+ */
+
+struct Options
+{
+    UDP::GeneratorConfig generator{
+        .source = UDP::Endpoint{IPv4::Address(127, 0, 0, 1), 1024},
+        .destination = UDP::Endpoint{IPv4::Address(127, 0, 0, 1), 9},
+    };
+    bool send = false;
+    std::string_view interface{};
+    uint64_t count = 50'000'000;
+};
+
+constexpr size_t batch_size = 64;
+constexpr size_t slot_size = 2048;
+
+template <typename T>
+static bool parse_number(std::string_view text, T &output)
+{
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), output);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static bool parse_flag(std::string_view text, bool &output)
+{
+    output = text == "1";
+    return text == "0" || text == "1";
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--send 0|1] [--interface NAME] [--count N] "
+        "[--payload N]\n"
+        "    [--sources N] [--source-ports N] [--destinations N] "
+        "[--destination-ports N]\n",
+        name);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    UDP::GeneratorConfig &g = options.generator;
+
+    for (int idx = 1; idx < argc; idx++) {
+        std::string_view key = argv[idx];
+        if (idx + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++idx];
+
+        bool parsed = true;
+        if (key == "--send") {
+            parsed = parse_flag(value, options.send);
+        } else if (key == "--interface") {
+            options.interface = value;
+        } else if (key == "--count") {
+            parsed = parse_number(value, options.count);
+        } else if (key == "--payload") {
+            parsed = parse_number(value, g.payload_size);
+        } else if (key == "--sources") {
+            parsed = parse_number(value, g.nb_sources);
+        } else if (key == "--source-ports") {
+            parsed = parse_number(value, g.nb_source_ports);
+        } else if (key == "--destinations") {
+            parsed = parse_number(value, g.nb_destinations);
+        } else if (key == "--destination-ports") {
+            parsed = parse_number(value, g.nb_destination_ports);
+        } else {
+            parsed = false;
+        }
+
+        parsed = parsed && g.nb_sources != 0 && g.nb_source_ports != 0 &&
+                 g.nb_destinations != 0 && g.nb_destination_ports != 0 &&
+                 g.payload_size <= slot_size - UDP::header_size -
+                                       IPv4::minimal_header_size;
+        if (!parsed) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::optional<IPv4::RawSocket> socket;
+    if (options.send) {
+        IPv4::RawSocketOptions raw;
+        raw.interface = options.interface;
+        raw.send_buffer = 8 << 20;
+        socket = IPv4::RawSocket::open(raw);
+        if (!socket) {
+            std::perror("raw socket");
+            return 1;
+        }
+    }
+
+    UDP::PacketGenerator generator(g);
+    std::vector<std::byte> slots(batch_size * slot_size);
+    generator.prepare(slots, slot_size);
+    UDP::SendBatch<batch_size> batch;
+
+    uint64_t sent = 0;
+    uint64_t errors = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (generator.sequence() < options.count) {
+        generator.fill(slots, slot_size, batch);
+        if (!socket) {
+            sent += batch.size();
+            batch.clear();
+        } else {
+            size_t size = batch.size();
+            size_t n = socket->send_batch(batch);
+            sent += n;
+            errors += size - n;
+        }
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    std::printf(
+        "%lu packets of %zu bytes in %.3f s: %.2f Mpackets/s, %.2f Gbit/s, "
+        "%lu send errors\n",
+        sent,
+        generator.packet_size(),
+        seconds,
+        sent / seconds / 1e6,
+        sent * generator.packet_size() * 8 / seconds / 1e9,
+        errors);
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <xnet/DHCP.hh>
+#include <xnet/DHCPLoadGenerator.hh>
+#include <xnet/UDPSocket.hh>
+#include <xnet/UDPUring.hh>
+
+using namespace xnet;
+
+/*
+ * Loopback receive rate of the recvmmsg path against UringSocket. A sender
+ * thread floods DHCPDISCOVERs, the receiver parses each one and the run
+ * ends once the flood stops. Datagrams the receiver was too slow for are
+ * dropped by the kernel and show up as lost.
+ */
+
+struct Options
+{
+    bool recvmmsg = true;
+    bool uring = true;
+    bool sqpoll = false;
+    bool zero_copy = false;
+    size_t burst = 32;
+    uint64_t count = 2'000'000;
+};
+
+struct Result
+{
+    uint64_t received = 0;
+    uint64_t invalid = 0;
+    double seconds = 0;
+};
+
+// Keeps the receiver's reads from being optimized out
+static volatile uint64_t sink;
+
+template <typename T>
+static bool parse_number(std::string_view text, T &output)
+{
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), output);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+static bool parse_flag(std::string_view text, bool &output)
+{
+    output = text == "1";
+    return text == "0" || text == "1";
+}
+
+static void usage(const char *name)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s [--backend recvmmsg|uring|both] [--sqpoll 0|1] "
+        "[--zero-copy 0|1]\n"
+        "    [--burst N] [--count N]\n",
+        name);
+}
+
+static std::optional<UDP::Socket> open_socket()
+{
+    UDP::SocketOptions options;
+    options.bind_to = UDP::Endpoint{IPv4::Address(127, 0, 0, 1), 0};
+    options.receive_buffer = 8 << 20;
+    options.send_buffer = 8 << 20;
+    return UDP::Socket::open(options);
+}
+
+/*
+ * Sends `count` copies of a DISCOVER with the xid as sequence number, with
+ * sendmmsg or, for zero copy, through a UringSocket.
+ */
+static void flood(const Options &options, UDP::Endpoint target)
+{
+    auto socket = open_socket();
+    if (!socket) {
+        return;
+    }
+
+    auto packet = DHCP::PacketTemplate::make(
+        DHCP::MessageType::DHCPDISCOVER,
+        false,
+        UDP::Endpoint{IPv4::Address(127, 0, 0, 1), DHCP::client_port},
+        target);
+    auto payload = std::span<const std::byte>(packet.data)
+                       .first(packet.size)
+                       .subspan(DHCP::PacketTemplate::dhcp_offset);
+    constexpr size_t xid_offset = DHCP::PacketTemplate::xid_offset -
+                                  DHCP::PacketTemplate::dhcp_offset;
+
+    std::optional<UDP::UringSocket> uring;
+    if (options.zero_copy) {
+        UDP::UringConfig config;
+        config.zero_copy_send = true;
+        config.nb_buffers = 1;
+        uring = UDP::UringSocket::open(std::move(*socket), config);
+        if (!uring) {
+            std::fprintf(stderr, "zero copy sender unavailable\n");
+            return;
+        }
+    }
+
+    std::vector<std::vector<std::byte>> copies(
+        options.burst, std::vector<std::byte>(payload.begin(), payload.end()));
+    UDP::SendBatch<64> batch;
+    uint64_t sent = 0;
+    while (sent < options.count) {
+        size_t n = std::min<uint64_t>(options.burst, options.count - sent);
+        for (size_t idx = 0; idx < n; idx++) {
+            auto xid = htobe<uint32_t>(sent + idx);
+            std::ranges::copy(xid, copies[idx].begin() + xid_offset);
+            if (uring) {
+                while (!uring->send(copies[idx], target)) {
+                    uring->submit();
+                }
+            } else {
+                batch.push(copies[idx], target);
+            }
+        }
+        if (uring) {
+            uring->submit();
+        } else {
+            socket->send_batch(batch);
+        }
+        sent += n;
+    }
+    if (uring) {
+        std::array<UDP::UringDatagram, 1> none;
+        uring->receive(none, std::chrono::milliseconds(10));
+    }
+}
+
+// Receives until nothing arrived for `idle`
+template <typename Receive>
+static Result run(const Options &options, UDP::Endpoint target, Receive recv)
+{
+    constexpr auto idle = std::chrono::milliseconds(200);
+    Result result;
+    std::jthread sender([&] { flood(options, target); });
+
+    auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    uint64_t checksum = 0;
+    while (std::chrono::steady_clock::now() - last < idle) {
+        size_t n = recv([&](std::span<const std::byte> payload) {
+            DHCP::HeaderView header(payload);
+            auto xid = header.xid();
+            result.invalid += !xid.has_value();
+            checksum += xid.value_or(0);
+        });
+        if (n != 0) {
+            result.received += n;
+            last = std::chrono::steady_clock::now();
+        }
+    }
+    result.seconds = std::chrono::duration<double>(last - start).count();
+    sink = checksum;
+    return result;
+}
+
+static std::optional<Result> run_recvmmsg(const Options &options)
+{
+    auto socket = open_socket();
+    if (!socket) {
+        return std::nullopt;
+    }
+    auto target = *socket->local_endpoint();
+
+    auto batch = std::make_unique<UDP::RecvBatch<64>>();
+    return run(options, target, [&](auto &&handle) -> size_t {
+        auto n = socket->recv_batch(*batch, false).value_or(0);
+        if (n == 0) {
+            std::this_thread::yield();
+        }
+        for (size_t idx = 0; idx < n; idx++) {
+            handle(batch->payload(idx));
+        }
+        return n;
+    });
+}
+
+static std::optional<Result> run_uring(const Options &options)
+{
+    auto socket = open_socket();
+    if (!socket) {
+        return std::nullopt;
+    }
+    auto target = *socket->local_endpoint();
+
+    UDP::UringConfig config;
+    config.sqpoll = options.sqpoll;
+    auto uring = UDP::UringSocket::open(std::move(*socket), config);
+    if (!uring) {
+        return std::nullopt;
+    }
+
+    std::array<UDP::UringDatagram, 64> datagrams;
+    auto result = run(options, target, [&](auto &&handle) -> size_t {
+        auto n = uring->receive(datagrams, std::chrono::milliseconds(10))
+                     .value_or(0);
+        for (size_t idx = 0; idx < n; idx++) {
+            handle(datagrams[idx].view().payload().value_or(
+                std::span<const std::byte>()));
+            uring->recycle(datagrams[idx]);
+        }
+        return n;
+    });
+
+    const UDP::UringStats &stats = uring->stats();
+    std::printf(
+        "uring rearms %lu, out of buffers %lu, truncated %lu\n",
+        stats.rearms,
+        stats.no_buffers,
+        stats.truncated);
+    return result;
+}
+
+static void report(const char *name, const Options &options, Result result)
+{
+    std::printf(
+        "%-8s %lu of %lu datagrams in %.3f s: %.2f Mpackets/s, lost %lu, "
+        "invalid %lu\n",
+        name,
+        result.received,
+        options.count,
+        result.seconds,
+        result.received / result.seconds / 1e6,
+        options.count - result.received,
+        result.invalid);
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+
+    for (int idx = 1; idx < argc; idx++) {
+        std::string_view key = argv[idx];
+        if (idx + 1 == argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        std::string_view value = argv[++idx];
+
+        bool parsed = true;
+        if (key == "--backend") {
+            parsed = value == "recvmmsg" || value == "uring" || value == "both";
+            options.recvmmsg = value != "uring";
+            options.uring = value != "recvmmsg";
+        } else if (key == "--sqpoll") {
+            parsed = parse_flag(value, options.sqpoll);
+        } else if (key == "--zero-copy") {
+            parsed = parse_flag(value, options.zero_copy);
+        } else if (key == "--burst") {
+            parsed = parse_number(value, options.burst);
+        } else if (key == "--count") {
+            parsed = parse_number(value, options.count);
+        } else {
+            parsed = false;
+        }
+
+        parsed = parsed && options.burst != 0 && options.burst <= 64;
+        if (!parsed) {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (options.recvmmsg) {
+        auto result = run_recvmmsg(options);
+        if (!result) {
+            std::perror("recvmmsg");
+            return 1;
+        }
+        report("recvmmsg", options, *result);
+    }
+    if (options.uring) {
+        auto result = run_uring(options);
+        if (!result) {
+            std::perror("io_uring");
+            return 1;
+        }
+        report("uring", options, *result);
+    }
+    return 0;
+}